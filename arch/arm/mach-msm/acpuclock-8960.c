@@ -1563,6 +1563,8 @@ static struct acpuclk_data acpuclk_8960_data = {
 	.get_rate = acpuclk_8960_get_rate,
 	.power_collapse_khz = STBY_KHZ,
 	.wait_for_irq_khz = STBY_KHZ,
+	/* CPU clock MUXes are reachable from any CPU via L2 indirect regs. */
+	.remote_switch = true,
 };
 
 static int __init acpuclk_8960_init(struct acpuclk_soc_data *soc_data)
@@ -11,9 +11,19 @@
  */
 
 #include <linux/cpu.h>
+#include <linux/percpu.h>
+#include <asm/atomic.h>
 #include "acpuclock.h"
 
+/* Ownership of a CPU's clocks, arbitrated between idle and remote switches. */
+enum {
+	CLK_OWNER_LOCAL = 0,
+	CLK_OWNER_REMOTE,
+	CLK_OWNER_COLLAPSED,
+};
+
 static struct acpuclk_data *acpuclk_data;
+static DEFINE_PER_CPU(atomic_t, acpuclk_owner);
 
 unsigned long acpuclk_get_rate(int cpu)
 {
@@ -36,6 +46,37 @@ uint32_t acpuclk_get_switch_time(void)
 	return acpuclk_data->switch_time_us;
 }
 
+bool acpuclk_remote_begin(int cpu)
+{
+	/*
+	 * cpu_online() only skips CPUs that are already down.  A CPU going
+	 * offline right now is handled by the cmpxchg below: every power
+	 * collapse, including the one hotplug ends in, claims the clocks
+	 * first and waits for a remote switch that got here before it.
+	 */
+	if (!acpuclk_data->remote_switch || !cpu_online(cpu))
+		return false;
+
+	return atomic_cmpxchg(&per_cpu(acpuclk_owner, cpu), CLK_OWNER_LOCAL,
+			      CLK_OWNER_REMOTE) == CLK_OWNER_LOCAL;
+}
+
+void acpuclk_remote_end(int cpu)
+{
+	atomic_set(&per_cpu(acpuclk_owner, cpu), CLK_OWNER_LOCAL);
+}
+
+bool acpuclk_pc_enter(void)
+{
+	return atomic_cmpxchg(&__get_cpu_var(acpuclk_owner), CLK_OWNER_LOCAL,
+			      CLK_OWNER_COLLAPSED) == CLK_OWNER_LOCAL;
+}
+
+void acpuclk_pc_exit(void)
+{
+	atomic_set(&__get_cpu_var(acpuclk_owner), CLK_OWNER_LOCAL);
+}
+
 unsigned long acpuclk_power_collapse(void)
 {
 	unsigned long rate = acpuclk_get_rate(smp_processor_id());
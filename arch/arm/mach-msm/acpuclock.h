@@ -48,6 +48,7 @@ struct acpuclk_data {
 	uint32_t switch_time_us;
 	unsigned long power_collapse_khz;
 	unsigned long wait_for_irq_khz;
+	bool remote_switch;
 };
 
 /**
@@ -71,6 +72,37 @@ int acpuclk_set_rate(int cpu, unsigned long rate, enum setrate_reason);
  */
 uint32_t acpuclk_get_switch_time(void);
 
+/**
+ * acpuclk_remote_begin() - Claim another CPU's clocks for a rate switch
+ * @cpu: CPU whose rate is about to be set
+ *
+ * Returns true if the caller may call acpuclk_set_rate() for @cpu from a
+ * different CPU. The target CPU is kept out of power collapse until
+ * acpuclk_remote_end() is called. Returns false if the driver cannot
+ * switch remote CPUs or if @cpu is currently power collapsed.
+ */
+bool acpuclk_remote_begin(int cpu);
+
+/**
+ * acpuclk_remote_end() - Release a CPU claimed by acpuclk_remote_begin()
+ * @cpu: CPU passed to acpuclk_remote_begin()
+ */
+void acpuclk_remote_end(int cpu);
+
+/**
+ * acpuclk_pc_enter() - Mark the current CPU as entering power collapse
+ *
+ * Returns false if a remote rate switch owns this CPU's clocks, in which
+ * case the caller must not power collapse yet. Called for every power
+ * collapse: idle, suspend and hotplug.
+ */
+bool acpuclk_pc_enter(void);
+
+/**
+ * acpuclk_pc_exit() - Mark the current CPU as back from power collapse
+ */
+void acpuclk_pc_exit(void);
+
 /**
  * acpuclk_power_collapse() - Prepare current CPU clocks for power-collapse
  *
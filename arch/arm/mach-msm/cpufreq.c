@@ -117,10 +117,6 @@ static int msm_cpufreq_target(struct cpufreq_policy *policy,
 	struct cpufreq_frequency_table *table;
 #ifdef CONFIG_SMP
 	struct cpufreq_work_struct *cpu_work = NULL;
-	cpumask_var_t mask;
-
-	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
-		return -ENOMEM;
 
 	if (!cpu_active(policy->cpu)) {
 		pr_info("cpufreq: cpu %d is not active.\n", policy->cpu);
@@ -152,24 +148,33 @@ static int msm_cpufreq_target(struct cpufreq_policy *policy,
 #endif
 
 #ifdef CONFIG_SMP
+	/*
+	 * Callers bound to the target CPU (e.g. ondemand's per-cpu work)
+	 * switch in place. Otherwise try to switch the remote CPU directly
+	 * and only fall back to a worker on that CPU if the clock driver
+	 * cannot do so right now (e.g. the CPU is power collapsed).
+	 */
+	if (cpumask_equal(&current->cpus_allowed, cpumask_of(policy->cpu))) {
+		ret = set_cpu_freq(policy, table[index].frequency);
+		goto done;
+	}
+
+	if (acpuclk_remote_begin(policy->cpu)) {
+		ret = set_cpu_freq(policy, table[index].frequency);
+		acpuclk_remote_end(policy->cpu);
+		goto done;
+	}
+
 	cpu_work = &per_cpu(cpufreq_work, policy->cpu);
 	cpu_work->policy = policy;
 	cpu_work->frequency = table[index].frequency;
 	cpu_work->status = -ENODEV;
 
-	cpumask_clear(mask);
-	cpumask_set_cpu(policy->cpu, mask);
-	if (cpumask_equal(mask, &current->cpus_allowed)) {
-		ret = set_cpu_freq(cpu_work->policy, cpu_work->frequency);
-		goto done;
-	} else {
-		cancel_work_sync(&cpu_work->work);
-		INIT_COMPLETION(cpu_work->complete);
-		queue_work_on(policy->cpu, msm_cpufreq_wq, &cpu_work->work);
-		wait_for_completion(&cpu_work->complete);
-	}
+	cancel_work_sync(&cpu_work->work);
+	INIT_COMPLETION(cpu_work->complete);
+	queue_work_on(policy->cpu, msm_cpufreq_wq, &cpu_work->work);
+	wait_for_completion(&cpu_work->complete);
 
-	free_cpumask_var(mask);
 	ret = cpu_work->status;
 #else
 	ret = set_cpu_freq(policy, table[index].frequency);
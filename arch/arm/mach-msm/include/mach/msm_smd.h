@@ -19,6 +19,7 @@
 #define __ASM_ARCH_MSM_SMD_H
 
 typedef struct smd_channel smd_channel_t;
+struct kvec;
 
 #define SMD_MAX_CH_NAME_LEN 20 /* includes null char at end */
 
@@ -28,6 +29,9 @@ typedef struct smd_channel smd_channel_t;
 #define SMD_EVENT_STATUS 4
 #define SMD_EVENT_REOPEN_READY 5
 
+/* smd_writev() flags */
+#define SMD_WRITEV_MORE 0x1	/* more data follows, hold the interrupt */
+
 enum {
 	SMD_APPS_MODEM = 0,
 	SMD_APPS_QDSP,
@@ -75,6 +79,24 @@ int smd_write(smd_channel_t *ch, const void *data, int len);
  */
 int smd_write_user_buffer(smd_channel_t *ch, const void *data, int len);
 
+/* Writes the kernel buffers in @iov back to back and interrupts the other
+ * processor once for the whole batch rather than once per buffer.
+ * On a packet channel the buffers form a single packet, which is written
+ * completely or not at all (-ENOMEM); on a stream channel the write may be
+ * partial.  With SMD_WRITEV_MORE the interrupt is held back until the next
+ * write without it; smd_writev(ch, NULL, 0, 0) just sends it.
+ * Returns the number of bytes written or an error.
+ */
+int smd_writev(smd_channel_t *ch, const struct kvec *iov, int iovcnt,
+	       unsigned flags);
+
+/* Reads into the kernel buffers in @iov and interrupts the other processor
+ * once when done.  On a packet channel at most the rest of the current
+ * packet is read.  Not safe to call from the notify callback.
+ * Returns the number of bytes read or an error.
+ */
+int smd_readv(smd_channel_t *ch, const struct kvec *iov, int iovcnt);
+
 int smd_write_avail(smd_channel_t *ch);
 int smd_read_avail(smd_channel_t *ch);
 
@@ -263,6 +285,18 @@ static inline int smd_write_end(smd_channel_t *ch)
 {
 	return -ENODEV;
 }
+
+static inline int smd_writev(smd_channel_t *ch, const struct kvec *iov,
+			     int iovcnt, unsigned flags)
+{
+	return -ENODEV;
+}
+
+static inline int smd_readv(smd_channel_t *ch, const struct kvec *iov,
+			    int iovcnt)
+{
+	return -ENODEV;
+}
 #endif
 
 #endif
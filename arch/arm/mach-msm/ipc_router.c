@@ -27,6 +27,9 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/rcupdate.h>
+#include <linux/rculist.h>
+#include <linux/rwsem.h>
 
 #include <asm/uaccess.h>
 #include <asm/byteorder.h>
@@ -105,12 +108,14 @@ struct msm_ipc_server {
 	struct list_head list;
 	struct msm_ipc_port_name name;
 	struct list_head server_port_list;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_server_port {
 	struct list_head list;
 	struct msm_ipc_port_addr server_addr;
 	struct msm_ipc_router_xprt_info *xprt_info;
+	struct rcu_head rcu;
 };
 
 #define RP_HASH_SIZE 32
@@ -147,11 +152,15 @@ struct msm_ipc_routing_table_entry {
 	uint32_t neighbor_node_id;
 	struct list_head remote_port_list[RP_HASH_SIZE];
 	struct msm_ipc_router_xprt_info *xprt_info;
-	struct mutex lock;
+	struct rw_semaphore lock;
 	unsigned long num_tx_bytes;
 	unsigned long num_rx_bytes;
 };
 
+/*
+ * Routing table entries are only ever added, so lookups walk the hash
+ * chains under RCU; routing_table_lock serializes the writers.
+ */
 static struct list_head routing_table[RT_HASH_SIZE];
 static DEFINE_MUTEX(routing_table_lock);
 static int routing_table_inited;
@@ -220,7 +229,7 @@ static struct msm_ipc_routing_table_entry *alloc_routing_table_entry(
 	for (i = 0; i < RP_HASH_SIZE; i++)
 		INIT_LIST_HEAD(&rt_entry->remote_port_list[i]);
 
-	mutex_init(&rt_entry->lock);
+	init_rwsem(&rt_entry->lock);
 	rt_entry->node_id = node_id;
 	rt_entry->xprt_info = NULL;
 	return rt_entry;
@@ -236,24 +245,38 @@ static int add_routing_table_entry(
 		return -EINVAL;
 
 	key = (rt_entry->node_id % RT_HASH_SIZE);
-	list_add_tail(&rt_entry->list, &routing_table[key]);
+	list_add_tail_rcu(&rt_entry->list, &routing_table[key]);
 	return 0;
 }
 
-/*Please take routing_table_lock before calling this function*/
-static struct msm_ipc_routing_table_entry *lookup_routing_table(
+/*
+ * Call with routing_table_lock held, or from rcu_read_lock().  The entry
+ * stays valid after either is dropped, as entries are never freed.
+ */
+static struct msm_ipc_routing_table_entry *__lookup_routing_table(
 	uint32_t node_id)
 {
 	uint32_t key = (node_id % RT_HASH_SIZE);
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	list_for_each_entry(rt_entry, &routing_table[key], list) {
+	list_for_each_entry_rcu(rt_entry, &routing_table[key], list) {
 		if (rt_entry->node_id == node_id)
 			return rt_entry;
 	}
 	return NULL;
 }
 
+static struct msm_ipc_routing_table_entry *lookup_routing_table(
+	uint32_t node_id)
+{
+	struct msm_ipc_routing_table_entry *rt_entry;
+
+	rcu_read_lock();
+	rt_entry = __lookup_routing_table(node_id);
+	rcu_read_unlock();
+	return rt_entry;
+}
+
 struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
 {
 	struct rr_packet *temp_pkt;
@@ -372,12 +395,14 @@ static int post_control_ports(struct rr_packet *pkt)
 
 	mutex_lock(&control_ports_lock);
 	list_for_each_entry(port_ptr, &control_ports, list) {
-		mutex_lock(&port_ptr->port_rx_q_lock);
 		cloned_pkt = clone_pkt(pkt);
+		if (!cloned_pkt)
+			continue;
+		spin_lock(&port_ptr->port_rx_q_lock);
 		wake_lock(&port_ptr->port_rx_wake_lock);
 		list_add_tail(&cloned_pkt->list, &port_ptr->port_rx_q);
 		wake_up(&port_ptr->port_rx_wait_q);
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 	}
 	mutex_unlock(&control_ports_lock);
 	return 0;
@@ -428,7 +453,7 @@ void msm_ipc_router_add_local_port(struct msm_ipc_port *port_ptr)
 
 	key = (port_ptr->this_port.port_id & (LP_HASH_SIZE - 1));
 	mutex_lock(&local_ports_lock);
-	list_add_tail(&port_ptr->list, &local_ports[key]);
+	list_add_tail_rcu(&port_ptr->list, &local_ports[key]);
 	mutex_unlock(&local_ports_lock);
 }
 
@@ -455,7 +480,7 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 	INIT_LIST_HEAD(&port_ptr->incomplete);
 	mutex_init(&port_ptr->incomplete_lock);
 	INIT_LIST_HEAD(&port_ptr->port_rx_q);
-	mutex_init(&port_ptr->port_rx_q_lock);
+	spin_lock_init(&port_ptr->port_rx_q_lock);
 	init_waitqueue_head(&port_ptr->port_rx_wait_q);
 	wake_lock_init(&port_ptr->port_rx_wake_lock,
 			WAKE_LOCK_SUSPEND, "msm_ipc_read");
@@ -468,19 +493,20 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 	return port_ptr;
 }
 
+/*
+ * Call this function under rcu_read_lock() or with local_ports_lock held.
+ * The port stays valid until rcu_read_unlock(): closing a port waits
+ * for a grace period before freeing it.
+ */
 static struct msm_ipc_port *msm_ipc_router_lookup_local_port(uint32_t port_id)
 {
 	int key = (port_id & (LP_HASH_SIZE - 1));
 	struct msm_ipc_port *port_ptr;
 
-	mutex_lock(&local_ports_lock);
-	list_for_each_entry(port_ptr, &local_ports[key], list) {
-		if (port_ptr->this_port.port_id == port_id) {
-			mutex_unlock(&local_ports_lock);
+	list_for_each_entry_rcu(port_ptr, &local_ports[key], list) {
+		if (port_ptr->this_port.port_id == port_id)
 			return port_ptr;
-		}
 	}
-	mutex_unlock(&local_ports_lock);
 	return NULL;
 }
 
@@ -492,27 +518,23 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_lookup_remote_port(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node is not up\n", __func__);
 		return NULL;
 	}
 
-	mutex_lock(&rt_entry->lock);
+	down_read(&rt_entry->lock);
 	list_for_each_entry(rport_ptr,
 			    &rt_entry->remote_port_list[key], list) {
 		if (rport_ptr->port_id == port_id) {
 			if (rport_ptr->restart_state != RESTART_NORMAL)
 				rport_ptr = NULL;
-			mutex_unlock(&rt_entry->lock);
-			mutex_unlock(&routing_table_lock);
+			up_read(&rt_entry->lock);
 			return rport_ptr;
 		}
 	}
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	up_read(&rt_entry->lock);
 	return NULL;
 }
 
@@ -524,20 +546,17 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node is not up\n", __func__);
 		return NULL;
 	}
 
-	mutex_lock(&rt_entry->lock);
+	down_write(&rt_entry->lock);
 	rport_ptr = kmalloc(sizeof(struct msm_ipc_router_remote_port),
 			    GFP_KERNEL);
 	if (!rport_ptr) {
-		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
+		up_write(&rt_entry->lock);
 		pr_err("%s: Remote port alloc failed\n", __func__);
 		return NULL;
 	}
@@ -549,8 +568,7 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 	mutex_init(&rport_ptr->quota_lock);
 	list_add_tail(&rport_ptr->list,
 		      &rt_entry->remote_port_list[key]);
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	up_write(&rt_entry->lock);
 	return rport_ptr;
 }
 
@@ -564,22 +582,23 @@ static void msm_ipc_router_destroy_remote_port(
 		return;
 
 	node_id = rport_ptr->node_id;
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node %d is not up\n", __func__, node_id);
 		return;
 	}
 
-	mutex_lock(&rt_entry->lock);
+	down_write(&rt_entry->lock);
 	list_del(&rport_ptr->list);
 	kfree(rport_ptr);
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	up_write(&rt_entry->lock);
 	return;
 }
 
+/*
+ * Call this function under rcu_read_lock() or with server_list_lock
+ * held.  The server is freed after a grace period once it has no ports.
+ */
 static struct msm_ipc_server *msm_ipc_router_lookup_server(
 				uint32_t service,
 				uint32_t instance,
@@ -590,25 +609,19 @@ static struct msm_ipc_server *msm_ipc_router_lookup_server(
 	struct msm_ipc_server_port *server_port;
 	int key = (instance & (SRV_HASH_SIZE - 1));
 
-	mutex_lock(&server_list_lock);
-	list_for_each_entry(server, &server_list[key], list) {
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != service) ||
 		    (server->name.instance != instance))
 			continue;
-		if ((node_id == 0) && (port_id == 0)) {
-			mutex_unlock(&server_list_lock);
+		if ((node_id == 0) && (port_id == 0))
 			return server;
-		}
-		list_for_each_entry(server_port, &server->server_port_list,
-				    list) {
+		list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
 			if ((server_port->server_addr.node_id == node_id) &&
-			    (server_port->server_addr.port_id == port_id)) {
-				mutex_unlock(&server_list_lock);
+			    (server_port->server_addr.port_id == port_id))
 				return server;
-			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
 	return NULL;
 }
 
@@ -622,6 +635,7 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	struct msm_ipc_server *server = NULL;
 	struct msm_ipc_server_port *server_port;
 	int key = (instance & (SRV_HASH_SIZE - 1));
+	int new_server = 0;
 
 	mutex_lock(&server_list_lock);
 	list_for_each_entry(server, &server_list[key], list) {
@@ -639,15 +653,13 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	server->name.service = service;
 	server->name.instance = instance;
 	INIT_LIST_HEAD(&server->server_port_list);
-	list_add_tail(&server->list, &server_list[key]);
+	new_server = 1;
 
 create_srv_port:
 	server_port = kmalloc(sizeof(struct msm_ipc_server_port), GFP_KERNEL);
 	if (!server_port) {
-		if (list_empty(&server->server_port_list)) {
-			list_del(&server->list);
+		if (new_server)
 			kfree(server);
-		}
 		mutex_unlock(&server_list_lock);
 		pr_err("%s: Server Port allocation failed\n", __func__);
 		return NULL;
@@ -655,36 +667,46 @@ create_srv_port:
 	server_port->server_addr.node_id = node_id;
 	server_port->server_addr.port_id = port_id;
 	server_port->xprt_info = xprt_info;
-	list_add_tail(&server_port->list, &server->server_port_list);
+	list_add_tail_rcu(&server_port->list, &server->server_port_list);
+	/* publish a new server only once it has a port */
+	if (new_server)
+		list_add_tail_rcu(&server->list, &server_list[key]);
 	mutex_unlock(&server_list_lock);
 
 	return server;
 }
 
-static void msm_ipc_router_destroy_server(struct msm_ipc_server *server,
-					  uint32_t node_id, uint32_t port_id)
+static int msm_ipc_router_destroy_server(uint32_t service, uint32_t instance,
+					 uint32_t node_id, uint32_t port_id)
 {
+	struct msm_ipc_server *server;
 	struct msm_ipc_server_port *server_port;
-
-	if (!server)
-		return;
+	int found = 0;
 
 	mutex_lock(&server_list_lock);
+	server = msm_ipc_router_lookup_server(service, instance,
+					      node_id, port_id);
+	if (!server) {
+		mutex_unlock(&server_list_lock);
+		return -ENODEV;
+	}
 	list_for_each_entry(server_port, &server->server_port_list, list) {
 		if ((server_port->server_addr.node_id == node_id) &&
-		    (server_port->server_addr.port_id == port_id))
+		    (server_port->server_addr.port_id == port_id)) {
+			found = 1;
 			break;
+		}
 	}
-	if (server_port) {
-		list_del(&server_port->list);
-		kfree(server_port);
+	if (found) {
+		list_del_rcu(&server_port->list);
+		kfree_rcu(server_port, rcu);
 	}
 	if (list_empty(&server->server_port_list)) {
-		list_del(&server->list);
-		kfree(server);
+		list_del_rcu(&server->list);
+		kfree_rcu(server, rcu);
 	}
 	mutex_unlock(&server_list_lock);
-	return;
+	return found ? 0 : -ENODEV;
 }
 
 static int msm_ipc_router_send_control_msg(
@@ -958,36 +980,37 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 
 	hdr = (struct rr_header *)head_pkt->data;
 	dst_node_id = hdr->dst_node_id;
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(dst_node_id);
-	if (!(rt_entry) || !(rt_entry->xprt_info)) {
-		mutex_unlock(&routing_table_lock);
+	if (!rt_entry) {
 		pr_err("%s: Routing table not initialized\n", __func__);
 		return -ENODEV;
 	}
 
-	mutex_lock(&rt_entry->lock);
+	down_read(&rt_entry->lock);
 	fwd_xprt_info = rt_entry->xprt_info;
+	if (!fwd_xprt_info) {
+		up_read(&rt_entry->lock);
+		pr_err("%s: Routing table not initialized\n", __func__);
+		return -ENODEV;
+	}
+
 	mutex_lock(&fwd_xprt_info->tx_lock);
 	if (xprt_info->remote_node_id == fwd_xprt_info->remote_node_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
-		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
+		up_read(&rt_entry->lock);
 		pr_err("%s: Discarding Command to route back\n", __func__);
 		return -EINVAL;
 	}
 
 	if (xprt_info->xprt->link_id == fwd_xprt_info->xprt->link_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
-		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
+		up_read(&rt_entry->lock);
 		pr_err("%s: DST in the same cluster\n", __func__);
 		return 0;
 	}
 	fwd_xprt_info->xprt->write(pkt, pkt->length, 0);
 	mutex_unlock(&fwd_xprt_info->tx_lock);
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	up_read(&rt_entry->lock);
 
 	return 0;
 }
@@ -1043,12 +1066,12 @@ static void msm_ipc_cleanup_remote_server_info(
 				ctl.srv.port_id = svr_port->server_addr.port_id;
 				relay_ctl_msg(xprt_info, &ctl);
 				broadcast_ctl_msg_locally(&ctl);
-				list_del(&svr_port->list);
-				kfree(svr_port);
+				list_del_rcu(&svr_port->list);
+				kfree_rcu(svr_port, rcu);
 			}
 			if (list_empty(&svr->server_port_list)) {
-				list_del(&svr->list);
-				kfree(svr);
+				list_del_rcu(&svr->list);
+				kfree_rcu(svr, rcu);
 			}
 		}
 	}
@@ -1072,9 +1095,9 @@ static void msm_ipc_cleanup_remote_client_info(
 	mutex_lock(&routing_table_lock);
 	for (i = 0; i < RT_HASH_SIZE; i++) {
 		list_for_each_entry(rt_entry, &routing_table[i], list) {
-			mutex_lock(&rt_entry->lock);
+			down_write(&rt_entry->lock);
 			if (rt_entry->xprt_info != xprt_info) {
-				mutex_unlock(&rt_entry->lock);
+				up_write(&rt_entry->lock);
 				continue;
 			}
 			for (j = 0; j < RP_HASH_SIZE; j++) {
@@ -1092,7 +1115,7 @@ static void msm_ipc_cleanup_remote_client_info(
 					broadcast_ctl_msg_locally(&ctl);
 				}
 			}
-			mutex_unlock(&rt_entry->lock);
+			up_write(&rt_entry->lock);
 		}
 	}
 	mutex_unlock(&routing_table_lock);
@@ -1108,9 +1131,9 @@ static void msm_ipc_cleanup_remote_port_info(uint32_t node_id)
 	for (i = 0; i < RT_HASH_SIZE; i++) {
 		list_for_each_entry_safe(rt_entry, tmp_rt_entry,
 					 &routing_table[i], list) {
-			mutex_lock(&rt_entry->lock);
+			down_write(&rt_entry->lock);
 			if (rt_entry->neighbor_node_id != node_id) {
-				mutex_unlock(&rt_entry->lock);
+				up_write(&rt_entry->lock);
 				continue;
 			}
 			for (j = 0; j < RP_HASH_SIZE; j++) {
@@ -1121,7 +1144,7 @@ static void msm_ipc_cleanup_remote_port_info(uint32_t node_id)
 					kfree(rport_ptr);
 				}
 			}
-			mutex_unlock(&rt_entry->lock);
+			up_write(&rt_entry->lock);
 		}
 	}
 	mutex_unlock(&routing_table_lock);
@@ -1141,10 +1164,10 @@ static void msm_ipc_cleanup_routing_table(
 	mutex_lock(&routing_table_lock);
 	for (i = 0; i < RT_HASH_SIZE; i++) {
 		list_for_each_entry(rt_entry, &routing_table[i], list) {
-			mutex_lock(&rt_entry->lock);
+			down_write(&rt_entry->lock);
 			if (rt_entry->xprt_info == xprt_info)
 				rt_entry->xprt_info = NULL;
-			mutex_unlock(&rt_entry->lock);
+			up_write(&rt_entry->lock);
 		}
 	}
 	mutex_unlock(&routing_table_lock);
@@ -1200,7 +1223,7 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 		xprt_info->remote_node_id = hdr->src_node_id;
 
 		mutex_lock(&routing_table_lock);
-		rt_entry = lookup_routing_table(hdr->src_node_id);
+		rt_entry = __lookup_routing_table(hdr->src_node_id);
 		if (!rt_entry) {
 			rt_entry = alloc_routing_table_entry(hdr->src_node_id);
 			if (!rt_entry) {
@@ -1211,10 +1234,10 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 			}
 			add_routing_table_entry(rt_entry);
 		}
-		mutex_lock(&rt_entry->lock);
+		down_write(&rt_entry->lock);
 		rt_entry->neighbor_node_id = xprt_info->remote_node_id;
 		rt_entry->xprt_info = xprt_info;
-		mutex_unlock(&rt_entry->lock);
+		up_write(&rt_entry->lock);
 		mutex_unlock(&routing_table_lock);
 		msm_ipc_cleanup_remote_port_info(xprt_info->remote_node_id);
 
@@ -1262,7 +1285,7 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 		   msg->srv.service, msg->srv.instance);
 
 		mutex_lock(&routing_table_lock);
-		rt_entry = lookup_routing_table(msg->srv.node_id);
+		rt_entry = __lookup_routing_table(msg->srv.node_id);
 		if (!rt_entry) {
 			rt_entry = alloc_routing_table_entry(msg->srv.node_id);
 			if (!rt_entry) {
@@ -1271,18 +1294,20 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 					__func__);
 				return -ENOMEM;
 			}
-			mutex_lock(&rt_entry->lock);
+			down_write(&rt_entry->lock);
 			rt_entry->neighbor_node_id = xprt_info->remote_node_id;
 			rt_entry->xprt_info = xprt_info;
-			mutex_unlock(&rt_entry->lock);
+			up_write(&rt_entry->lock);
 			add_routing_table_entry(rt_entry);
 		}
 		mutex_unlock(&routing_table_lock);
 
+		rcu_read_lock();
 		server = msm_ipc_router_lookup_server(msg->srv.service,
 						      msg->srv.instance,
 						      msg->srv.node_id,
 						      msg->srv.port_id);
+		rcu_read_unlock();
 		if (!server) {
 			server = msm_ipc_router_create_server(
 				msg->srv.service, msg->srv.instance,
@@ -1309,14 +1334,10 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	case IPC_ROUTER_CTRL_CMD_REMOVE_SERVER:
 		RR("o REMOVE_SERVER service=%08x:%d\n",
 		   msg->srv.service, msg->srv.instance);
-		server = msm_ipc_router_lookup_server(msg->srv.service,
-						      msg->srv.instance,
-						      msg->srv.node_id,
-						      msg->srv.port_id);
-		if (server) {
-			msm_ipc_router_destroy_server(server,
-						      msg->srv.node_id,
-						      msg->srv.port_id);
+		if (!msm_ipc_router_destroy_server(msg->srv.service,
+						   msg->srv.instance,
+						   msg->srv.node_id,
+						   msg->srv.port_id)) {
 			relay_msg(xprt_info, pkt);
 			post_control_ports(pkt);
 		}
@@ -1353,6 +1374,8 @@ static void do_read_data(struct work_struct *work)
 	struct msm_ipc_port_addr *src_addr;
 	struct msm_ipc_router_remote_port *rport_ptr;
 	uint32_t resume_tx, resume_tx_node_id, resume_tx_port_id;
+	void (*notify)(unsigned event, void *data, void *addr, void *priv);
+	void *priv;
 
 	struct msm_ipc_router_xprt_info *xprt_info =
 		container_of(work,
@@ -1427,14 +1450,6 @@ static void do_read_data(struct work_struct *work)
 	resume_tx_node_id = hdr->dst_node_id;
 	resume_tx_port_id = hdr->dst_port_id;
 
-	port_ptr = msm_ipc_router_lookup_local_port(hdr->dst_port_id);
-	if (!port_ptr) {
-		pr_err("%s: No local port id %08x\n", __func__,
-			hdr->dst_port_id);
-		release_pkt(pkt);
-		goto process_done;
-	}
-
 	rport_ptr = msm_ipc_router_lookup_remote_port(hdr->src_node_id,
 						      hdr->src_port_id);
 	if (!rport_ptr) {
@@ -1448,13 +1463,27 @@ static void do_read_data(struct work_struct *work)
 		}
 	}
 
+	rcu_read_lock();
+	port_ptr = msm_ipc_router_lookup_local_port(hdr->dst_port_id);
+	if (!port_ptr) {
+		rcu_read_unlock();
+		pr_err("%s: No local port id %08x\n", __func__,
+			hdr->dst_port_id);
+		release_pkt(pkt);
+		goto process_done;
+	}
+
 	if (!port_ptr->notify) {
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 		wake_lock(&port_ptr->port_rx_wake_lock);
 		list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 		wake_up(&port_ptr->port_rx_wait_q);
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
+		rcu_read_unlock();
 	} else {
+		notify = port_ptr->notify;
+		priv = port_ptr->priv;
+		rcu_read_unlock();
 		src_addr = kmalloc(sizeof(struct msm_ipc_port_addr),
 				   GFP_KERNEL);
 		if (src_addr) {
@@ -1462,8 +1491,8 @@ static void do_read_data(struct work_struct *work)
 			src_addr->port_id = hdr->src_port_id;
 		}
 		skb_pull(head_skb, IPC_ROUTER_HDR_SIZE);
-		port_ptr->notify(MSM_IPC_ROUTER_READ_CB, pkt->pkt_fragment_q,
-				 src_addr, port_ptr->priv);
+		notify(MSM_IPC_ROUTER_READ_CB, pkt->pkt_fragment_q,
+		       src_addr, priv);
 		pkt->pkt_fragment_q = NULL;
 		src_addr = NULL;
 		release_pkt(pkt);
@@ -1505,10 +1534,12 @@ int msm_ipc_router_register_server(struct msm_ipc_port *port_ptr,
 	if (name->addrtype != MSM_IPC_ADDR_NAME)
 		return -EINVAL;
 
+	rcu_read_lock();
 	server = msm_ipc_router_lookup_server(name->addr.port_name.service,
 					      name->addr.port_name.instance,
 					      IPC_ROUTER_NID_LOCAL,
 					      port_ptr->this_port.port_id);
+	rcu_read_unlock();
 	if (server) {
 		pr_err("%s: Server already present\n", __func__);
 		return -EINVAL;
@@ -1525,22 +1556,21 @@ int msm_ipc_router_register_server(struct msm_ipc_port *port_ptr,
 	}
 
 	ctl.cmd = IPC_ROUTER_CTRL_CMD_NEW_SERVER;
-	ctl.srv.service = server->name.service;
-	ctl.srv.instance = server->name.instance;
+	ctl.srv.service = name->addr.port_name.service;
+	ctl.srv.instance = name->addr.port_name.instance;
 	ctl.srv.node_id = IPC_ROUTER_NID_LOCAL;
 	ctl.srv.port_id = port_ptr->this_port.port_id;
 	broadcast_ctl_msg(&ctl);
 	spin_lock_irqsave(&port_ptr->port_lock, flags);
 	port_ptr->type = SERVER_PORT;
-	port_ptr->port_name.service = server->name.service;
-	port_ptr->port_name.instance = server->name.instance;
+	port_ptr->port_name.service = name->addr.port_name.service;
+	port_ptr->port_name.instance = name->addr.port_name.instance;
 	spin_unlock_irqrestore(&port_ptr->port_lock, flags);
 	return 0;
 }
 
 int msm_ipc_router_unregister_server(struct msm_ipc_port *port_ptr)
 {
-	struct msm_ipc_server *server;
 	unsigned long flags;
 	union rr_control_msg ctl;
 
@@ -1559,23 +1589,20 @@ int msm_ipc_router_unregister_server(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 	}
 
-	server = msm_ipc_router_lookup_server(port_ptr->port_name.service,
-					      port_ptr->port_name.instance,
-					      port_ptr->this_port.node_id,
-					      port_ptr->this_port.port_id);
-	if (!server) {
+	if (msm_ipc_router_destroy_server(port_ptr->port_name.service,
+					  port_ptr->port_name.instance,
+					  port_ptr->this_port.node_id,
+					  port_ptr->this_port.port_id)) {
 		pr_err("%s: Server lookup failed\n", __func__);
 		return -ENODEV;
 	}
 
 	ctl.cmd = IPC_ROUTER_CTRL_CMD_REMOVE_SERVER;
-	ctl.srv.service = server->name.service;
-	ctl.srv.instance = server->name.instance;
+	ctl.srv.service = port_ptr->port_name.service;
+	ctl.srv.instance = port_ptr->port_name.instance;
 	ctl.srv.node_id = IPC_ROUTER_NID_LOCAL;
 	ctl.srv.port_id = port_ptr->this_port.port_id;
 	broadcast_ctl_msg(&ctl);
-	msm_ipc_router_destroy_server(server, port_ptr->this_port.node_id,
-				      port_ptr->this_port.port_id);
 	spin_lock_irqsave(&port_ptr->port_lock, flags);
 	port_ptr->type = CLIENT_PORT;
 	spin_unlock_irqrestore(&port_ptr->port_lock, flags);
@@ -1590,6 +1617,7 @@ static int loopback_data(struct msm_ipc_port *src,
 	struct rr_header *hdr;
 	struct msm_ipc_port *port_ptr;
 	struct rr_packet *pkt;
+	int ret;
 
 	if (!data) {
 		pr_err("%s: Invalid pkt pointer\n", __func__);
@@ -1622,21 +1650,26 @@ static int loopback_data(struct msm_ipc_port *src,
 	hdr->dst_node_id = IPC_ROUTER_NID_LOCAL;
 	hdr->dst_port_id = port_id;
 	pkt->length += IPC_ROUTER_HDR_SIZE;
+	/* the receiver may free pkt as soon as it is queued */
+	ret = pkt->length;
 
+	rcu_read_lock();
 	port_ptr = msm_ipc_router_lookup_local_port(port_id);
 	if (!port_ptr) {
+		rcu_read_unlock();
 		pr_err("%s: Local port %d not present\n", __func__, port_id);
 		release_pkt(pkt);
 		return -ENODEV;
 	}
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	wake_lock(&port_ptr->port_rx_wake_lock);
 	list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 	wake_up(&port_ptr->port_rx_wait_q);
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
+	rcu_read_unlock();
 
-	return pkt->length;
+	return ret;
 }
 
 static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
@@ -1702,21 +1735,24 @@ static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
 		hdr->confirm_rx = 1;
 	mutex_unlock(&rport_ptr->quota_lock);
 
-	mutex_lock(&routing_table_lock);
 	rt_entry = lookup_routing_table(hdr->dst_node_id);
-	if (!rt_entry || !rt_entry->xprt_info) {
-		mutex_unlock(&routing_table_lock);
+	if (!rt_entry) {
 		pr_err("%s: Remote node %d not up\n",
 			__func__, hdr->dst_node_id);
 		return -ENODEV;
 	}
-	mutex_lock(&rt_entry->lock);
+	down_read(&rt_entry->lock);
 	xprt_info = rt_entry->xprt_info;
+	if (!xprt_info) {
+		up_read(&rt_entry->lock);
+		pr_err("%s: Remote node %d not up\n",
+			__func__, hdr->dst_node_id);
+		return -ENODEV;
+	}
 	mutex_lock(&xprt_info->tx_lock);
 	ret = xprt_info->xprt->write(pkt, pkt->length, 0);
 	mutex_unlock(&xprt_info->tx_lock);
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	up_read(&rt_entry->lock);
 
 	if (ret < 0) {
 		pr_err("%s: Write on XPRT failed\n", __func__);
@@ -1771,21 +1807,27 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 		dst_node_id = dest->addr.port_addr.node_id;
 		dst_port_id = dest->addr.port_addr.port_id;
 	} else if (dest->addrtype == MSM_IPC_ADDR_NAME) {
+		ret = -ENODEV;
+		rcu_read_lock();
 		server = msm_ipc_router_lookup_server(
 					dest->addr.port_name.service,
 					dest->addr.port_name.instance,
 					0, 0);
-		if (!server) {
+		/* the first port, unless the server is being removed */
+		if (server)
+			list_for_each_entry_rcu(server_port,
+						&server->server_port_list,
+						list) {
+				dst_node_id = server_port->server_addr.node_id;
+				dst_port_id = server_port->server_addr.port_id;
+				ret = 0;
+				break;
+			}
+		rcu_read_unlock();
+		if (ret) {
 			pr_err("%s: Destination not reachable\n", __func__);
-			return -ENODEV;
+			return ret;
 		}
-		mutex_lock(&server_list_lock);
-		server_port = list_first_entry(&server->server_port_list,
-					       struct msm_ipc_server_port,
-					       list);
-		dst_node_id = server_port->server_addr.node_id;
-		dst_port_id = server_port->server_addr.port_id;
-		mutex_unlock(&server_list_lock);
 	}
 	if (dst_node_id == IPC_ROUTER_NID_LOCAL) {
 		ret = loopback_data(src, dst_port_id, data);
@@ -1822,15 +1864,15 @@ int msm_ipc_router_read(struct msm_ipc_port *port_ptr,
 	if (!port_ptr || !data)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	if (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		return -EAGAIN;
 	}
 
 	pkt = list_first_entry(&port_ptr->port_rx_q, struct rr_packet, list);
 	if ((buf_len) && ((pkt->length - IPC_ROUTER_HDR_SIZE) > buf_len)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		return -ETOOSMALL;
 	}
 	list_del(&pkt->list);
@@ -1839,7 +1881,7 @@ int msm_ipc_router_read(struct msm_ipc_port *port_ptr,
 	*data = pkt->pkt_fragment_q;
 	ret = pkt->length;
 	kfree(pkt);
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	return ret;
 }
@@ -1859,9 +1901,9 @@ int msm_ipc_router_recv_from(struct msm_ipc_port *port_ptr,
 	}
 
 	*data = NULL;
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	while (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		if (timeout < 0) {
 			ret = wait_event_interruptible(
 					port_ptr->port_rx_wait_q,
@@ -1878,9 +1920,9 @@ int msm_ipc_router_recv_from(struct msm_ipc_port *port_ptr,
 		}
 		if (timeout == 0)
 			return -ETIMEDOUT;
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	ret = msm_ipc_router_read(port_ptr, data, 0);
 	if (ret <= 0 || !(*data))
@@ -1921,7 +1963,6 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 {
 	union rr_control_msg msg;
 	struct rr_packet *pkt, *temp_pkt;
-	struct msm_ipc_server *server;
 
 	if (!port_ptr)
 		return -EINVAL;
@@ -1947,36 +1988,34 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 		broadcast_ctl_msg_locally(&msg);
 	}
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
-	list_for_each_entry_safe(pkt, temp_pkt, &port_ptr->port_rx_q, list) {
-		list_del(&pkt->list);
-		release_pkt(pkt);
-	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
-
-	if (port_ptr->type == SERVER_PORT) {
-		server = msm_ipc_router_lookup_server(
+	/*
+	 * Unlink first and wait for the lookups that may still see the
+	 * port, so that nothing is queued after the flush below.
+	 */
+	if (port_ptr->type == SERVER_PORT || port_ptr->type == CLIENT_PORT) {
+		if (port_ptr->type == SERVER_PORT)
+			msm_ipc_router_destroy_server(
 				port_ptr->port_name.service,
 				port_ptr->port_name.instance,
 				port_ptr->this_port.node_id,
 				port_ptr->this_port.port_id);
-		if (server)
-			msm_ipc_router_destroy_server(server,
-				port_ptr->this_port.node_id,
-				port_ptr->this_port.port_id);
 		mutex_lock(&local_ports_lock);
-		list_del(&port_ptr->list);
-		mutex_unlock(&local_ports_lock);
-	} else if (port_ptr->type == CLIENT_PORT) {
-		mutex_lock(&local_ports_lock);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		mutex_unlock(&local_ports_lock);
+		synchronize_rcu();
 	} else if (port_ptr->type == CONTROL_PORT) {
 		mutex_lock(&control_ports_lock);
 		list_del(&port_ptr->list);
 		mutex_unlock(&control_ports_lock);
 	}
 
+	spin_lock(&port_ptr->port_rx_q_lock);
+	list_for_each_entry_safe(pkt, temp_pkt, &port_ptr->port_rx_q, list) {
+		list_del(&pkt->list);
+		release_pkt(pkt);
+	}
+	spin_unlock(&port_ptr->port_rx_q_lock);
+
 	wake_lock_destroy(&port_ptr->port_rx_wake_lock);
 	kfree(port_ptr);
 	return 0;
@@ -1990,13 +2029,13 @@ int msm_ipc_router_get_curr_pkt_size(struct msm_ipc_port *port_ptr)
 	if (!port_ptr)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	if (!list_empty(&port_ptr->port_rx_q)) {
 		pkt = list_first_entry(&port_ptr->port_rx_q,
 					struct rr_packet, list);
 		rc = pkt->length;
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	return rc;
 }
@@ -2007,8 +2046,10 @@ int msm_ipc_router_bind_control_port(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 
 	mutex_lock(&local_ports_lock);
-	list_del(&port_ptr->list);
+	list_del_rcu(&port_ptr->list);
 	mutex_unlock(&local_ports_lock);
+	/* a lookup may still be walking port_ptr->list */
+	synchronize_rcu();
 	port_ptr->type = CONTROL_PORT;
 	mutex_lock(&control_ports_lock);
 	list_add_tail(&port_ptr->list, &control_ports);
@@ -2036,17 +2077,17 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 		return -EINVAL;
 	}
 
-	mutex_lock(&server_list_lock);
+	rcu_read_lock();
 	if (!lookup_mask)
 		lookup_mask = 0xFFFFFFFF;
 	for (key = 0; key < SRV_HASH_SIZE; key++) {
-		list_for_each_entry(server, &server_list[key], list) {
+		list_for_each_entry_rcu(server, &server_list[key], list) {
 			if ((server->name.service != srv_name->service) ||
 			    ((server->name.instance & lookup_mask) !=
 				srv_name->instance))
 				continue;
 
-			list_for_each_entry(server_port,
+			list_for_each_entry_rcu(server_port,
 				&server->server_port_list, list) {
 				if (i < num_entries_in_array) {
 					srv_addr[i].node_id =
@@ -2058,7 +2099,7 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 
 	return i;
 }
@@ -2087,7 +2128,7 @@ static int dump_routing_table(char *buf, int max)
 	for (j = 0; j < RT_HASH_SIZE; j++) {
 		mutex_lock(&routing_table_lock);
 		list_for_each_entry(rt_entry, &routing_table[j], list) {
-			mutex_lock(&rt_entry->lock);
+			down_read(&rt_entry->lock);
 			i += scnprintf(buf + i, max - i,
 				       "Node Id: 0x%08x\n", rt_entry->node_id);
 			if (j == IPC_ROUTER_NID_LOCAL) {
@@ -2104,7 +2145,7 @@ static int dump_routing_table(char *buf, int max)
 					rt_entry->xprt_info->remote_node_id);
 			}
 			i += scnprintf(buf + i, max - i, "\n");
-			mutex_unlock(&rt_entry->lock);
+			up_read(&rt_entry->lock);
 		}
 		mutex_unlock(&routing_table_lock);
 	}
@@ -2174,7 +2215,7 @@ static int dump_remote_ports(char *buf, int max)
 	for (j = 0; j < RT_HASH_SIZE; j++) {
 		mutex_lock(&routing_table_lock);
 		list_for_each_entry(rt_entry, &routing_table[j], list) {
-			mutex_lock(&rt_entry->lock);
+			down_read(&rt_entry->lock);
 			for (k = 0; k < RP_HASH_SIZE; k++) {
 				list_for_each_entry(rport_ptr,
 					&rt_entry->remote_port_list[k],
@@ -2191,7 +2232,7 @@ static int dump_remote_ports(char *buf, int max)
 				i += scnprintf(buf + i, max - i, "\n");
 				}
 			}
-			mutex_unlock(&rt_entry->lock);
+			up_read(&rt_entry->lock);
 		}
 		mutex_unlock(&routing_table_lock);
 	}
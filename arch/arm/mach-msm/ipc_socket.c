@@ -333,9 +333,9 @@ static int msm_ipc_router_recvmsg(struct kiocb *iocb, struct socket *sock,
 
 	lock_sock(sk);
 	timeout = sk->sk_rcvtimeo;
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	while (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		release_sock(sk);
 		if (timeout < 0) {
 			ret = wait_event_interruptible(
@@ -355,9 +355,9 @@ static int msm_ipc_router_recvmsg(struct kiocb *iocb, struct socket *sock,
 		if (timeout == 0)
 			return -ETIMEDOUT;
 		lock_sock(sk);
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	ret = msm_ipc_router_read(port_ptr, &msg, buf_len);
 	if (ret <= 0 || !msg) {
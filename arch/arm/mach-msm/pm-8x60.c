@@ -857,16 +857,35 @@ static bool msm_pm_spm_power_collapse(
 	return collapsed;
 }
 
+/*
+ * A cpufreq switch issued from another CPU may be reprogramming this
+ * CPU's clocks.  Idle gives up and stays powered up; suspend and hotplug
+ * wait for the switch, which takes microseconds, to finish.
+ */
+static bool msm_pm_acpuclk_claim(bool from_idle)
+{
+	if (from_idle)
+		return acpuclk_pc_enter();
+
+	while (!acpuclk_pc_enter())
+		cpu_relax();
+	return true;
+}
+
 static bool msm_pm_power_collapse_standalone(bool from_idle)
 {
 	unsigned int cpu = smp_processor_id();
 	unsigned int avsdscr_setting;
 	bool collapsed;
 
+	if (!msm_pm_acpuclk_claim(from_idle))
+		return false;
+
 	avsdscr_setting = avs_get_avsdscr();
 	avs_disable();
 	collapsed = msm_pm_spm_power_collapse(cpu, from_idle, false);
 	avs_reset_delays(avsdscr_setting);
+	acpuclk_pc_exit();
 	return collapsed;
 }
 
@@ -883,6 +902,9 @@ static bool msm_pm_power_collapse(bool from_idle)
 		pr_info("CPU%u: %s: idle %d\n",
 			cpu, __func__, (int)from_idle);
 
+	if (!msm_pm_acpuclk_claim(from_idle))
+		return false;
+
 	if (smp_processor_id() == 0) {
 		if (((!from_idle) && (MSM_PM_DEBUG_CLOCK & msm_pm_debug_mask)) ||
 			((from_idle) && (MSM_PM_DEBUG_IDLE_CLOCK & msm_pm_debug_mask))) {
@@ -943,6 +965,7 @@ static bool msm_pm_power_collapse(bool from_idle)
 	if (acpuclk_set_rate(cpu, saved_acpuclk_rate, SETRATE_PC) < 0)
 		pr_warning("CPU%u: %s: failed to restore clock rate(%lu)\n",
 			cpu, __func__, saved_acpuclk_rate);
+	acpuclk_pc_exit();
 
 	avs_reset_delays(avsdscr_setting);
 	msm_pm_config_hw_after_power_up();
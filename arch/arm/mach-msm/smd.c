@@ -32,6 +32,7 @@
 #include <linux/remote_spinlock.h>
 #include <linux/uaccess.h>
 #include <linux/kfifo.h>
+#include <linux/uio.h>
 #include <linux/wakelock.h>
 #include <mach/msm_smd.h>
 #include <mach/msm_iomap.h>
@@ -539,6 +540,8 @@ struct smd_channel {
 	unsigned type;
 
 	int pending_pkt_sz;
+	/* data written by smd_writev(SMD_WRITEV_MORE) not yet signalled */
+	int notify_pending;
 
 	char is_pkt_ch;
 };
@@ -1219,8 +1222,11 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
-				int user_buf)
+/* basic write interface to ch_write_{buffer,done} used by
+ * smd_*_write() and smd_writev(); the caller notifies the other cpu
+ */
+static int ch_write(struct smd_channel *ch, const void *_data, int len,
+			int user_buf)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
@@ -1228,12 +1234,6 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	int orig_len = len;
 	int r = 0;
 
-	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
-	if (len < 0)
-		return -EINVAL;
-	else if (len == 0)
-		return 0;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -1257,10 +1257,27 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
+	return orig_len - len;
+}
+
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int r;
+
+	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
+	if (len < 0)
+		return -EINVAL;
+	else if (len == 0)
+		return 0;
+
+	r = ch_write(ch, _data, len, user_buf);
+	if (r || ch->notify_pending) {
+		ch->notify_pending = 0;
 		ch->notify_other_cpu();
+	}
 
-	return orig_len - len;
+	return r;
 }
 
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
@@ -1281,17 +1298,20 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[0] = len;
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
-
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
-	if (ret < 0 || ret != sizeof(hdr)) {
+	/* header and data go out under a single interrupt */
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
+	if (ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
+		if (ret)
+			ch->notify_other_cpu();
 		return -1;
 	}
 
-
-	ret = smd_stream_write(ch, _data, len, user_buf);
-	if (ret < 0 || ret != len) {
+	ret = ch_write(ch, _data, len, user_buf);
+	ch->notify_pending = 0;
+	ch->notify_other_cpu();
+	if (ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
 		return ret;
@@ -1855,6 +1875,112 @@ int smd_write_user_buffer(smd_channel_t *ch, const void *data, int len)
 }
 EXPORT_SYMBOL(smd_write_user_buffer);
 
+int smd_writev(smd_channel_t *ch, const struct kvec *iov, int iovcnt,
+		unsigned flags)
+{
+	unsigned hdr[5];
+	int i, r, len = 0, written = 0;
+
+	if (!ch) {
+		pr_err("[SMD] %s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (iovcnt < 0)
+		return -EINVAL;
+	if (ch->pending_pkt_sz)
+		return -EBUSY;
+
+	for (i = 0; i < iovcnt; i++) {
+		if ((int)iov[i].iov_len < 0 || len + iov[i].iov_len > INT_MAX)
+			return -EINVAL;
+		len += iov[i].iov_len;
+	}
+
+	if (len && ch->is_pkt_ch) {
+		/* the whole vector is one packet; never a partial write */
+		if (smd_stream_write_avail(ch) < (len + SMD_HEADER_SIZE))
+			return -ENOMEM;
+
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+
+		r = ch_write(ch, hdr, sizeof(hdr), 0);
+		if (r != sizeof(hdr)) {
+			SMD_DBG("%s failed to write pkt header: "
+				"%d returned\n", __func__, r);
+			written = -1;
+			if (r)
+				ch->notify_pending = 1;
+			goto notify;
+		}
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_len)
+			continue;
+		r = ch_write(ch, iov[i].iov_base, iov[i].iov_len, 0);
+		written += r;
+		if (r != iov[i].iov_len)
+			break;
+	}
+
+	if (written)
+		ch->notify_pending = 1;
+
+	if (flags & SMD_WRITEV_MORE)
+		return written;
+
+notify:
+	if (ch->notify_pending) {
+		ch->notify_pending = 0;
+		ch->notify_other_cpu();
+	}
+
+	return written;
+}
+EXPORT_SYMBOL(smd_writev);
+
+int smd_readv(smd_channel_t *ch, const struct kvec *iov, int iovcnt)
+{
+	unsigned long flags;
+	int i, n, r, read = 0;
+
+	if (!ch) {
+		pr_err("[SMD] %s: Invalid channel specified\n", __func__);
+		return -ENODEV;
+	}
+	if (iovcnt < 0)
+		return -EINVAL;
+
+	for (i = 0; i < iovcnt; i++) {
+		n = iov[i].iov_len;
+		if (n < 0)
+			return -EINVAL;
+		if (ch->is_pkt_ch && n > ch->current_packet - read)
+			n = ch->current_packet - read;
+		if (!n)
+			continue;
+
+		r = ch_read(ch, iov[i].iov_base, n, 0);
+		read += r;
+		if (r != n)
+			break;
+	}
+
+	if (read > 0 && !read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	if (ch->is_pkt_ch) {
+		spin_lock_irqsave(&smd_lock, flags);
+		ch->current_packet -= read;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&smd_lock, flags);
+	}
+
+	return read;
+}
+EXPORT_SYMBOL(smd_readv);
+
 int smd_read_avail(smd_channel_t *ch)
 {
 	return ch->read_avail(ch);
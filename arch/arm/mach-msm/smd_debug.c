@@ -19,8 +19,13 @@
 #include <linux/list.h>
 #include <linux/ctype.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
 
 #include <mach/msm_iomap.h>
+#include <mach/msm_smd.h>
 
 #include "smd_private.h"
 #include <linux/platform_device.h>
@@ -770,6 +775,112 @@ static int debug_read_intr_mux(char *buf, int max)
 	return i;
 }
 
+/*
+ * smd_writev() throughput and latency on the local loopback channel,
+ * whose interrupt to the other side is a call of its own notify
+ * callback.  Each pass writes WRITEV_BENCH_BYTES in buffers of one size,
+ * kicking the reader either for every buffer or, with SMD_WRITEV_MORE,
+ * once per WRITEV_BENCH_BATCH buffers, and drains the channel after
+ * every kick.  The time to notify is from the first write of a kick to
+ * the notification, the time the reader waits for the data.
+ */
+#define WRITEV_BENCH_BYTES	(1024 * 1024)
+#define WRITEV_BENCH_BATCH	16
+#define WRITEV_BENCH_MAX_SIZE	256
+
+static struct {
+	int reading;
+	unsigned kicks;
+	ktime_t first;
+	s64 wait_ns;
+} writev_bench;
+
+static void writev_bench_notify(void *priv, unsigned event)
+{
+	/* reads notify the writer on this channel too; don't count those */
+	if (event != SMD_EVENT_DATA || writev_bench.reading)
+		return;
+	writev_bench.kicks++;
+	writev_bench.wait_ns += ktime_to_ns(ktime_sub(ktime_get(),
+						      writev_bench.first));
+}
+
+static int writev_bench_pass(smd_channel_t *ch, char *data, char *sink,
+			     unsigned size, unsigned batch, char *buf, int max)
+{
+	struct kvec iov = { .iov_base = data, .iov_len = size };
+	struct kvec riov = { .iov_base = sink, .iov_len = size * batch };
+	unsigned done, i;
+	ktime_t start;
+	s64 ns;
+	int r;
+
+	memset(&writev_bench, 0, sizeof(writev_bench));
+	start = ktime_get();
+	for (done = 0; done < WRITEV_BENCH_BYTES; done += size * batch) {
+		writev_bench.first = ktime_get();
+		for (i = 0; i < batch; i++) {
+			r = smd_writev(ch, &iov, 1,
+				       i < batch - 1 ? SMD_WRITEV_MORE : 0);
+			if (r != size)
+				return scnprintf(buf, max, "%u B: smd_writev "
+						 "returned %d\n", size, r);
+		}
+		writev_bench.reading = 1;
+		r = smd_readv(ch, &riov, 1);
+		writev_bench.reading = 0;
+		if (r != size * batch)
+			return scnprintf(buf, max, "%u B: smd_readv returned "
+					 "%d\n", size, r);
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (ns <= 0)
+		ns = 1;
+
+	return scnprintf(buf, max,
+			 "%3u B, %2u per kick: %7llu KB/s, %6u kicks, "
+			 "%6lld ns to notify\n", size, batch,
+			 div64_u64((u64)WRITEV_BENCH_BYTES * NSEC_PER_SEC,
+				   ns) >> 10, writev_bench.kicks,
+			 writev_bench.kicks ? div_s64(writev_bench.wait_ns,
+						      writev_bench.kicks) : 0);
+}
+
+static int debug_writev_bench(char *buf, int max)
+{
+	static const unsigned sizes[] = { 16, 64, WRITEV_BENCH_MAX_SIZE };
+	smd_channel_t *ch;
+	char *data, *sink;
+	int i = 0, n, r;
+
+	data = kmalloc(WRITEV_BENCH_MAX_SIZE, GFP_KERNEL);
+	sink = kmalloc(WRITEV_BENCH_MAX_SIZE * WRITEV_BENCH_BATCH,
+		       GFP_KERNEL);
+	if (!data || !sink) {
+		i = scnprintf(buf, max, "out of memory\n");
+		goto out;
+	}
+	memset(data, 0x5a, WRITEV_BENCH_MAX_SIZE);
+
+	r = smd_named_open_on_edge("local_loopback", SMD_LOOPBACK_TYPE, &ch,
+				   NULL, writev_bench_notify);
+	if (r) {
+		i = scnprintf(buf, max, "local_loopback: open failed %d\n", r);
+		goto out;
+	}
+	for (n = 0; n < ARRAY_SIZE(sizes); n++) {
+		i += writev_bench_pass(ch, data, sink, sizes[n], 1,
+				       buf + i, max - i);
+		i += writev_bench_pass(ch, data, sink, sizes[n],
+				       WRITEV_BENCH_BATCH, buf + i, max - i);
+	}
+	smd_close(ch);
+out:
+	kfree(sink);
+	kfree(data);
+	return i;
+}
+
 #define DEBUG_BUFMAX 4096
 static char debug_buffer[DEBUG_BUFMAX];
 
@@ -824,6 +935,7 @@ static int __init smd_debugfs_init(void)
 	debug_create("modem_err_f3", 0444, dent, debug_modem_err_f3);
 	debug_create("print_diag", 0444, dent, debug_diag);
 	debug_create("print_f3", 0444, dent, debug_f3);
+	debug_create("writev_bench", 0444, dent, debug_writev_bench);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
@@ -30,6 +30,8 @@
 #include <linux/completion.h>
 #include <linux/msm_smd_pkt.h>
 #include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <asm/ioctls.h>
 #include <linux/wakelock.h>
 
@@ -47,6 +49,7 @@
 
 #define DEVICE_NAME "smdpkt"
 #define WAKELOCK_TIMEOUT (HZ / 5)
+#define SMD_PKT_RX_RING_MAX (1024 * 1024)
 
 struct smd_pkt_dev {
 	struct cdev cdev;
@@ -76,6 +79,21 @@ struct smd_pkt_dev {
 	struct wake_lock pa_wake_lock;		/* Packet Arrival Wake lock*/
 	struct work_struct packet_arrival_work;
 	struct spinlock pa_spinlock;
+
+	/*
+	 * mmap()ed receive ring, see SMD_PKT_IOCTL_RX_RING; under rx_lock.
+	 * The ring header is writable by userspace, so the kernel keeps its
+	 * own copy of everything but consumed and never reads it back.
+	 */
+	struct smd_pkt_rx_ring *rx_ring;
+	unsigned rx_nr_bufs;
+	unsigned rx_buf_size;
+	unsigned rx_data_offset;
+	unsigned rx_produced;
+	unsigned rx_dropped;
+	unsigned rx_pkt_len;	/* packet being copied, 0 if none */
+	unsigned rx_pkt_off;
+	struct work_struct rx_ring_work;
 } *smd_pkt_devp[NUM_SMD_PKT_PORTS];
 
 struct class *smd_pkt_classp;
@@ -199,6 +217,199 @@ static void packet_arrival_worker(struct work_struct *work)
 	mutex_unlock(&smd_pkt_devp->ch_lock);
 }
 
+static u32 *rx_ring_buf(struct smd_pkt_dev *smd_pkt_devp, unsigned n)
+{
+	void *ring = smd_pkt_devp->rx_ring;
+
+	return ring + smd_pkt_devp->rx_data_offset +
+		(n & (smd_pkt_devp->rx_nr_bufs - 1)) * smd_pkt_devp->rx_buf_size;
+}
+
+/*
+ * Number of buffers userspace still holds.  consumed comes from the
+ * shared page and may be garbage; anything outside [produced - nr_bufs,
+ * produced] is treated as a full ring so a bad index can only stall
+ * this channel.
+ */
+static unsigned rx_ring_used(struct smd_pkt_dev *smd_pkt_devp)
+{
+	unsigned used;
+
+	used = smd_pkt_devp->rx_produced -
+		ACCESS_ONCE(smd_pkt_devp->rx_ring->consumed);
+
+	return min(used, smd_pkt_devp->rx_nr_bufs);
+}
+
+/*
+ * Copy whole packets from the fifo into free ring buffers.  Packets
+ * bigger than the fifo come in pieces, so a partly copied packet is
+ * carried over to the next call in rx_pkt_len/rx_pkt_off.
+ */
+static void rx_ring_fill(struct smd_pkt_dev *smd_pkt_devp)
+{
+	struct smd_pkt_rx_ring *ring;
+	unsigned produced;
+	unsigned long flags;
+	u32 *buf = NULL;
+	int avail, r;
+
+	mutex_lock(&smd_pkt_devp->ch_lock);
+	mutex_lock(&smd_pkt_devp->rx_lock);
+	ring = smd_pkt_devp->rx_ring;
+	if (!smd_pkt_devp->ch || !ring) {
+		mutex_unlock(&smd_pkt_devp->rx_lock);
+		mutex_unlock(&smd_pkt_devp->ch_lock);
+		return;
+	}
+
+	produced = smd_pkt_devp->rx_produced;
+	for (;;) {
+		if (!smd_pkt_devp->rx_pkt_len) {
+			smd_pkt_devp->rx_pkt_len =
+				smd_cur_packet_size(smd_pkt_devp->ch);
+			smd_pkt_devp->rx_pkt_off = 0;
+			if (!smd_pkt_devp->rx_pkt_len)
+				break;
+		}
+
+		avail = smd_read_avail(smd_pkt_devp->ch);
+		if (avail <= 0)
+			break;
+
+		if (smd_pkt_devp->rx_pkt_len >
+		    smd_pkt_devp->rx_buf_size - sizeof(u32)) {
+			r = smd_read(smd_pkt_devp->ch, NULL, avail);
+		} else {
+			if (rx_ring_used(smd_pkt_devp) ==
+			    smd_pkt_devp->rx_nr_bufs)
+				break;
+			/* don't write the buffer before userspace let it go */
+			smp_mb();
+			buf = rx_ring_buf(smd_pkt_devp,
+					  smd_pkt_devp->rx_produced);
+			r = smd_read(smd_pkt_devp->ch,
+				     (char *)(buf + 1) + smd_pkt_devp->rx_pkt_off,
+				     avail);
+		}
+		if (r <= 0)
+			break;
+
+		smd_pkt_devp->rx_pkt_off += r;
+		if (smd_pkt_devp->rx_pkt_off < smd_pkt_devp->rx_pkt_len)
+			continue;
+
+		if (smd_pkt_devp->rx_pkt_len >
+		    smd_pkt_devp->rx_buf_size - sizeof(u32)) {
+			pr_err("[SMD] %s: dropped %u byte packet\n", __func__,
+			       smd_pkt_devp->rx_pkt_len);
+			ring->dropped = ++smd_pkt_devp->rx_dropped;
+		} else {
+			*buf = smd_pkt_devp->rx_pkt_len;
+			smp_wmb();
+			ring->produced = ++smd_pkt_devp->rx_produced;
+		}
+		smd_pkt_devp->rx_pkt_len = 0;
+	}
+	produced = smd_pkt_devp->rx_produced - produced;
+	mutex_unlock(&smd_pkt_devp->rx_lock);
+
+	spin_lock_irqsave(&smd_pkt_devp->pa_spinlock, flags);
+	if (smd_pkt_devp->poll_mode &&
+	    !smd_cur_packet_size(smd_pkt_devp->ch)) {
+		wake_unlock(&smd_pkt_devp->pa_wake_lock);
+		smd_pkt_devp->poll_mode = 0;
+	}
+	spin_unlock_irqrestore(&smd_pkt_devp->pa_spinlock, flags);
+	mutex_unlock(&smd_pkt_devp->ch_lock);
+
+	if (produced)
+		wake_up(&smd_pkt_devp->ch_read_wait_queue);
+}
+
+static void rx_ring_worker(struct work_struct *work)
+{
+	struct smd_pkt_dev *smd_pkt_devp;
+
+	smd_pkt_devp = container_of(work, struct smd_pkt_dev, rx_ring_work);
+	rx_ring_fill(smd_pkt_devp);
+}
+
+static int rx_ring_setup(struct smd_pkt_dev *smd_pkt_devp,
+			 struct smd_pkt_rx_ring_req __user *arg)
+{
+	struct smd_pkt_rx_ring_req req;
+	struct smd_pkt_rx_ring *ring;
+	unsigned data_offset;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.nr_bufs || (req.nr_bufs & (req.nr_bufs - 1)) ||
+	    req.buf_size < 2 * sizeof(u32) || (req.buf_size & 3) ||
+	    req.buf_size > SMD_PKT_RX_RING_MAX ||
+	    req.nr_bufs > SMD_PKT_RX_RING_MAX / req.buf_size)
+		return -EINVAL;
+
+	data_offset = L1_CACHE_ALIGN(sizeof(*ring));
+	ring = vmalloc_user(data_offset + req.nr_bufs * req.buf_size);
+	if (!ring)
+		return -ENOMEM;
+
+	ring->nr_bufs = req.nr_bufs;
+	ring->buf_size = req.buf_size;
+	ring->data_offset = data_offset;
+
+	mutex_lock(&smd_pkt_devp->rx_lock);
+	if (smd_pkt_devp->rx_ring) {
+		/* it may be mapped already */
+		mutex_unlock(&smd_pkt_devp->rx_lock);
+		vfree(ring);
+		return -EBUSY;
+	}
+	smd_pkt_devp->rx_nr_bufs = req.nr_bufs;
+	smd_pkt_devp->rx_buf_size = req.buf_size;
+	smd_pkt_devp->rx_data_offset = data_offset;
+	smd_pkt_devp->rx_produced = 0;
+	smd_pkt_devp->rx_dropped = 0;
+	smd_pkt_devp->rx_pkt_len = 0;
+	smd_pkt_devp->rx_ring = ring;
+	mutex_unlock(&smd_pkt_devp->rx_lock);
+
+	/* pick up whatever arrived before the ring existed */
+	schedule_work(&smd_pkt_devp->rx_ring_work);
+
+	return 0;
+}
+
+static void rx_ring_free(struct smd_pkt_dev *smd_pkt_devp)
+{
+	cancel_work_sync(&smd_pkt_devp->rx_ring_work);
+
+	mutex_lock(&smd_pkt_devp->rx_lock);
+	vfree(smd_pkt_devp->rx_ring);
+	smd_pkt_devp->rx_ring = NULL;
+	mutex_unlock(&smd_pkt_devp->rx_lock);
+}
+
+static int smd_pkt_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	int ret = -EINVAL;
+	struct smd_pkt_dev *smd_pkt_devp;
+
+	smd_pkt_devp = file->private_data;
+	if (!smd_pkt_devp)
+		return -EINVAL;
+
+	mutex_lock(&smd_pkt_devp->rx_lock);
+	if (smd_pkt_devp->rx_ring)
+		ret = remap_vmalloc_range(vma, smd_pkt_devp->rx_ring,
+					  vma->vm_pgoff);
+	mutex_unlock(&smd_pkt_devp->rx_lock);
+
+	return ret;
+}
+
 static long smd_pkt_ioctl(struct file *file, unsigned int cmd,
 					     unsigned long arg)
 {
@@ -219,6 +430,9 @@ static long smd_pkt_ioctl(struct file *file, unsigned int cmd,
 	case SMD_PKT_IOCTL_BLOCKING_WRITE:
 		ret = get_user(smd_pkt_devp->blocking_write, (int *)arg);
 		break;
+	case SMD_PKT_IOCTL_RX_RING:
+		ret = rx_ring_setup(smd_pkt_devp, (void __user *)arg);
+		break;
 	default:
 		ret = -1;
 	}
@@ -251,6 +465,10 @@ ssize_t smd_pkt_read(struct file *file,
 		return notify_reset(smd_pkt_devp);
 	}
 
+	/* packets go to the receive ring */
+	if (smd_pkt_devp->rx_ring)
+		return -EBUSY;
+
 	chl = smd_pkt_devp->ch;
 wait_for_packet:
 	r = wait_event_interruptible(smd_pkt_devp->ch_read_wait_queue,
@@ -422,6 +640,17 @@ static unsigned int smd_pkt_poll(struct file *file, poll_table *wait)
 
 	smd_pkt_devp->poll_mode = 1;
 	poll_wait(file, &smd_pkt_devp->ch_read_wait_queue, wait);
+
+	if (smd_pkt_devp->rx_ring) {
+		/* userspace may have freed buffers for a waiting packet */
+		rx_ring_fill(smd_pkt_devp);
+		if (rx_ring_used(smd_pkt_devp))
+			mask |= POLLIN | POLLRDNORM;
+		if (smd_pkt_devp->has_reset)
+			mask |= POLLERR;
+		return mask;
+	}
+
 	if (smd_read_avail(smd_pkt_devp->ch))
 		mask |= POLLIN | POLLRDNORM;
 
@@ -484,6 +713,8 @@ static void ch_notify(void *priv, unsigned event)
 	case SMD_EVENT_DATA: {
 		D(KERN_ERR "%s: data\n", __func__);
 		check_and_wakeup_reader(smd_pkt_devp);
+		if (smd_pkt_devp->rx_ring)
+			schedule_work(&smd_pkt_devp->rx_ring_work);
 		if (smd_pkt_devp->blocking_write)
 			check_and_wakeup_writer(smd_pkt_devp);
 		D(KERN_ERR "%s: data after check_and_wakeup\n", __func__);
@@ -738,6 +969,8 @@ int smd_pkt_release(struct inode *inode, struct file *file)
 	}
 	mutex_unlock(&smd_pkt_devp->ch_lock);
 
+	rx_ring_free(smd_pkt_devp);
+
 	smd_pkt_devp->has_reset = 0;
 	smd_pkt_devp->do_reset_notification = 0;
 	wake_lock_destroy(&smd_pkt_devp->pa_wake_lock);
@@ -752,6 +985,7 @@ static const struct file_operations smd_pkt_fops = {
 	.read = smd_pkt_read,
 	.write = smd_pkt_write,
 	.poll = smd_pkt_poll,
+	.mmap = smd_pkt_mmap,
 	.unlocked_ioctl = smd_pkt_ioctl,
 };
 
@@ -810,6 +1044,7 @@ static int __init smd_pkt_init(void)
 		mutex_init(&smd_pkt_devp[i]->rx_lock);
 		mutex_init(&smd_pkt_devp[i]->tx_lock);
 		init_completion(&smd_pkt_devp[i]->ch_allocated);
+		INIT_WORK(&smd_pkt_devp[i]->rx_ring_work, rx_ring_worker);
 
 		cdev_init(&smd_pkt_devp[i]->cdev, &smd_pkt_fops);
 		smd_pkt_devp[i]->cdev.owner = THIS_MODULE;
@@ -0,0 +1,458 @@
+/*
+ *  ROW (Read Over Write) i/o scheduler.
+ *
+ *  Requests wait in one FIFO per priority queue. Dispatching goes in
+ *  rounds: in each round a queue may dispatch up to its quantum of
+ *  requests, and the highest priority queue that still has requests
+ *  and quantum left always goes first. Reads therefore go ahead of
+ *  writes, while writes still get their quantum every round.
+ *
+ *  When reads have been arriving back to back and the read queues run
+ *  dry, writes are held back for a short idle time in case another
+ *  read follows, so that writes are flushed while reads are quiet.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/ioprio.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
+
+/*
+ * See Documentation/block/row-iosched.txt
+ */
+enum row_queue_prio {
+	ROWQ_PRIO_HIGH_READ = 0,	/* reads of the RT io class */
+	ROWQ_PRIO_REG_READ,		/* other reads */
+	ROWQ_PRIO_HIGH_SWRITE,		/* sync writes of the RT io class */
+	ROWQ_PRIO_REG_SWRITE,		/* other sync writes */
+	ROWQ_PRIO_REG_WRITE,		/* async writes */
+	ROWQ_PRIO_LOW_READ,		/* reads of the idle io class */
+	ROWQ_PRIO_LOW_WRITE,		/* writes of the idle io class */
+	ROWQ_MAX_PRIO,
+};
+
+/* Requests each queue may dispatch in one round */
+static const int row_quantum[ROWQ_MAX_PRIO] = {
+	[ROWQ_PRIO_HIGH_READ]	= 100,
+	[ROWQ_PRIO_REG_READ]	= 75,
+	[ROWQ_PRIO_HIGH_SWRITE]	= 4,
+	[ROWQ_PRIO_REG_SWRITE]	= 4,
+	[ROWQ_PRIO_REG_WRITE]	= 4,
+	[ROWQ_PRIO_LOW_READ]	= 2,
+	[ROWQ_PRIO_LOW_WRITE]	= 2,
+};
+
+/* in ms; HZ / 200 would be 0 at HZ=100 */
+static const int read_idle = 5;		/* writes held back */
+static const int read_idle_freq = 50;	/* reads this close are a stream */
+
+struct row_queue {
+	struct list_head	fifo;
+	unsigned int		nr_req;
+	unsigned int		nr_dispatched;	/* in the current round */
+	int			quantum;
+
+	/* read queues only: when the last request came, and if in a stream */
+	unsigned long		last_insert;
+	bool			frequent;
+};
+
+struct row_data {
+	struct request_queue	*queue;
+	struct row_queue	row_queues[ROWQ_MAX_PRIO];
+	unsigned int		nr_reqs[2];
+
+	/* holding writes back while reads are expected */
+	struct timer_list	idle_timer;
+	struct work_struct	kick_work;
+	bool			idling;
+	int			read_idle;
+	int			read_idle_freq;
+};
+
+/* Reads that are worth holding writes back for */
+static inline bool row_queue_idles(int prio)
+{
+	return prio == ROWQ_PRIO_HIGH_READ || prio == ROWQ_PRIO_REG_READ;
+}
+
+static int row_get_queue_prio(struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	int ioprio_class = IOPRIO_PRIO_CLASS(req_get_ioprio(rq));
+
+	if (ioprio_class == IOPRIO_CLASS_NONE) {
+		if (current->io_context)
+			ioprio_class = task_ioprio_class(current->io_context);
+		else
+			ioprio_class = task_nice_ioclass(current);
+	}
+
+	switch (ioprio_class) {
+	case IOPRIO_CLASS_RT:
+		if (data_dir == READ)
+			return ROWQ_PRIO_HIGH_READ;
+		if (is_sync)
+			return ROWQ_PRIO_HIGH_SWRITE;
+		break;
+	case IOPRIO_CLASS_IDLE:
+		if (data_dir == READ)
+			return ROWQ_PRIO_LOW_READ;
+		return ROWQ_PRIO_LOW_WRITE;
+	}
+
+	if (data_dir == READ)
+		return ROWQ_PRIO_REG_READ;
+	return is_sync ? ROWQ_PRIO_REG_SWRITE : ROWQ_PRIO_REG_WRITE;
+}
+
+/*
+ * add rq to the fifo of its queue
+ */
+static void row_add_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	const int prio = row_get_queue_prio(rq);
+	struct row_queue *rqueue = &rd->row_queues[prio];
+
+	rq->elevator_private[0] = rqueue;
+	rq_set_fifo_time(rq, jiffies);
+	list_add_tail(&rq->queuelist, &rqueue->fifo);
+	rqueue->nr_req++;
+	rd->nr_reqs[rq_data_dir(rq)]++;
+
+	if (row_queue_idles(prio)) {
+		rqueue->frequent = time_before(jiffies, rqueue->last_insert +
+					       rd->read_idle_freq);
+		rqueue->last_insert = jiffies;
+	}
+}
+
+/*
+ * remove rq from the fifo of its queue
+ */
+static void row_remove_request(struct row_data *rd, struct request *rq)
+{
+	struct row_queue *rqueue = rq->elevator_private[0];
+
+	rq_fifo_clear(rq);
+	rqueue->nr_req--;
+	rd->nr_reqs[rq_data_dir(rq)]--;
+}
+
+static void
+row_merged_requests(struct request_queue *q, struct request *req,
+		    struct request *next)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+
+	/*
+	 * if next was queued before rq in the same fifo, rq takes its
+	 * place (next will be deleted)
+	 */
+	if (req->elevator_private[0] == next->elevator_private[0] &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+		list_move(&req->queuelist, &next->queuelist);
+		rq_set_fifo_time(req, rq_fifo_time(next));
+	}
+
+	row_remove_request(rd, next);
+}
+
+static void row_kick_queue(struct work_struct *work)
+{
+	struct row_data *rd = container_of(work, struct row_data, kick_work);
+	struct request_queue *q = rd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * No read came while writes were held back: let them go, and stop
+ * treating the reads seen so far as a stream.
+ */
+static void row_idle_timer(unsigned long data)
+{
+	struct row_data *rd = (struct row_data *) data;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(rd->queue->queue_lock, flags);
+	rd->idling = false;
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		rd->row_queues[i].frequent = false;
+	kblockd_schedule_work(rd->queue, &rd->kick_work);
+	spin_unlock_irqrestore(rd->queue->queue_lock, flags);
+}
+
+/* Whether a read is likely soon after the read queues ran dry */
+static bool row_should_idle(struct row_data *rd)
+{
+	struct row_queue *rqueue;
+	int i;
+
+	if (!rd->read_idle)
+		return false;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		if (!row_queue_idles(i))
+			continue;
+
+		rqueue = &rd->row_queues[i];
+		if (!rqueue->nr_req && rqueue->frequent &&
+		    time_before(jiffies, rqueue->last_insert +
+				rd->read_idle_freq))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * The highest priority queue that has requests and quantum left in
+ * this round. Once every queue with requests has used its quantum, a
+ * new round starts. Returns -1 if there are no requests at all.
+ */
+static int row_pick_queue(struct row_data *rd)
+{
+	struct row_queue *rqueue;
+	bool new_round = false;
+	int i;
+
+	if (!rd->nr_reqs[READ] && !rd->nr_reqs[WRITE])
+		return -1;
+
+	for (;;) {
+		for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+			rqueue = &rd->row_queues[i];
+			if (rqueue->nr_req &&
+			    rqueue->nr_dispatched < rqueue->quantum)
+				return i;
+		}
+
+		BUG_ON(new_round);
+		for (i = 0; i < ROWQ_MAX_PRIO; i++)
+			rd->row_queues[i].nr_dispatched = 0;
+		new_round = true;
+	}
+}
+
+/*
+ * row_dispatch_requests moves the oldest request of the selected queue
+ * to the dispatch queue, unless writes are being held back for reads
+ */
+static int row_dispatch_requests(struct request_queue *q, int force)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_queue *rqueue;
+	struct request *rq;
+	int prio;
+
+	prio = row_pick_queue(rd);
+	if (prio < 0)
+		return 0;
+
+	if (rd->idling) {
+		if (!force && !row_queue_idles(prio))
+			return 0;
+		/* a read came in, or we are being drained */
+		del_timer(&rd->idle_timer);
+		rd->idling = false;
+	}
+
+	if (!force && prio > ROWQ_PRIO_REG_READ && row_should_idle(rd)) {
+		rd->idling = true;
+		mod_timer(&rd->idle_timer, jiffies + rd->read_idle);
+		return 0;
+	}
+
+	rqueue = &rd->row_queues[prio];
+	rq = rq_entry_fifo(rqueue->fifo.next);
+	row_remove_request(rd, rq);
+	elv_dispatch_add_tail(q, rq);
+	rqueue->nr_dispatched++;
+
+	return 1;
+}
+
+static void row_exit_queue(struct elevator_queue *e)
+{
+	struct row_data *rd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+		BUG_ON(!list_empty(&rd->row_queues[i].fifo));
+
+	del_timer_sync(&rd->idle_timer);
+	cancel_work_sync(&rd->kick_work);
+
+	kfree(rd);
+}
+
+/*
+ * initialize elevator private data (row_data).
+ */
+static void *row_init_queue(struct request_queue *q)
+{
+	struct row_data *rd;
+	int i;
+
+	rd = kmalloc_node(sizeof(*rd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!rd)
+		return NULL;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		INIT_LIST_HEAD(&rd->row_queues[i].fifo);
+		rd->row_queues[i].quantum = row_quantum[i];
+		rd->row_queues[i].last_insert = jiffies;
+	}
+
+	rd->queue = q;
+	setup_timer(&rd->idle_timer, row_idle_timer, (unsigned long) rd);
+	INIT_WORK(&rd->kick_work, row_kick_queue);
+	/* msecs_to_jiffies() rounds up, so neither becomes 0 */
+	rd->read_idle = msecs_to_jiffies(read_idle);
+	rd->read_idle_freq = msecs_to_jiffies(read_idle_freq);
+
+	return rd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+row_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+row_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return row_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(row_hp_read_quantum_show,
+	rd->row_queues[ROWQ_PRIO_HIGH_READ].quantum, 0);
+SHOW_FUNCTION(row_rp_read_quantum_show,
+	rd->row_queues[ROWQ_PRIO_REG_READ].quantum, 0);
+SHOW_FUNCTION(row_hp_swrite_quantum_show,
+	rd->row_queues[ROWQ_PRIO_HIGH_SWRITE].quantum, 0);
+SHOW_FUNCTION(row_rp_swrite_quantum_show,
+	rd->row_queues[ROWQ_PRIO_REG_SWRITE].quantum, 0);
+SHOW_FUNCTION(row_rp_write_quantum_show,
+	rd->row_queues[ROWQ_PRIO_REG_WRITE].quantum, 0);
+SHOW_FUNCTION(row_lp_read_quantum_show,
+	rd->row_queues[ROWQ_PRIO_LOW_READ].quantum, 0);
+SHOW_FUNCTION(row_lp_write_quantum_show,
+	rd->row_queues[ROWQ_PRIO_LOW_WRITE].quantum, 0);
+SHOW_FUNCTION(row_read_idle_show, rd->read_idle, 1);
+SHOW_FUNCTION(row_read_idle_freq_show, rd->read_idle_freq, 1);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct row_data *rd = e->elevator_data;				\
+	int __data;							\
+	int ret = row_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(row_hp_read_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_HIGH_READ].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_rp_read_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_REG_READ].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_hp_swrite_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_HIGH_SWRITE].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_rp_swrite_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_REG_SWRITE].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_rp_write_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_REG_WRITE].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_lp_read_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_LOW_READ].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_lp_write_quantum_store,
+	&rd->row_queues[ROWQ_PRIO_LOW_WRITE].quantum, 1, INT_MAX, 0);
+STORE_FUNCTION(row_read_idle_store, &rd->read_idle, 0, INT_MAX, 1);
+STORE_FUNCTION(row_read_idle_freq_store, &rd->read_idle_freq, 0, INT_MAX, 1);
+#undef STORE_FUNCTION
+
+#define ROW_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
+				      row_##name##_store)
+
+static struct elv_fs_entry row_attrs[] = {
+	ROW_ATTR(hp_read_quantum),
+	ROW_ATTR(rp_read_quantum),
+	ROW_ATTR(hp_swrite_quantum),
+	ROW_ATTR(rp_swrite_quantum),
+	ROW_ATTR(rp_write_quantum),
+	ROW_ATTR(lp_read_quantum),
+	ROW_ATTR(lp_write_quantum),
+	ROW_ATTR(read_idle),
+	ROW_ATTR(read_idle_freq),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_row = {
+	.ops = {
+		.elevator_merge_req_fn =	row_merged_requests,
+		.elevator_dispatch_fn =		row_dispatch_requests,
+		.elevator_add_req_fn =		row_add_request,
+		.elevator_init_fn =		row_init_queue,
+		.elevator_exit_fn =		row_exit_queue,
+	},
+
+	.elevator_attrs = row_attrs,
+	.elevator_name = "row",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init row_init(void)
+{
+	elv_register(&iosched_row);
+
+	return 0;
+}
+
+static void __exit row_exit(void)
+{
+	elv_unregister(&iosched_row);
+}
+
+module_init(row_init);
+module_exit(row_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Read Over Write IO scheduler");
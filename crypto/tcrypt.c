@@ -33,6 +33,9 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <asm/sections.h>
 #include "tcrypt.h"
 #include "internal.h"
 
@@ -47,6 +50,11 @@
 #define ENCRYPT 1
 #define DECRYPT 0
 
+/*
+ * Used by test_comp_speed(): pages of kernel text compressed per pass
+ */
+#define COMP_SPEED_PAGES	256
+
 /*
  * Used by test_cipher_speed()
  */
@@ -64,7 +72,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -719,6 +727,83 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+/*
+ * Compress and decompress the kernel text a page at a time, the way zram
+ * uses a compressor, for sec seconds (at least one pass).  Kernel text
+ * only gives comparable speeds; for ratios on swap data use
+ * tools/zram/zram-bench -c with a captured corpus.
+ */
+static void test_comp_speed(const char *algo, unsigned int sec)
+{
+	unsigned int npages = (_etext - _stext) >> PAGE_SHIFT;
+	u64 in = 0, out = 0, cns = 0, dns = 0;
+	struct crypto_comp *tfm;
+	unsigned long end;
+	u8 *dst, *back;
+	unsigned int i;
+	int ret = 0;
+
+	printk(KERN_INFO "\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk(KERN_ERR "failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	dst = kmalloc(2 * PAGE_SIZE, GFP_KERNEL);
+	back = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!dst || !back) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	npages = min_t(unsigned int, npages, COMP_SPEED_PAGES);
+	end = jiffies + (sec ?: 1) * HZ;
+	do {
+		for (i = 0; i < npages; i++) {
+			const u8 *src = (const u8 *)_stext + i * PAGE_SIZE;
+			unsigned int dlen = 2 * PAGE_SIZE;
+			unsigned int blen = PAGE_SIZE;
+			ktime_t t;
+
+			t = ktime_get();
+			ret = crypto_comp_compress(tfm, src, PAGE_SIZE, dst,
+						   &dlen);
+			cns += ktime_to_ns(ktime_sub(ktime_get(), t));
+			if (ret)
+				goto out;
+
+			t = ktime_get();
+			ret = crypto_comp_decompress(tfm, dst, dlen, back,
+						     &blen);
+			dns += ktime_to_ns(ktime_sub(ktime_get(), t));
+			if (!ret && (blen != PAGE_SIZE ||
+				     memcmp(back, src, PAGE_SIZE)))
+				ret = -EINVAL;
+			if (ret)
+				goto out;
+
+			in += PAGE_SIZE;
+			out += dlen;
+		}
+	} while (time_before(jiffies, end));
+
+	printk(KERN_INFO "%u pages, ratio %llu.%02llu, compress %llu MB/s, "
+	       "decompress %llu MB/s\n", npages, div64_u64(in, out),
+	       div64_u64(in * 100, out) % 100,
+	       div64_u64(in * 1000, cns ?: 1),
+	       div64_u64(in * 1000, dns ?: 1));
+
+out:
+	if (ret)
+		printk(KERN_ERR "%s failed: %d\n", algo, ret);
+	kfree(back);
+	kfree(dst);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -944,6 +1029,10 @@ static int do_test(int m)
 		ret += tcrypt_test("rfc4309(ccm(aes))");
 		break;
 
+	case 46:
+		ret += tcrypt_test("lz4");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1231,6 +1320,24 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_comp_speed("lzo", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_comp_speed("lz4", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_comp_speed("deflate", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
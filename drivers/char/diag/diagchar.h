@@ -142,10 +142,17 @@ struct diagchar_dev {
 	mempool_t *diagpool;
 	mempool_t *diag_hdlc_pool;
 	mempool_t *diag_write_struct_pool;
-	struct mutex diagmem_mutex;
 	int count;
 	int count_hdlc_pool;
 	int count_write_struct_pool;
+	/* Current caps, grown from poolsize* when full, reset when idle */
+	int limit;
+	int limit_hdlc_pool;
+	int limit_write_struct_pool;
+	/* Allocations refused because a pool was at its largest cap */
+	int drops;
+	int drops_hdlc_pool;
+	int drops_write_struct_pool;
 	int used;
 
 	/* State for diag forwarding */
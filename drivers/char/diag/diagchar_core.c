@@ -929,9 +929,26 @@ static const struct file_operations diagcharfops = {
 	.release = diagchar_close
 };
 
-static int diagchar_setup_cdev(dev_t devno)
+static ssize_t mempool_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
 {
+	return snprintf(buf, PAGE_SIZE,
+			"copy: %d/%d in use, %d dropped\n"
+			"hdlc: %d/%d in use, %d dropped\n"
+			"write_struct: %d/%d in use, %d dropped\n",
+			driver->count, driver->limit, driver->drops,
+			driver->count_hdlc_pool, driver->limit_hdlc_pool,
+			driver->drops_hdlc_pool,
+			driver->count_write_struct_pool,
+			driver->limit_write_struct_pool,
+			driver->drops_write_struct_pool);
+}
+
+static DEVICE_ATTR(mempool, S_IRUGO, mempool_show, NULL);
 
+static int diagchar_setup_cdev(dev_t devno)
+{
+	struct device *dev;
 	int err;
 
 	cdev_init(driver->cdev, &diagcharfops);
@@ -953,8 +970,10 @@ static int diagchar_setup_cdev(dev_t devno)
 		return -1;
 	}
 
-	device_create(driver->diagchar_class, NULL, devno,
+	dev = device_create(driver->diagchar_class, NULL, devno,
 				  (void *)driver, "diag");
+	if (!IS_ERR(dev) && device_create_file(dev, &dev_attr_mempool))
+		pr_err("diag: unable to create mempool attribute\n");
 
 	return 0;
 
@@ -1039,6 +1058,7 @@ static int __init diagchar_init(void)
 			diag_read_smd_wcnss_work_fn);
 		INIT_WORK(&(driver->diag_read_smd_wcnss_cntl_work),
 			diag_read_smd_wcnss_cntl_work_fn);
+		diag_hdlc_init();
 		diagfwd_init();
 		diagfwd_cntl_init();
 		diag_sdio_fn(INIT);
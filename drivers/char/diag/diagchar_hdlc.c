@@ -18,6 +18,7 @@
 #include <linux/device.h>
 #include <linux/uaccess.h>
 #include <linux/crc-ccitt.h>
+#include <asm/unaligned.h>
 #include "diagchar_hdlc.h"
 
 
@@ -28,6 +29,40 @@ MODULE_LICENSE("GPL v2");
 #define CRC_16_L_STEP(xx_crc, xx_c) \
 	crc_ccitt_byte(xx_crc, xx_c)
 
+/*
+ * Most of a diag stream needs no escaping, so encode and decode move
+ * four bytes at a time until a word holds a byte in 0x7C..0x7F, which
+ * covers both ESC_CHAR and CONTROL_CHAR, and only then go byte by byte.
+ */
+#define HDLC_NEEDS_ESC(w) \
+	(((((w) & 0xFCFCFCFC) ^ 0x7C7C7C7C) - 0x01010101) & \
+	 ~(((w) & 0xFCFCFCFC) ^ 0x7C7C7C7C) & 0x80808080)
+
+/* crc_ccitt_table[] advanced by one, two and three more zero bytes */
+static u16 crc_16_l_table[3][256];
+
+void diag_hdlc_init(void)
+{
+	int i, k;
+	u16 crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = crc_ccitt_table[i];
+		for (k = 0; k < 3; k++) {
+			crc = crc_ccitt_byte(crc, 0);
+			crc_16_l_table[k][i] = crc;
+		}
+	}
+}
+
+/* Same as four CRC_16_L_STEP()s, without the dependency chain */
+static inline u16 crc_16_l_step4(u16 crc, const uint8_t *p)
+{
+	return crc_16_l_table[2][(crc ^ p[0]) & 0xFF] ^
+	       crc_16_l_table[1][((crc >> 8) ^ p[1]) & 0xFF] ^
+	       crc_16_l_table[0][p[2]] ^ crc_ccitt_table[p[3]];
+}
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc)
 {
@@ -39,6 +74,7 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 	unsigned char src_byte = 0;
 	enum diag_send_state_enum_type state;
 	unsigned int used = 0;
+	u32 word;
 
 	if (src_desc && enc) {
 
@@ -64,6 +100,20 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 			   of 2 dest bytes for an escaped byte */
 			while (src <= src_last && dest <= dest_last) {
 
+				while (src_last - src >= 3 &&
+				       dest_last - dest >= 3) {
+					word = get_unaligned((u32 *)src);
+					if (HDLC_NEEDS_ESC(word))
+						break;
+					put_unaligned(word, (u32 *)dest);
+					crc = crc_16_l_step4(crc, src);
+					src += 4;
+					dest += 4;
+					used += 4;
+				}
+				if (src > src_last || dest > dest_last)
+					break;
+
 				src_byte = *src++;
 
 				if ((src_byte == CONTROL_CHAR) ||
@@ -169,6 +219,7 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 	unsigned int len = 0;
 	unsigned int i;
 	uint8_t src_byte;
+	u32 word;
 
 	int pkt_bnd = 0;
 
@@ -186,6 +237,18 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 
 		for (i = 0; i < src_length; i++) {
 
+			while (!hdlc->escaping && src_length - i >= 4 &&
+			       dest_length - len >= 4) {
+				word = get_unaligned((u32 *)&src_ptr[i]);
+				if (HDLC_NEEDS_ESC(word))
+					break;
+				put_unaligned(word, (u32 *)&dest_ptr[len]);
+				i += 4;
+				len += 4;
+			}
+			if (i >= src_length || len >= dest_length)
+				break;
+
 			src_byte = src_ptr[i];
 
 			if (hdlc->escaping) {
@@ -130,6 +130,24 @@ int chk_apps_master(void)
 		return 0;
 }
 
+/*
+ * Read @r bytes from @ch into @buf, then keep appending whatever else is
+ * already waiting while it fits in @size, so that back to back packets
+ * go out to the host in one write.
+ */
+static int diag_smd_read_batch(smd_channel_t *ch, void *buf, int r, int size)
+{
+	int total = 0;
+
+	do {
+		smd_read(ch, buf + total, r);
+		total += r;
+		r = smd_read_avail(ch);
+	} while (r > 0 && total + r <= size);
+
+	return total;
+}
+
 void __diag_smd_send_req(void)
 {
 	void *buf = NULL;
@@ -165,9 +183,10 @@ void __diag_smd_send_req(void)
 				pr_info("Out of diagmem for Modem\n");
 			else {
 				APPEND_DEBUG('i');
-				smd_read(driver->ch, buf, r);
+				write_ptr_modem->length = diag_smd_read_batch(
+					driver->ch, buf, r,
+					max_t(int, r, IN_BUF_SIZE));
 				APPEND_DEBUG('j');
-				write_ptr_modem->length = r;
 				*in_busy_ptr = 1;
 				diag_device_write(buf, MODEM_DATA,
 							 write_ptr_modem);
@@ -309,9 +328,10 @@ void __diag_smd_wcnss_send_req(void)
 				pr_err("Out of diagmem for wcnss\n");
 			} else {
 				APPEND_DEBUG('i');
-				smd_read(driver->ch_wcnss, buf, r);
+				write_ptr_wcnss->length = diag_smd_read_batch(
+					driver->ch_wcnss, buf, r,
+					max_t(int, r, IN_BUF_SIZE));
 				APPEND_DEBUG('j');
-				write_ptr_wcnss->length = r;
 				*in_busy_wcnss_ptr = 1;
 				diag_device_write(buf, WCNSS_DATA,
 					 write_ptr_wcnss);
@@ -355,9 +375,10 @@ void __diag_smd_qdsp_send_req(void)
 				printk(KERN_INFO "Out of diagmem for QDSP\n");
 			else {
 				APPEND_DEBUG('i');
-				smd_read(driver->chqdsp, buf, r);
+				write_ptr_qdsp->length = diag_smd_read_batch(
+					driver->chqdsp, buf, r,
+					max_t(int, r, IN_BUF_SIZE));
 				APPEND_DEBUG('j');
-				write_ptr_qdsp->length = r;
 				*in_busy_qdsp_ptr = 1;
 				diag_device_write(buf, QDSP_DATA,
 							 write_ptr_qdsp);
@@ -14,42 +14,95 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/mempool.h>
-#include <linux/mutex.h>
 #include <asm/atomic.h>
 #include "diagchar.h"
 
+/* A pool's cap grows on drops, up to this many times its poolsize */
+#define DIAGMEM_GROW_MAX	4
+
+/*
+ * Take one of the *@limit items of @pool.  This runs from several
+ * contexts at once without a lock, so the count is bumped with cmpxchg
+ * and can never pass the cap.  When the cap is hit it is raised by
+ * another @poolsize items, with the reserve grown to match as far as
+ * atomic allocations allow; only a request that still fails at
+ * DIAGMEM_GROW_MAX counts as a drop.  mempool_resize() raises min_nr
+ * for good, so diagmem_put() hands the extra reserve back once the
+ * burst is over.
+ */
+static int diagmem_take(mempool_t *pool, int *count, int *limit,
+			unsigned int poolsize, int *drops)
+{
+	int c, l;
+
+	for (;;) {
+		c = atomic_read((atomic_t *)count);
+		l = *limit;
+		if (c < l) {
+			if (atomic_cmpxchg((atomic_t *)count, c, c + 1) == c)
+				return 1;
+			continue;
+		}
+
+		if (l >= poolsize * DIAGMEM_GROW_MAX) {
+			atomic_inc((atomic_t *)drops);
+			return 0;
+		}
+		if (atomic_cmpxchg((atomic_t *)limit, l, l + poolsize) == l)
+			mempool_resize(pool, l + poolsize, GFP_ATOMIC);
+	}
+}
+
+/*
+ * Give back the count of an item that went back to @pool.  If it is the
+ * last one outstanding, the cap and the reserve drop back to @poolsize
+ * first: once the count reaches zero diagmem_exit() may destroy the pool
+ * from another context.  A grow racing with this can leave the reserve
+ * below the cap until the next idle point; mempool_alloc() then just
+ * falls back to kmalloc for the difference.
+ */
+static void diagmem_put(mempool_t *pool, int *count, int *limit,
+			unsigned int poolsize)
+{
+	int l = *limit;
+
+	if (l > poolsize && atomic_read((atomic_t *)count) == 1 &&
+	    atomic_cmpxchg((atomic_t *)limit, l, poolsize) == l)
+		mempool_resize(pool, poolsize, GFP_ATOMIC);
+	atomic_dec((atomic_t *)count);
+}
+
 void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 {
 	void *buf = NULL;
 
 	if (pool_type == POOL_TYPE_COPY) {
 		if (driver->diagpool) {
-			mutex_lock(&driver->diagmem_mutex);
-			if (driver->count < driver->poolsize) {
-				atomic_add(1, (atomic_t *)&driver->count);
+			if (diagmem_take(driver->diagpool, &driver->count,
+					 &driver->limit, driver->poolsize,
+					 &driver->drops))
 				buf = mempool_alloc(driver->diagpool,
 								 GFP_ATOMIC);
-			}
-			mutex_unlock(&driver->diagmem_mutex);
 		}
 	} else if (pool_type == POOL_TYPE_HDLC) {
 		if (driver->diag_hdlc_pool) {
-			if (driver->count_hdlc_pool < driver->poolsize_hdlc) {
-				atomic_add(1,
-					 (atomic_t *)&driver->count_hdlc_pool);
+			if (diagmem_take(driver->diag_hdlc_pool,
+					 &driver->count_hdlc_pool,
+					 &driver->limit_hdlc_pool,
+					 driver->poolsize_hdlc,
+					 &driver->drops_hdlc_pool))
 				buf = mempool_alloc(driver->diag_hdlc_pool,
 								 GFP_ATOMIC);
-			}
 		}
 	} else if (pool_type == POOL_TYPE_WRITE_STRUCT) {
 		if (driver->diag_write_struct_pool) {
-			if (driver->count_write_struct_pool <
-					 driver->poolsize_write_struct) {
-				atomic_add(1,
-				 (atomic_t *)&driver->count_write_struct_pool);
+			if (diagmem_take(driver->diag_write_struct_pool,
+					 &driver->count_write_struct_pool,
+					 &driver->limit_write_struct_pool,
+					 driver->poolsize_write_struct,
+					 &driver->drops_write_struct_pool))
 				buf = mempool_alloc(
 				driver->diag_write_struct_pool, GFP_ATOMIC);
-			}
 		}
 	}
 	return buf;
@@ -90,7 +143,8 @@ void diagmem_free(struct diagchar_dev *driver, void *buf, int pool_type)
 	if (pool_type == POOL_TYPE_COPY) {
 		if (driver->diagpool != NULL && driver->count > 0) {
 			mempool_free(buf, driver->diagpool);
-			atomic_add(-1, (atomic_t *)&driver->count);
+			diagmem_put(driver->diagpool, &driver->count,
+				    &driver->limit, driver->poolsize);
 		} else
 			pr_err("diag: Attempt to free up DIAG driver "
 	       "mempool memory which is already free %d", driver->count);
@@ -98,7 +152,10 @@ void diagmem_free(struct diagchar_dev *driver, void *buf, int pool_type)
 		if (driver->diag_hdlc_pool != NULL &&
 			 driver->count_hdlc_pool > 0) {
 			mempool_free(buf, driver->diag_hdlc_pool);
-			atomic_add(-1, (atomic_t *)&driver->count_hdlc_pool);
+			diagmem_put(driver->diag_hdlc_pool,
+				    &driver->count_hdlc_pool,
+				    &driver->limit_hdlc_pool,
+				    driver->poolsize_hdlc);
 		} else
 			pr_err("diag: Attempt to free up DIAG driver "
 	"HDLC mempool which is already free %d ", driver->count_hdlc_pool);
@@ -106,8 +163,10 @@ void diagmem_free(struct diagchar_dev *driver, void *buf, int pool_type)
 		if (driver->diag_write_struct_pool != NULL &&
 			 driver->count_write_struct_pool > 0) {
 			mempool_free(buf, driver->diag_write_struct_pool);
-			atomic_add(-1,
-				 (atomic_t *)&driver->count_write_struct_pool);
+			diagmem_put(driver->diag_write_struct_pool,
+				    &driver->count_write_struct_pool,
+				    &driver->limit_write_struct_pool,
+				    driver->poolsize_write_struct);
 		} else
 			pr_err("diag: Attempt to free up DIAG driver "
 			   "USB structure mempool which is already free %d ",
@@ -119,19 +178,23 @@ void diagmem_free(struct diagchar_dev *driver, void *buf, int pool_type)
 
 void diagmem_init(struct diagchar_dev *driver)
 {
-	mutex_init(&driver->diagmem_mutex);
-
-	if (driver->count == 0)
+	if (driver->count == 0) {
 		driver->diagpool = mempool_create_kmalloc_pool(
 					driver->poolsize, driver->itemsize);
+		driver->limit = driver->poolsize;
+	}
 
-	if (driver->count_hdlc_pool == 0)
+	if (driver->count_hdlc_pool == 0) {
 		driver->diag_hdlc_pool = mempool_create_kmalloc_pool(
 				driver->poolsize_hdlc, driver->itemsize_hdlc);
+		driver->limit_hdlc_pool = driver->poolsize_hdlc;
+	}
 
-	if (driver->count_write_struct_pool == 0)
+	if (driver->count_write_struct_pool == 0) {
 		driver->diag_write_struct_pool = mempool_create_kmalloc_pool(
 		driver->poolsize_write_struct, driver->itemsize_write_struct);
+		driver->limit_write_struct_pool = driver->poolsize_write_struct;
+	}
 
 	if (!driver->diagpool)
 		printk(KERN_INFO "Cannot allocate diag mempool\n");
@@ -20,6 +20,7 @@
 #include <linux/kobject.h>
 #include <linux/spinlock.h>
 #include <linux/notifier.h>
+#include <linux/hrtimer.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -35,6 +36,11 @@ static cputime64_t cpu1_time_in_state[32] = {0};
 static cputime64_t temp_cpu0_time_in_state[32] = {0};
 static cputime64_t temp_cpu1_time_in_state[32] = {0};
 
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+/* Transition latency buckets: [0] < 1us, [i] < 2^i us, last is open-ended */
+#define TRANS_LAT_BUCKETS	16
+#endif
+
 static unsigned int cpu1_total_trans;
 static unsigned int temp_cpu0_total_trans;
 static unsigned int temp_cpu1_total_trans;
@@ -50,6 +56,9 @@ struct cpufreq_stats {
 	unsigned int *freq_table;
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	unsigned int *trans_table;
+	ktime_t trans_start;
+	unsigned int trans_lat[TRANS_LAT_BUCKETS];
+	s64 trans_lat_max_us;
 #endif
 };
 
@@ -215,6 +224,55 @@ static ssize_t show_trans_table(struct cpufreq_policy *policy, char *buf)
 	return len;
 }
 CPUFREQ_STATDEVICE_ATTR(trans_table, 0444, show_trans_table);
+
+static ssize_t show_trans_latency(struct cpufreq_policy *policy, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+
+	spin_lock(&cpufreq_stats_lock);
+	for (i = 0; i < TRANS_LAT_BUCKETS - 1; i++)
+		len += sprintf(buf + len, "<%uus %u\n", 1U << i,
+				stat->trans_lat[i]);
+	len += sprintf(buf + len, ">=%uus %u\n", 1U << (i - 1),
+			stat->trans_lat[i]);
+	len += sprintf(buf + len, "max %lldus\n", stat->trans_lat_max_us);
+	spin_unlock(&cpufreq_stats_lock);
+	return len;
+}
+CPUFREQ_STATDEVICE_ATTR(trans_latency, 0444, show_trans_latency);
+
+/*
+ * Account the time between the PRECHANGE and POSTCHANGE notifications,
+ * i.e. how long the driver took to actually switch the clock.
+ */
+static void cpufreq_stats_trans_latency(struct cpufreq_stats *stat,
+					unsigned long val)
+{
+	s64 us;
+	int bucket;
+
+	if (val == CPUFREQ_PRECHANGE) {
+		stat->trans_start = ktime_get();
+		return;
+	}
+
+	if (!stat->trans_start.tv64)
+		return;
+
+	us = ktime_us_delta(ktime_get(), stat->trans_start);
+	stat->trans_start.tv64 = 0;
+	bucket = us > 0 ? min_t(int, fls64(us), TRANS_LAT_BUCKETS - 1) : 0;
+
+	spin_lock(&cpufreq_stats_lock);
+	stat->trans_lat[bucket]++;
+	if (us > stat->trans_lat_max_us)
+		stat->trans_lat_max_us = us;
+	spin_unlock(&cpufreq_stats_lock);
+}
 #endif
 
 CPUFREQ_STATDEVICE_ATTR(total_trans, 0444, show_total_trans);
@@ -229,6 +287,7 @@ static struct attribute *default_attrs[] = {
        &_attr_cpu1_total_trans.attr,
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&_attr_trans_table.attr,
+	&_attr_trans_latency.attr,
 #endif
 	NULL
 };
@@ -370,13 +429,19 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	struct cpufreq_stats *stat;
 	int old_index, new_index;
 
-	if (val != CPUFREQ_POSTCHANGE)
+	if (val != CPUFREQ_PRECHANGE && val != CPUFREQ_POSTCHANGE)
 		return 0;
 
 	stat = per_cpu(cpufreq_stats_table, freq->cpu);
 	if (!stat)
 		return 0;
 
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	cpufreq_stats_trans_latency(stat, val);
+#endif
+	if (val != CPUFREQ_POSTCHANGE)
+		return 0;
+
 	old_index = stat->last_index;
 	new_index = freq_table_get_index(stat, freq->new);
 
@@ -89,6 +89,7 @@ struct mmc_blk_data {
 	unsigned int	flags;
 #define MMC_BLK_CMD23	(1 << 0)	/* Can do SET_BLOCK_COUNT for multiblock */
 #define MMC_BLK_REL_WR	(1 << 1)	/* MMC Reliable write support */
+#define MMC_BLK_PACKED_WR (1 << 2)	/* eMMC 4.5 packed write support */
 
 	unsigned int	usage;
 	unsigned int	read_only;
@@ -102,6 +103,8 @@ struct mmc_blk_data {
 	 */
 	unsigned int	part_curr;
 	struct device_attribute force_ro;
+	struct device_attribute packing_threshold;
+	struct device_attribute packing_stats;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -177,6 +180,84 @@ out:
 	return ret;
 }
 
+static ssize_t packing_threshold_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	int ret;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	ret = snprintf(buf, PAGE_SIZE, "%u\n", md->queue.packed_threshold);
+	mmc_blk_put(md);
+	return ret;
+}
+
+/* 0 turns packing off, otherwise the fewest requests worth packing */
+static ssize_t packing_threshold_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int ret;
+	char *end;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	unsigned long set = simple_strtoul(buf, &end, 0);
+	if (end == buf || set == 1 || set > MMC_PACKED_MAX) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	md->queue.packed_threshold = set;
+	ret = count;
+out:
+	mmc_blk_put(md);
+	return ret;
+}
+
+static const char *mmc_packed_stop_names[MMC_PACKED_STOP_NR] = {
+	[MMC_PACKED_STOP_EMPTY]		= "empty queue",
+	[MMC_PACKED_STOP_READ]		= "read",
+	[MMC_PACKED_STOP_SPECIAL]	= "flush or discard",
+	[MMC_PACKED_STOP_REL_WR]	= "reliable write",
+	[MMC_PACKED_STOP_MAX_REQS]	= "max packed writes",
+	[MMC_PACKED_STOP_SIZE]		= "max transfer size",
+	[MMC_PACKED_STOP_SEGS]		= "max segments",
+};
+
+static ssize_t packing_stats_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	int i, len = 0;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_packed_stats *stats = &md->queue.packed_stats;
+
+	len += snprintf(buf + len, PAGE_SIZE - len, "packed writes:\n");
+	for (i = 2; i <= MMC_PACKED_MAX; i++)
+		if (stats->packed[i])
+			len += snprintf(buf + len, PAGE_SIZE - len,
+					"  %d requests: %lu\n",
+					i, stats->packed[i]);
+	len += snprintf(buf + len, PAGE_SIZE - len, "stopped packing on:\n");
+	for (i = 0; i < MMC_PACKED_STOP_NR; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "  %s: %lu\n",
+				mmc_packed_stop_names[i], stats->stop[i]);
+	len += snprintf(buf + len, PAGE_SIZE - len,
+			"below threshold: %lu\nerrors: %lu\n",
+			stats->below_threshold, stats->errors);
+
+	mmc_blk_put(md);
+	return len;
+}
+
+/* Any write resets the statistics */
+static ssize_t packing_stats_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	memset(&md->queue.packed_stats, 0, sizeof(md->queue.packed_stats));
+	mmc_blk_put(md);
+	return count;
+}
+
 static int mmc_blk_open(struct block_device *bdev, fmode_t mode)
 {
 	struct mmc_blk_data *md = mmc_blk_get(bdev->bd_disk);
@@ -850,6 +931,90 @@ static inline void mmc_apply_rel_rw(struct mmc_blk_request *brq,
 	 R1_CC_ERROR |		/* Card controller error */		\
 	 R1_ERROR)		/* General/unknown error */
 
+/*
+ * Reliable writes are used to implement Forced Unit Access and
+ * REQ_META accesses, and are supported only on MMCs.
+ */
+static inline bool mmc_blk_rel_wr(struct mmc_blk_data *md,
+				  struct request *req)
+{
+	return ((req->cmd_flags & REQ_FUA) ||
+		(req->cmd_flags & REQ_META)) &&
+		(rq_data_dir(req) == WRITE) &&
+		(md->flags & MMC_BLK_REL_WR);
+}
+
+/*
+ * Start the request queued after the one on the bus and map its data,
+ * so that this overlaps the transfer. Reads are always taken, writes
+ * only when they would not be packed or need a reliable write.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct request_queue *q = mq->queue;
+	struct mmc_data *data = &mq->prep_data;
+	struct request *next;
+
+	if (!mq->prep_sg || mq->prep_req)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	next = blk_peek_request(q);
+	if (next && ((next->cmd_flags & (REQ_DISCARD | REQ_FLUSH)) ||
+		     (rq_data_dir(next) == WRITE &&
+		      (mmc_blk_rel_wr(md, next) ||
+		       ((md->flags & MMC_BLK_PACKED_WR) &&
+			mq->packed_threshold)))))
+		next = NULL;
+	if (next)
+		blk_start_request(next);
+	spin_unlock_irq(q->queue_lock);
+
+	if (!next)
+		return;
+
+	memset(data, 0, sizeof(struct mmc_data));
+	data->blksz = 512;
+	data->blocks = blk_rq_sectors(next);
+	data->flags = rq_data_dir(next) == READ ? MMC_DATA_READ :
+						   MMC_DATA_WRITE;
+	data->sg = mq->prep_sg;
+	data->sg_len = blk_rq_map_sg(q, next, mq->prep_sg);
+
+	memset(&mq->prep_mrq, 0, sizeof(struct mmc_request));
+	mq->prep_mrq.data = data;
+	mmc_pre_req(mq->card->host, &mq->prep_mrq, false);
+	mq->prep_req = next;
+}
+
+/*
+ * Issue the prepared request with the sg list mapped for it, and make
+ * the other list the one the next request is mapped into.
+ */
+static void mmc_blk_use_prep(struct mmc_queue *mq, struct mmc_data *data)
+{
+	struct scatterlist *sg = mq->sg;
+
+	mq->sg = mq->prep_sg;
+	mq->prep_sg = sg;
+
+	data->sg = mq->sg;
+	data->sg_len = mq->prep_data.sg_len;
+	data->host_cookie = mq->prep_data.host_cookie;
+	mq->prep_req = NULL;
+}
+
+/* Drop the mapping of a prepared request that will be mapped again */
+static void mmc_blk_unprep(struct mmc_queue *mq)
+{
+	if (!mq->prep_req)
+		return;
+
+	mmc_post_req(mq->card->host, &mq->prep_mrq, 0);
+	mq->prep_req = NULL;
+}
+
 
 static int
 mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card);
@@ -1266,15 +1431,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	u32 status;
 	int  no_ready = 0;
 	ktime_t start, diff;
-
-	/*
-	 * Reliable writes are used to implement Forced Unit Access and
-	 * REQ_META accesses, and are supported only on MMCs.
-	 */
-	bool do_rel_wr = ((req->cmd_flags & REQ_FUA) ||
-			  (req->cmd_flags & REQ_META)) &&
-		(rq_data_dir(req) == WRITE) &&
-		(md->flags & MMC_BLK_REL_WR);
+	bool do_rel_wr = mmc_blk_rel_wr(md, req);
 
 	do {
 		u32 readcmd, writecmd;
@@ -1365,8 +1522,19 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 
 		mmc_set_data_timeout(&brq.data, card);
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+		/*
+		 * Use the mapping made while the previous request was on
+		 * the bus, unless only part of the request can be sent.
+		 */
+		if (req == mq->prep_req &&
+		    brq.data.blocks == blk_rq_sectors(req)) {
+			mmc_blk_use_prep(mq, &brq.data);
+		} else {
+			if (req == mq->prep_req)
+				mmc_blk_unprep(mq);
+			brq.data.sg = mq->sg;
+			brq.data.sg_len = mmc_queue_map_sg(mq);
+		}
 
 		/*
 		 * Adjust the sg list so it is the same size as the
@@ -1390,7 +1558,10 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		start = ktime_get();
 		mmc_queue_bounce_pre(mq);
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+		mmc_start_req(card->host, &brq.mrq);
+		mmc_blk_prep_next(mq);
+		mmc_wait_for_req_done(card->host, &brq.mrq);
+		mmc_post_req(card->host, &brq.mrq, 0);
 
 		mmc_queue_bounce_post(mq);
 		diff = ktime_sub(ktime_get(), start);
@@ -1591,6 +1762,264 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 	return 0;
 }
 
+/*
+ * Packed writes (eMMC 4.5): a header block listing the CMD23 and CMD25
+ * arguments of each request, followed by their data, all sent as one
+ * CMD23 bounded CMD25. The card then programs each request as if it
+ * had been sent on its own.
+ */
+#define MMC_PACKED_VERSION	0x01
+#define MMC_PACKED_WRITE	0x02
+#define MMC_CMD23_ARG_PACKED	(1 << 30)
+
+static inline u32 mmc_blk_rq_addr(struct mmc_card *card, struct request *req)
+{
+	return mmc_card_blockaddr(card) ? blk_rq_pos(req) : blk_rq_pos(req) << 9;
+}
+
+/*
+ * Start the writes queued behind @req that can go in one packed write
+ * with it, and put them all on mq->packed_list. Returns the number of
+ * requests to pack, or 0 to issue @req on its own.
+ */
+static unsigned int mmc_blk_prep_packed_list(struct mmc_queue *mq,
+					     struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_host *host = mq->card->host;
+	struct request_queue *q = mq->queue;
+	struct mmc_packed_stats *stats = &mq->packed_stats;
+	struct request *next;
+	unsigned int max_reqs, max_blocks, stop;
+
+	if (!(md->flags & MMC_BLK_PACKED_WR) || !mq->packed_threshold ||
+	    rq_data_dir(req) != WRITE || mmc_blk_rel_wr(md, req))
+		return 0;
+
+	max_reqs = min_t(unsigned int, mq->card->ext_csd.max_packed_writes,
+			 MMC_PACKED_MAX);
+	max_blocks = min(host->max_blk_count, host->max_req_size >> 9);
+
+	/* The header takes a block and a segment of its own */
+	if (blk_rq_sectors(req) + 1 > max_blocks ||
+	    req->nr_phys_segments + 1 > host->max_segs)
+		return 0;
+
+	/* Packing was turned on after @req was mapped on its own */
+	if (req == mq->prep_req)
+		mmc_blk_unprep(mq);
+
+	list_add_tail(&req->queuelist, &mq->packed_list);
+	mq->packed_nr = 1;
+	mq->packed_blocks = blk_rq_sectors(req) + 1;
+	mq->packed_segs = req->nr_phys_segments + 1;
+
+	spin_lock_irq(q->queue_lock);
+	for (;;) {
+		if (mq->packed_nr >= max_reqs) {
+			stop = MMC_PACKED_STOP_MAX_REQS;
+			break;
+		}
+
+		next = blk_peek_request(q);
+		if (!next) {
+			stop = MMC_PACKED_STOP_EMPTY;
+			break;
+		}
+		if (next->cmd_flags & (REQ_DISCARD | REQ_FLUSH)) {
+			stop = MMC_PACKED_STOP_SPECIAL;
+			break;
+		}
+		if (rq_data_dir(next) != WRITE) {
+			stop = MMC_PACKED_STOP_READ;
+			break;
+		}
+		if (mmc_blk_rel_wr(md, next)) {
+			stop = MMC_PACKED_STOP_REL_WR;
+			break;
+		}
+		if (mq->packed_blocks + blk_rq_sectors(next) > max_blocks) {
+			stop = MMC_PACKED_STOP_SIZE;
+			break;
+		}
+		if (mq->packed_segs + next->nr_phys_segments > host->max_segs) {
+			stop = MMC_PACKED_STOP_SEGS;
+			break;
+		}
+
+		blk_start_request(next);
+		list_add_tail(&next->queuelist, &mq->packed_list);
+		mq->packed_nr++;
+		mq->packed_blocks += blk_rq_sectors(next);
+		mq->packed_segs += next->nr_phys_segments;
+	}
+	stats->stop[stop]++;
+
+	if (mq->packed_nr < mq->packed_threshold) {
+		/* Put back all but @req, last first to keep their order */
+		while (mq->packed_nr > 1) {
+			next = list_entry(mq->packed_list.prev, struct request,
+					  queuelist);
+			list_del_init(&next->queuelist);
+			blk_requeue_request(q, next);
+			mq->packed_nr--;
+		}
+		list_del_init(&req->queuelist);
+		mq->packed_nr = 0;
+		stats->below_threshold++;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	return mq->packed_nr;
+}
+
+/*
+ * Get the card back to the transfer state after a write, failed or not:
+ * stop it if it is still receiving, then wait for programming to end.
+ */
+static int mmc_blk_wait_prg_done(struct mmc_card *card)
+{
+	unsigned long timeout = jiffies + HZ * 2;
+	bool stopped = false;
+	u32 status;
+	int err;
+
+	do {
+		err = get_card_status(card, &status, 5);
+		if (err)
+			return err;
+		if (!stopped &&
+		    (R1_CURRENT_STATE(status) == R1_STATE_DATA ||
+		     R1_CURRENT_STATE(status) == R1_STATE_RCV)) {
+			err = send_stop(card, &status);
+			if (err)
+				return err;
+			stopped = true;
+			continue;
+		}
+		if (time_after(jiffies, timeout))
+			return -ETIMEDOUT;
+	} while (!(status & R1_READY_FOR_DATA) ||
+		 (R1_CURRENT_STATE(status) == R1_STATE_PRG));
+
+	return 0;
+}
+
+/*
+ * After a failed packed write, the number of requests at its start
+ * that the card reports as written.
+ */
+static unsigned int mmc_blk_packed_done(struct mmc_card *card,
+					unsigned int nr)
+{
+	u8 *ext_csd;
+	unsigned int done = 0;
+
+	ext_csd = kmalloc(512, GFP_KERNEL);
+	if (!ext_csd)
+		return 0;
+
+	/* PACKED_FAILURE_INDEX counts from 1 */
+	if (!mmc_send_ext_csd(card, ext_csd) &&
+	    (ext_csd[EXT_CSD_PACKED_CMD_STATUS] &
+	     EXT_CSD_PACKED_INDEXED_ERROR) &&
+	    ext_csd[EXT_CSD_PACKED_FAILURE_INDEX])
+		done = min_t(unsigned int,
+			     ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] - 1, nr);
+
+	kfree(ext_csd);
+	return done;
+}
+
+/*
+ * Issue the requests on mq->packed_list as one packed write. If it
+ * fails, the requests the card did not report as written are redone
+ * one at a time.
+ */
+static int mmc_blk_issue_packed_rq(struct mmc_queue *mq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request brq;
+	struct request *req;
+	__le32 *hdr = mq->packed_hdr;
+	unsigned int i = 1, done;
+	int ret = 1, err;
+
+	memset(hdr, 0, MMC_PACKED_HDR_SIZE);
+	hdr[0] = cpu_to_le32(mq->packed_nr << 16 | MMC_PACKED_WRITE << 8 |
+			     MMC_PACKED_VERSION);
+	list_for_each_entry(req, &mq->packed_list, queuelist) {
+		hdr[i * 2] = cpu_to_le32(blk_rq_sectors(req));
+		hdr[i * 2 + 1] = cpu_to_le32(mmc_blk_rq_addr(card, req));
+		i++;
+	}
+	req = list_first_entry(&mq->packed_list, struct request, queuelist);
+
+	memset(&brq, 0, sizeof(struct mmc_blk_request));
+	brq.mrq.sbc = &brq.sbc;
+	brq.mrq.cmd = &brq.cmd;
+	brq.mrq.data = &brq.data;
+	brq.mrq.stop = &brq.stop;
+
+	brq.sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq.sbc.arg = MMC_CMD23_ARG_PACKED | mq->packed_blocks;
+	brq.sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq.cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq.cmd.arg = mmc_blk_rq_addr(card, req);
+	brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq.stop.opcode = MMC_STOP_TRANSMISSION;
+	brq.stop.arg = 0;
+	brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	brq.data.blksz = 512;
+	brq.data.blocks = mq->packed_blocks;
+	brq.data.flags = MMC_DATA_WRITE;
+	brq.data.sg = mq->sg;
+	brq.data.sg_len = mmc_queue_packed_map_sg(mq);
+	mmc_set_data_timeout(&brq.data, card);
+
+	mq->packed_stats.packed[mq->packed_nr]++;
+	mmc_start_req(card->host, &brq.mrq);
+	mmc_blk_prep_next(mq);
+	mmc_wait_for_req_done(card->host, &brq.mrq);
+
+	/* also before reading EXT_CSD: the card may still be busy */
+	err = mmc_blk_wait_prg_done(card);
+	if (err || brq.sbc.error || brq.cmd.error || brq.stop.error ||
+	    brq.data.error || (brq.cmd.resp[0] & CMD_ERRORS)) {
+		done = mmc_blk_packed_done(card, mq->packed_nr);
+		mq->packed_stats.errors++;
+		pr_err("%s: packed write of %u requests failed, %u written\n",
+			req->rq_disk->disk_name, mq->packed_nr, done);
+	} else {
+		done = mq->packed_nr;
+	}
+
+	spin_lock_irq(&md->lock);
+	for (i = 0; i < done; i++) {
+		req = list_first_entry(&mq->packed_list, struct request,
+				       queuelist);
+		list_del_init(&req->queuelist);
+		__blk_end_request_all(req, 0);
+	}
+	spin_unlock_irq(&md->lock);
+
+	while (!list_empty(&mq->packed_list)) {
+		req = list_first_entry(&mq->packed_list, struct request,
+				       queuelist);
+		list_del_init(&req->queuelist);
+		mq->req = req;
+		if (!mmc_blk_issue_rw_rq(mq, req))
+			ret = 0;
+	}
+	mq->packed_nr = 0;
+
+	return ret;
+}
+
 static int sd_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 {
 	int ret;
@@ -1798,6 +2227,8 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	mmc_claim_host(card->host);
 	ret = mmc_blk_part_switch(card, md);
 	if (ret) {
+		if (req == mq->prep_req)
+			mmc_blk_unprep(mq);
 		ret = 0;
 		goto out;
 	}
@@ -1809,6 +2240,8 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 			ret = mmc_blk_issue_discard_rq(mq, req);
 	} else if (req->cmd_flags & REQ_FLUSH)
 		ret = mmc_blk_issue_flush(mq, req);
+	else if (mmc_blk_prep_packed_list(mq, req))
+		ret = mmc_blk_issue_packed_rq(mq);
 	else
 		ret = mmc_blk_issue_rw_rq(mq, req);
 
@@ -1925,6 +2358,10 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	/* The queue only sets up packing for cards and hosts that can */
+	if (md->flags & MMC_BLK_CMD23 && md->queue.packed_hdr)
+		md->flags |= MMC_BLK_PACKED_WR;
+
 	return md;
 
  err_putdisk:
@@ -2031,6 +2468,12 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 	if (md) {
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+			if (md->flags & MMC_BLK_PACKED_WR) {
+				device_remove_file(disk_to_dev(md->disk),
+						   &md->packing_threshold);
+				device_remove_file(disk_to_dev(md->disk),
+						   &md->packing_stats);
+			}
 
 			/* Stop new requests from getting into the queue */
 			del_gendisk_async(md->disk);
@@ -2068,8 +2511,38 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	md->force_ro.attr.mode = S_IRUGO | S_IWUSR;
 	ret = device_create_file(disk_to_dev(md->disk), &md->force_ro);
 	if (ret)
-		del_gendisk(md->disk);
+		goto del_disk;
+
+	if (!(md->flags & MMC_BLK_PACKED_WR))
+		return 0;
+
+	md->packing_threshold.show = packing_threshold_show;
+	md->packing_threshold.store = packing_threshold_store;
+	sysfs_attr_init(&md->packing_threshold.attr);
+	md->packing_threshold.attr.name = "packing_threshold";
+	md->packing_threshold.attr.mode = S_IRUGO | S_IWUSR;
+	ret = device_create_file(disk_to_dev(md->disk),
+				 &md->packing_threshold);
+	if (ret)
+		goto remove_force_ro;
+
+	md->packing_stats.show = packing_stats_show;
+	md->packing_stats.store = packing_stats_store;
+	sysfs_attr_init(&md->packing_stats.attr);
+	md->packing_stats.attr.name = "packing_stats";
+	md->packing_stats.attr.mode = S_IRUGO | S_IWUSR;
+	ret = device_create_file(disk_to_dev(md->disk), &md->packing_stats);
+	if (ret)
+		goto remove_threshold;
+
+	return 0;
 
+ remove_threshold:
+	device_remove_file(disk_to_dev(md->disk), &md->packing_threshold);
+ remove_force_ro:
+	device_remove_file(disk_to_dev(md->disk), &md->force_ro);
+ del_disk:
+	del_gendisk(md->disk);
 	return ret;
 }
 
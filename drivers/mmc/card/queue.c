@@ -131,7 +131,10 @@ static int mmc_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
+		/* A request may already have been started and mapped */
+		req = mq->prep_req;
+		if (!req)
+			req = blk_fetch_request(q);
 		mq->req = req;
 		spin_unlock_irq(q->queue_lock);
 
@@ -320,6 +323,29 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		sg_init_table(mq->sg, host->max_segs);
 	}
 
+	/*
+	 * Packed writes are built on the sg list, so there is no packing
+	 * through a bounce buffer.
+	 */
+	INIT_LIST_HEAD(&mq->packed_list);
+	if (mmc_card_mmc(card) && mmc_host_packed_wr(host) &&
+	    card->ext_csd.max_packed_writes && !mq->bounce_buf) {
+		mq->packed_hdr = kmalloc(MMC_PACKED_HDR_SIZE, GFP_KERNEL);
+		if (!mq->packed_hdr)
+			printk(KERN_WARNING "%s: unable to allocate packed "
+				"header, not packing writes\n",
+				mmc_card_name(card));
+		mq->packed_threshold = MMC_PACKED_THRESHOLD;
+	}
+
+	/* The next request can be mapped ahead only if the host can */
+	if (!mmc_card_sd(card) && !mq->bounce_buf && host->ops->pre_req) {
+		mq->prep_sg = kmalloc(sizeof(struct scatterlist) *
+			host->max_segs, GFP_KERNEL);
+		if (mq->prep_sg)
+			sg_init_table(mq->prep_sg, host->max_segs);
+	}
+
 	sema_init(&mq->thread_sem, 1);
 
 	if (mmc_card_sd(card))
@@ -343,6 +369,10 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		kfree(mq->sg);
 
 	mq->sg = NULL;
+	kfree(mq->prep_sg);
+	mq->prep_sg = NULL;
+	kfree(mq->packed_hdr);
+	mq->packed_hdr = NULL;
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -375,6 +405,11 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 
 	mq->sg = NULL;
 
+	kfree(mq->prep_sg);
+	mq->prep_sg = NULL;
+	kfree(mq->packed_hdr);
+	mq->packed_hdr = NULL;
+
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -455,6 +490,28 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	return 1;
 }
 
+/*
+ * Map a packed write: the header block, then every request on
+ * packed_list in order.
+ */
+unsigned int mmc_queue_packed_map_sg(struct mmc_queue *mq)
+{
+	struct scatterlist *sg = mq->sg;
+	struct request *req;
+	unsigned int sg_len = 1;
+
+	sg_set_buf(sg, mq->packed_hdr, MMC_PACKED_HDR_SIZE);
+	list_for_each_entry(req, &mq->packed_list, queuelist) {
+		/* blk_rq_map_sg() marks its last entry as the end */
+		sg->page_link &= ~0x02;
+		sg_len += blk_rq_map_sg(mq->queue, req, mq->sg + sg_len);
+		sg = mq->sg + sg_len - 1;
+	}
+	sg_mark_end(sg);
+
+	return sg_len;
+}
+
 /*
  * If writing, bounce the data to the buffer before the request
  * is sent to the host driver
@@ -1,9 +1,35 @@
 #ifndef MMC_QUEUE_H
 #define MMC_QUEUE_H
 
+#include <linux/mmc/core.h>
+
 struct request;
 struct task_struct;
 
+/* Packed write commands (eMMC 4.5), see mmc_blk_prep_packed_list() */
+#define MMC_PACKED_HDR_SIZE	512	/* header block, in bytes */
+#define MMC_PACKED_MAX		63	/* entries that fit in the header */
+#define MMC_PACKED_THRESHOLD	2	/* default minimum requests to pack */
+
+/* Why collecting requests for a packed write stopped */
+enum mmc_packed_stop {
+	MMC_PACKED_STOP_EMPTY,		/* no more requests queued */
+	MMC_PACKED_STOP_READ,		/* next request is a read */
+	MMC_PACKED_STOP_SPECIAL,	/* next request is a flush or discard */
+	MMC_PACKED_STOP_REL_WR,		/* next request needs a reliable write */
+	MMC_PACKED_STOP_MAX_REQS,	/* card's limit on packed writes */
+	MMC_PACKED_STOP_SIZE,		/* host's limit on one transfer */
+	MMC_PACKED_STOP_SEGS,		/* host's limit on sg segments */
+	MMC_PACKED_STOP_NR,
+};
+
+struct mmc_packed_stats {
+	unsigned long		packed[MMC_PACKED_MAX + 1]; /* by request count */
+	unsigned long		stop[MMC_PACKED_STOP_NR];
+	unsigned long		below_threshold;
+	unsigned long		errors;
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -17,6 +43,24 @@ struct mmc_queue {
 	char			*bounce_buf;
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
+
+	/*
+	 * The next request, started and mapped into prep_sg while the
+	 * current one was on the bus, see mmc_blk_prep_next()
+	 */
+	struct request		*prep_req;
+	struct scatterlist	*prep_sg;
+	struct mmc_request	prep_mrq;
+	struct mmc_data		prep_data;
+
+	/* Packed writes, only if packed_hdr was allocated */
+	__le32			*packed_hdr;
+	struct list_head	packed_list;	/* started requests to pack */
+	unsigned int		packed_nr;	/* entries in packed_list */
+	unsigned int		packed_blocks;	/* header and data blocks */
+	unsigned int		packed_segs;	/* their sg segments */
+	unsigned int		packed_threshold;
+	struct mmc_packed_stats	packed_stats;
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -26,6 +70,7 @@ extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
 extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
+extern unsigned int mmc_queue_packed_map_sg(struct mmc_queue *);
 extern void mmc_queue_bounce_pre(struct mmc_queue *);
 extern void mmc_queue_bounce_post(struct mmc_queue *);
 extern int mmc_reinit_card(struct mmc_host *host);
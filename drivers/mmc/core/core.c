@@ -241,32 +241,87 @@ static void mmc_wait_done(struct mmc_request *mrq)
 }
 
 /**
- *	mmc_wait_for_req - start a request and wait for completion
+ *	mmc_start_req - start a request without waiting for it
  *	@host: MMC host to start command
  *	@mrq: MMC request to start
  *
- *	Start a new MMC custom command request for a host, and wait
- *	for the command to complete. Does not attempt to parse the
- *	response.
+ *	Start a new MMC request for a host. The caller may do other
+ *	work, such as preparing its next request with mmc_pre_req(),
+ *	and must then call mmc_wait_for_req_done().
  */
-void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq)
 {
-	DECLARE_COMPLETION_ONSTACK(complete);
-
-	mrq->done_data = &complete;
+	init_completion(&mrq->completion);
+	mrq->done_data = &mrq->completion;
 	mrq->done = mmc_wait_done;
 	if (mmc_card_removed(host->card)) {
 		mrq->cmd->error = -ENOMEDIUM;
+		complete(&mrq->completion);
 		return;
 	}
 
 	mmc_start_request(host, mrq);
+}
+EXPORT_SYMBOL(mmc_start_req);
 
-	wait_for_completion_io(&complete);
+/**
+ *	mmc_wait_for_req_done - wait for a request started by mmc_start_req
+ *	@host: MMC host the request was started on
+ *	@mrq: MMC request to wait for
+ */
+void mmc_wait_for_req_done(struct mmc_host *host, struct mmc_request *mrq)
+{
+	wait_for_completion_io(&mrq->completion);
+}
+EXPORT_SYMBOL(mmc_wait_for_req_done);
+
+/**
+ *	mmc_wait_for_req - start a request and wait for completion
+ *	@host: MMC host to start command
+ *	@mrq: MMC request to start
+ *
+ *	Start a new MMC custom command request for a host, and wait
+ *	for the command to complete. Does not attempt to parse the
+ *	response.
+ */
+void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	mmc_start_req(host, mrq);
+	mmc_wait_for_req_done(host, mrq);
 }
 
 EXPORT_SYMBOL(mmc_wait_for_req);
 
+/**
+ *	mmc_pre_req - prepare a request's data ahead of time
+ *	@host: MMC host to prepare command
+ *	@mrq: MMC request to prepare
+ *	@is_first_req: true if no other request is in flight
+ *
+ *	Lets the host driver do work such as DMA mapping for @mrq while
+ *	another request is on the bus. Must be balanced by mmc_post_req().
+ */
+void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+		 bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+EXPORT_SYMBOL(mmc_pre_req);
+
+/**
+ *	mmc_post_req - undo mmc_pre_req once a request is done
+ *	@host: MMC host the request was prepared on
+ *	@mrq: MMC request that was prepared
+ *	@err: error of the request, or 0
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+EXPORT_SYMBOL(mmc_post_req);
+
 /**
  *	mmc_wait_for_cmd - start a command and wait for completion
  *	@host: MMC host to start command
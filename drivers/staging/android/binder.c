@@ -19,6 +19,7 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -50,6 +51,29 @@ static uid_t binder_context_mgr_uid = -1;
 static int binder_last_id;
 static struct workqueue_struct *binder_deferred_workqueue;
 
+/*
+ * Pages freed by a buffer stay mapped, up to BINDER_PAGE_CACHE_MAX per
+ * proc, so that the next buffer over them needs no page table updates.
+ * binder_cached_pages counts them for the shrinker.
+ */
+#define BINDER_PAGE_CACHE_MAX		16
+static int binder_cached_pages;
+
+/*
+ * Transactions up to BINDER_SMALL_BUFFER_SIZE all get a buffer of that
+ * size, and up to BINDER_SMALL_BUFFER_MAX freed ones are kept aside per
+ * proc to be handed out again without touching the free tree.
+ */
+#define BINDER_SMALL_BUFFER_SIZE	256
+#define BINDER_SMALL_BUFFER_MAX		16
+
+/*
+ * Replies are counted per called node by how long after the transaction
+ * they came: bucket 0 under 1us, bucket i in [2^(i-1), 2^i) us, and the
+ * last bucket everything slower.
+ */
+#define BINDER_LATENCY_BUCKETS		20
+
 #define BINDER_DEBUG_ENTRY(name) \
 static int binder_##name##_open(struct inode *inode, struct file *file) \
 { \
@@ -147,7 +171,7 @@ enum binder_stat_types {
 
 struct binder_stats {
 	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	int bc[_IOC_NR(BC_REPLY_SG) + 1];
 	int obj_created[BINDER_STAT_COUNT];
 	int obj_deleted[BINDER_STAT_COUNT];
 };
@@ -198,6 +222,15 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	return e;
 }
 
+/*
+ * A scheduling policy and the priority within it: the rt_priority for
+ * SCHED_FIFO and SCHED_RR, the nice value otherwise.
+ */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 struct binder_work {
 	struct list_head entry;
 	enum {
@@ -232,6 +265,7 @@ struct binder_node {
 	unsigned accept_fds:1;
 	unsigned min_priority:8;
 	struct list_head async_todo;
+	u32 *latency_hist;
 };
 
 struct binder_ref_death {
@@ -270,6 +304,7 @@ struct binder_buffer {
 	struct binder_node *target_node;
 	size_t data_size;
 	size_t offsets_size;
+	size_t extra_buffers_size;
 	uint8_t data[0];
 };
 
@@ -300,6 +335,10 @@ struct binder_proc {
 	size_t free_async_space;
 
 	struct page **pages;
+	unsigned long *page_cached;
+	int cached_pages;
+	struct binder_buffer *small_buffers[BINDER_SMALL_BUFFER_MAX];
+	int small_buffer_count;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -310,7 +349,7 @@ struct binder_proc {
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	struct binder_priority default_priority;
 	struct dentry *debugfs_entry;
 };
 
@@ -352,11 +391,16 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	start_time;
+	void __user *target_ptr;
 };
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
@@ -518,6 +562,73 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static inline int binder_is_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+/* Maps a binder_priority onto one scale where lower is more urgent */
+static int binder_prio_level(const struct binder_priority *p)
+{
+	if (binder_is_rt_policy(p->sched_policy))
+		return MAX_USER_RT_PRIO - 1 - p->prio;
+	return MAX_RT_PRIO + 20 + p->prio;
+}
+
+static void binder_get_priority(struct task_struct *task,
+				struct binder_priority *p)
+{
+	if (binder_is_rt_policy(task->policy)) {
+		p->sched_policy = task->policy;
+		p->prio = task->rt_priority;
+	} else {
+		p->sched_policy = task->policy == SCHED_BATCH ?
+				  SCHED_BATCH : SCHED_NORMAL;
+		p->prio = task_nice(task);
+	}
+}
+
+/*
+ * binder_set_priority - switch current to the given policy and priority
+ *
+ * A real-time priority is capped by current's RLIMIT_RTPRIO, as a nice
+ * value is by its RLIMIT_NICE, unless it has CAP_SYS_NICE.
+ */
+static void binder_set_priority(const struct binder_priority *desired)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	unsigned int policy = desired->sched_policy;
+	int prio = desired->prio;
+
+	if (binder_is_rt_policy(policy) && !capable(CAP_SYS_NICE)) {
+		unsigned long max_rtprio = task_rlimit(current, RLIMIT_RTPRIO);
+
+		if (max_rtprio < prio) {
+			binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+				     "binder: %d: rt priority %d not allowed "
+				     "use %lu instead\n", current->pid, prio,
+				     max_rtprio);
+			prio = max_rtprio;
+		}
+		if (!prio) {
+			policy = SCHED_NORMAL;
+			prio = -20;
+		}
+	}
+
+	if (binder_is_rt_policy(policy)) {
+		param.sched_priority = prio;
+		if (current->policy != policy ||
+		    current->rt_priority != prio)
+			sched_setscheduler_nocheck(current, policy, &param);
+		return;
+	}
+
+	if (current->policy != policy)
+		sched_setscheduler_nocheck(current, policy, &param);
+	binder_set_nice(prio);
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -610,15 +721,130 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static void binder_unmap_page(struct binder_proc *proc, size_t index,
+			      struct vm_area_struct *vma)
+{
+	void *page_addr = proc->buffer + index * PAGE_SIZE;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(proc->pages[index]);
+	proc->pages[index] = NULL;
+}
+
+/* Unmaps up to nr_to_scan cached pages, returns how many it did */
+static int binder_shrink_page_cache(struct binder_proc *proc,
+				    struct vm_area_struct *vma, int nr_to_scan)
+{
+	size_t nr_pages = proc->buffer_size / PAGE_SIZE;
+	size_t index = 0;
+	int freed = 0;
+
+	while (proc->cached_pages && freed < nr_to_scan) {
+		index = find_next_bit(proc->page_cached, nr_pages, index);
+		BUG_ON(index >= nr_pages);
+		__clear_bit(index, proc->page_cached);
+		proc->cached_pages--;
+		binder_cached_pages--;
+		binder_unmap_page(proc, index, vma);
+		freed++;
+	}
+
+	return freed;
+}
+
+static void binder_free_page_range(struct binder_proc *proc,
+				   void *start, void *end,
+				   struct vm_area_struct *vma)
+{
+	void *page_addr;
+
+	for (page_addr = end - PAGE_SIZE; page_addr >= start;
+	     page_addr -= PAGE_SIZE) {
+		size_t index = (page_addr - proc->buffer) / PAGE_SIZE;
+
+		if (proc->cached_pages < BINDER_PAGE_CACHE_MAX) {
+			__set_bit(index, proc->page_cached);
+			proc->cached_pages++;
+			binder_cached_pages++;
+			continue;
+		}
+		binder_unmap_page(proc, index, vma);
+	}
+}
+
+/*
+ * Maps the n pages at page_addr, which are not mapped yet. The pages are
+ * allocated first so that the kernel mapping is set up in one go.
+ */
+static int binder_map_pages(struct binder_proc *proc, void *page_addr,
+			    size_t n, struct vm_area_struct *vma)
+{
+	struct vm_struct tmp_area;
+	struct page **page, **page_array_ptr;
+	unsigned long user_page_addr;
+	size_t i;
+	int ret;
+
+	page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+	for (i = 0; i < n; i++) {
+		page[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (page[i] == NULL) {
+			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       page_addr + i * PAGE_SIZE);
+			goto err_alloc_page_failed;
+		}
+	}
+
+	tmp_area.addr = page_addr;
+	tmp_area.size = (n + 1) * PAGE_SIZE /* guard page? */;
+	page_array_ptr = page;
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p in kernel\n",
+		       proc->pid, page_addr);
+		goto err_map_kernel_failed;
+	}
+
+	user_page_addr = (uintptr_t)page_addr + proc->user_buffer_offset;
+	for (i = 0; i < n; i++) {
+		ret = vm_insert_page(vma, user_page_addr + i * PAGE_SIZE,
+				     page[i]);
+		if (ret) {
+			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_page_addr + i * PAGE_SIZE);
+			goto err_vm_insert_page_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+	return 0;
+
+err_vm_insert_page_failed:
+	if (i)
+		zap_page_range(vma, user_page_addr, i * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, n * PAGE_SIZE);
+	i = n;
+err_map_kernel_failed:
+err_alloc_page_failed:
+	while (i--) {
+		__free_page(page[i]);
+		page[i] = NULL;
+	}
+	return -ENOMEM;
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
 	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
 	struct mm_struct *mm;
+	size_t index, n;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -637,8 +863,10 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
+	if (allocate == 0) {
+		binder_free_page_range(proc, start, end, vma);
+		goto out;
+	}
 
 	if (vma == NULL) {
 		printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed to "
@@ -646,60 +874,34 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		goto err_no_vma;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+	for (page_addr = start; page_addr < end; page_addr += n * PAGE_SIZE) {
+		index = (page_addr - proc->buffer) / PAGE_SIZE;
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			printk(KERN_ERR "[K] binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+		/* Still mapped from a buffer freed earlier */
+		if (proc->pages[index]) {
+			BUG_ON(!test_bit(index, proc->page_cached));
+			__clear_bit(index, proc->page_cached);
+			proc->cached_pages--;
+			binder_cached_pages--;
+			n = 1;
+			continue;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
+
+		for (n = 1; page_addr + n * PAGE_SIZE < end &&
+			    !proc->pages[index + n]; n++)
+			;
+		if (binder_map_pages(proc, page_addr, n, vma))
+			goto err_map_pages_failed;
 	}
+out:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
-		;
-	}
+err_map_pages_failed:
+	binder_free_page_range(proc, start, page_addr, vma);
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -708,14 +910,35 @@ err_no_vma:
 	return -ENOMEM;
 }
 
+static inline size_t binder_size_class(size_t size)
+{
+	return max_t(size_t, size, BINDER_SMALL_BUFFER_SIZE);
+}
+
+static void binder_merge_free_buf(struct binder_proc *proc,
+				  struct binder_buffer *buffer);
+
+/* Returns the small buffers kept aside to the free tree */
+static void binder_drain_small_buffers(struct binder_proc *proc)
+{
+	while (proc->small_buffer_count) {
+		struct binder_buffer *buffer;
+
+		buffer = proc->small_buffers[--proc->small_buffer_count];
+		binder_merge_free_buf(proc, buffer);
+	}
+}
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
-					      size_t offsets_size, int is_async)
+					      size_t offsets_size,
+					      size_t extra_buffers_size,
+					      int is_async)
 {
-	struct rb_node *n = proc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
+	struct rb_node *best_fit;
 	void *has_page_addr;
 	void *end_page_addr;
 	size_t size;
@@ -735,6 +958,15 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		return NULL;
 	}
 
+	size += ALIGN(extra_buffers_size, sizeof(void *));
+	if (size < extra_buffers_size) {
+		binder_user_error("binder: %d: got transaction with invalid "
+			"extra_buffers_size %zd\n", proc->pid,
+			extra_buffers_size);
+		return NULL;
+	}
+	size = binder_size_class(size);
+
 	if (is_async &&
 	    proc->free_async_space < size + sizeof(struct binder_buffer)) {
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -743,6 +975,15 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		return NULL;
 	}
 
+	if (size == BINDER_SMALL_BUFFER_SIZE && proc->small_buffer_count) {
+		buffer = proc->small_buffers[--proc->small_buffer_count];
+		binder_insert_allocated_buffer(proc, buffer);
+		goto found;
+	}
+
+retry:
+	n = proc->free_buffers.rb_node;
+	best_fit = NULL;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -758,6 +999,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 			break;
 		}
 	}
+	if (best_fit == NULL && proc->small_buffer_count) {
+		binder_drain_small_buffers(proc);
+		goto retry;
+	}
 	if (best_fit == NULL) {
 		printk(KERN_ERR "[K] binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
@@ -797,11 +1042,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		new_buffer->free = 1;
 		binder_insert_free_buffer(proc, new_buffer);
 	}
+found:
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got "
 		     "%p\n", proc->pid, size, buffer);
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
+	buffer->extra_buffers_size = extra_buffers_size;
 	buffer->async_transaction = is_async;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
@@ -871,6 +1118,40 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
+/*
+ * binder_merge_free_buf - returns an unused buffer's pages and merges it
+ * with its free neighbours into the free tree
+ */
+static void binder_merge_free_buf(struct binder_proc *proc,
+				  struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_buffer_size(proc, buffer);
+
+	binder_update_page_range(proc, 0,
+		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
+		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
+		NULL);
+	buffer->free = 1;
+	if (!list_is_last(&buffer->entry, &proc->buffers)) {
+		struct binder_buffer *next = list_entry(buffer->entry.next,
+						struct binder_buffer, entry);
+		if (next->free) {
+			rb_erase(&next->rb_node, &proc->free_buffers);
+			binder_delete_free_buffer(proc, next);
+		}
+	}
+	if (proc->buffers.next != &buffer->entry) {
+		struct binder_buffer *prev = list_entry(buffer->entry.prev,
+						struct binder_buffer, entry);
+		if (prev->free) {
+			binder_delete_free_buffer(proc, buffer);
+			rb_erase(&prev->rb_node, &proc->free_buffers);
+			buffer = prev;
+		}
+	}
+	binder_insert_free_buffer(proc, buffer);
+}
+
 static void binder_free_buf(struct binder_proc *proc,
 			    struct binder_buffer *buffer)
 {
@@ -878,8 +1159,9 @@ static void binder_free_buf(struct binder_proc *proc,
 
 	buffer_size = binder_buffer_size(proc, buffer);
 
-	size = ALIGN(buffer->data_size, sizeof(void *)) +
-		ALIGN(buffer->offsets_size, sizeof(void *));
+	size = binder_size_class(ALIGN(buffer->data_size, sizeof(void *)) +
+		ALIGN(buffer->offsets_size, sizeof(void *)) +
+		ALIGN(buffer->extra_buffers_size, sizeof(void *)));
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_free_buf %p size %zd buffer"
@@ -900,30 +1182,13 @@ static void binder_free_buf(struct binder_proc *proc,
 			     proc->free_async_space);
 	}
 
-	binder_update_page_range(proc, 0,
-		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
-		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
-		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
-	buffer->free = 1;
-	if (!list_is_last(&buffer->entry, &proc->buffers)) {
-		struct binder_buffer *next = list_entry(buffer->entry.next,
-						struct binder_buffer, entry);
-		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
-			binder_delete_free_buffer(proc, next);
-		}
-	}
-	if (proc->buffers.next != &buffer->entry) {
-		struct binder_buffer *prev = list_entry(buffer->entry.prev,
-						struct binder_buffer, entry);
-		if (prev->free) {
-			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
-			buffer = prev;
-		}
+	if (size == BINDER_SMALL_BUFFER_SIZE &&
+	    proc->small_buffer_count < BINDER_SMALL_BUFFER_MAX) {
+		proc->small_buffers[proc->small_buffer_count++] = buffer;
+		return;
 	}
-	binder_insert_free_buffer(proc, buffer);
+	binder_merge_free_buf(proc, buffer);
 }
 
 static struct binder_node *binder_get_node(struct binder_proc *proc,
@@ -1055,6 +1320,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 					     "binder: dead node %d deleted\n",
 					     node->debug_id);
 			}
+			kfree(node->latency_hist);
 			kfree(node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		}
@@ -1231,6 +1497,34 @@ static int binder_dec_ref(struct binder_ref *ref, int strong)
 	return 0;
 }
 
+/*
+ * binder_record_latency - account the reply to 't' to the node it called,
+ * if that still exists in 'proc', the replying process
+ */
+static void binder_record_latency(struct binder_proc *proc,
+				  struct binder_transaction *t)
+{
+	struct binder_node *node = binder_get_node(proc, t->target_ptr);
+	s64 latency_us = ktime_us_delta(ktime_get(), t->start_time);
+	int bucket;
+
+	trace_binder_transaction_latency(t, node, latency_us);
+
+	if (node == NULL)
+		return;
+	if (node->latency_hist == NULL) {
+		node->latency_hist = kzalloc(BINDER_LATENCY_BUCKETS *
+					     sizeof(u32), GFP_KERNEL);
+		if (node->latency_hist == NULL)
+			return;
+	}
+
+	bucket = latency_us > 0 ? fls64(latency_us) : 0;
+	if (bucket >= BINDER_LATENCY_BUCKETS)
+		bucket = BINDER_LATENCY_BUCKETS - 1;
+	node->latency_hist[bucket]++;
+}
+
 static void binder_pop_transaction(struct binder_thread *target_thread,
 				   struct binder_transaction *t)
 {
@@ -1303,6 +1597,33 @@ static void binder_send_failed_reply(struct binder_transaction *t,
 	}
 }
 
+/*
+ * binder_validate_object - returns the size of the object at 'offset' in
+ * the buffer's data, or 0 if there is no room for it there.
+ */
+static size_t binder_validate_object(struct binder_buffer *buffer,
+				     size_t offset)
+{
+	struct flat_binder_object *fp;
+	size_t size;
+
+	if (buffer->data_size < sizeof(fp->type) ||
+	    offset > buffer->data_size - sizeof(fp->type) ||
+	    !IS_ALIGNED(offset, sizeof(void *)))
+		return 0;
+
+	fp = (struct flat_binder_object *)(buffer->data + offset);
+	if (fp->type == BINDER_TYPE_PTR)
+		size = sizeof(struct binder_buffer_object);
+	else
+		size = sizeof(struct flat_binder_object);
+
+	if (buffer->data_size < size || offset > buffer->data_size - size)
+		return 0;
+
+	return size;
+}
+
 static void binder_transaction_buffer_release(struct binder_proc *proc,
 					      struct binder_buffer *buffer,
 					      size_t *failed_at)
@@ -1325,9 +1646,7 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 		off_end = (void *)offp + buffer->offsets_size;
 	for (; offp < off_end; offp++) {
 		struct flat_binder_object *fp;
-		if (*offp > buffer->data_size - sizeof(*fp) ||
-		    buffer->data_size < sizeof(*fp) ||
-		    !IS_ALIGNED(*offp, sizeof(void *))) {
+		if (!binder_validate_object(buffer, *offp)) {
 			printk(KERN_ERR "[K] binder: transaction release %d bad"
 					"offset %zd, size %zd\n", debug_id,
 					*offp, buffer->data_size);
@@ -1370,6 +1689,10 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 				task_close_fd(proc, fp->handle);
 			break;
 
+		case BINDER_TYPE_PTR:
+			/* The copy lives in the buffer and goes with it */
+			break;
+
 		default:
 			printk(KERN_ERR "[K] binder: transaction release %d bad "
 			       "object type %lx\n", debug_id, fp->type);
@@ -1380,11 +1703,13 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
-			       struct binder_transaction_data *tr, int reply)
+			       struct binder_transaction_data *tr, int reply,
+			       size_t extra_buffers_size)
 {
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
 	size_t *offp, *off_end;
+	uint8_t *sg_bufp, *sg_buf_end;
 	struct binder_proc *target_proc;
 	struct binder_thread *target_thread = NULL;
 	struct binder_node *target_node = NULL;
@@ -1411,7 +1736,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(&in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1545,9 +1870,15 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	binder_get_priority(current, &t->priority);
+	if (!reply) {
+		t->start_time = ktime_get();
+		t->target_ptr = target_node->ptr;
+	}
+	trace_binder_transaction(reply, t, target_node);
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
-		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
+		tr->offsets_size, extra_buffers_size,
+		!reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
@@ -1581,11 +1912,11 @@ static void binder_transaction(struct binder_proc *proc,
 		goto err_bad_offset;
 	}
 	off_end = (void *)offp + tr->offsets_size;
+	sg_bufp = (uint8_t *)offp + ALIGN(tr->offsets_size, sizeof(void *));
+	sg_buf_end = sg_bufp + extra_buffers_size;
 	for (; offp < off_end; offp++) {
 		struct flat_binder_object *fp;
-		if (*offp > t->buffer->data_size - sizeof(*fp) ||
-		    t->buffer->data_size < sizeof(*fp) ||
-		    !IS_ALIGNED(*offp, sizeof(void *))) {
+		if (!binder_validate_object(t->buffer, *offp)) {
 			binder_user_error("binder: %d:%d got transaction with "
 				"invalid offset, %zd\n",
 				proc->pid, thread->pid, *offp);
@@ -1710,6 +2041,31 @@ static void binder_transaction(struct binder_proc *proc,
 			fp->handle = target_fd;
 		} break;
 
+		case BINDER_TYPE_PTR: {
+			struct binder_buffer_object *bp = (void *)fp;
+			size_t len = ALIGN(bp->length, sizeof(void *));
+
+			if (bp->flags || len < bp->length ||
+			    len > sg_buf_end - sg_bufp) {
+				binder_user_error("binder: %d:%d got transaction with too large buffer, %zd\n",
+					proc->pid, thread->pid, bp->length);
+				return_error = BR_FAILED_REPLY;
+				goto err_bad_offset;
+			}
+			/* Straight from the sender into the target's mapping */
+			if (copy_from_user(sg_bufp, bp->buffer, bp->length)) {
+				binder_user_error("binder: %d:%d got transaction with invalid buffer ptr\n",
+					proc->pid, thread->pid);
+				return_error = BR_FAILED_REPLY;
+				goto err_copy_data_failed;
+			}
+			binder_debug(BINDER_DEBUG_TRANSACTION,
+				     "        buffer %p size %zd\n",
+				     bp->buffer, bp->length);
+			bp->buffer = sg_bufp + target_proc->user_buffer_offset;
+			sg_bufp += len;
+		} break;
+
 		default:
 			binder_user_error("binder: %d:%d got transactio"
 				"n with invalid object type, %lx\n",
@@ -1720,6 +2076,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_record_latency(proc, in_reply_to);
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -1954,6 +2311,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				     "binder: %d:%d BC_FREE_BUFFER u%p found buffer %d for %s transaction\n",
 				     proc->pid, thread->pid, data_ptr, buffer->debug_id,
 				     buffer->transaction ? "active" : "finished");
+			trace_binder_transaction_buffer_release(buffer);
 
 			if (buffer->transaction) {
 				buffer->transaction->buffer = NULL;
@@ -1978,7 +2336,19 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (copy_from_user(&tr, ptr, sizeof(tr)))
 				return -EFAULT;
 			ptr += sizeof(tr);
-			binder_transaction(proc, thread, &tr, cmd == BC_REPLY);
+			binder_transaction(proc, thread, &tr, cmd == BC_REPLY, 0);
+			break;
+		}
+
+		case BC_TRANSACTION_SG:
+		case BC_REPLY_SG: {
+			struct binder_transaction_data_sg tr;
+
+			if (copy_from_user(&tr, ptr, sizeof(tr)))
+				return -EFAULT;
+			ptr += sizeof(tr);
+			binder_transaction(proc, thread, &tr.transaction_data,
+					   cmd == BC_REPLY_SG, tr.buffers_size);
 			break;
 		}
 
@@ -2246,7 +2616,7 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		binder_set_priority(&proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
@@ -2355,6 +2725,7 @@ retry:
 						     proc->pid, thread->pid, node->debug_id,
 						     node->ptr, node->cookie);
 					rb_erase(&node->rb_node, &proc->nodes);
+					kfree(node->latency_hist);
 					kfree(node);
 					binder_stats_deleted(BINDER_STAT_NODE);
 				} else {
@@ -2407,15 +2778,24 @@ retry:
 		BUG_ON(t->buffer == NULL);
 		if (t->buffer->target_node) {
 			struct binder_node *target_node = t->buffer->target_node;
+			struct binder_priority node_prio;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
+			node_prio.sched_policy = SCHED_NORMAL;
+			node_prio.prio = target_node->min_priority;
+			binder_get_priority(current, &t->saved_priority);
+			/*
+			 * A synchronous caller lends its policy and priority,
+			 * real-time included, until this thread replies.
+			 */
+			if (binder_prio_level(&t->priority) <
+			    binder_prio_level(&node_prio) &&
 			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
+				binder_set_priority(&t->priority);
 			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+				 binder_prio_level(&t->saved_priority) >
+				 binder_prio_level(&node_prio))
+				binder_set_priority(&node_prio);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2449,6 +2829,8 @@ retry:
 			return -EFAULT;
 		ptr += sizeof(tr);
 
+		trace_binder_transaction_received(t);
+
 		binder_stat_br(proc, thread, cmd);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "binder: %d:%d %s %d %d:%d, cmd %d"
@@ -2835,6 +3217,12 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->page_cached = kzalloc(BITS_TO_LONGS((vma->vm_end - vma->vm_start) / PAGE_SIZE) * sizeof(long), GFP_KERNEL);
+	if (proc->page_cached == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc page bitmap";
+		goto err_alloc_page_bitmap_failed;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -2860,6 +3248,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->page_cached);
+	proc->page_cached = NULL;
+err_alloc_page_bitmap_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -2887,7 +3278,7 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
+	binder_get_priority(current, &proc->default_priority);
 	mutex_lock(&binder_lock);
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
@@ -2977,6 +3368,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		rb_erase(&node->rb_node, &proc->nodes);
 		list_del_init(&node->work.entry);
 		if (hlist_empty(&node->refs)) {
+			kfree(node->latency_hist);
 			kfree(node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		} else {
@@ -3035,6 +3427,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_stats_deleted(BINDER_STAT_PROC);
 
 	page_count = 0;
+	binder_cached_pages -= proc->cached_pages;
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
@@ -3052,6 +3445,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 			}
 		}
 		kfree(proc->pages);
+		kfree(proc->page_cached);
 		vfree(proc->buffer);
 	}
 
@@ -3125,13 +3519,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %d:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3333,7 +3728,9 @@ static const char *binder_command_strings[] = {
 	"BC_EXIT_LOOPER",
 	"BC_REQUEST_DEATH_NOTIFICATION",
 	"BC_CLEAR_DEATH_NOTIFICATION",
-	"BC_DEAD_BINDER_DONE"
+	"BC_DEAD_BINDER_DONE",
+	"BC_TRANSACTION_SG",
+	"BC_REPLY_SG"
 };
 
 static const char *binder_objstat_strings[] = {
@@ -3495,6 +3892,48 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void print_binder_proc_latency(struct seq_file *m,
+				      struct binder_proc *proc)
+{
+	struct rb_node *n;
+	int i, header = 0;
+
+	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
+		struct binder_node *node = rb_entry(n, struct binder_node,
+						    rb_node);
+
+		if (node->latency_hist == NULL)
+			continue;
+		if (!header) {
+			seq_printf(m, "proc %d\n", proc->pid);
+			header = 1;
+		}
+		seq_printf(m, "  node %d: u%p c%p", node->debug_id,
+			   node->ptr, node->cookie);
+		for (i = 0; i < BINDER_LATENCY_BUCKETS; i++)
+			seq_printf(m, " %u", node->latency_hist[i]);
+		seq_puts(m, "\n");
+	}
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+
+	if (do_lock)
+		mutex_lock(&binder_lock);
+
+	seq_printf(m, "binder reply latency, %d log2(us) buckets:\n",
+		   BINDER_LATENCY_BUCKETS);
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
+		print_binder_proc_latency(m, proc);
+	if (do_lock)
+		mutex_unlock(&binder_lock);
+	return 0;
+}
+
 static int binder_proc_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc = m->private;
@@ -3554,6 +3993,54 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(latency);
+
+/*
+ * binder_shrink - unmaps pages kept in the per-proc page caches
+ *
+ * Procs whose locks cannot be taken right away are skipped.
+ */
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int nr_to_scan = sc->nr_to_scan;
+
+	if (!nr_to_scan)
+		return binder_cached_pages;
+
+	if (!mutex_trylock(&binder_lock))
+		return -1;
+
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		struct mm_struct *mm;
+
+		if (!proc->cached_pages)
+			continue;
+
+		mm = get_task_mm(proc->tsk);
+		if (mm && !down_write_trylock(&mm->mmap_sem)) {
+			mmput(mm);
+			continue;
+		}
+		nr_to_scan -= binder_shrink_page_cache(proc,
+					mm ? proc->vma : NULL, nr_to_scan);
+		if (mm) {
+			up_write(&mm->mmap_sem);
+			mmput(mm);
+		}
+		if (nr_to_scan <= 0)
+			break;
+	}
+	mutex_unlock(&binder_lock);
+
+	return binder_cached_pages;
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
 
 static int __init binder_init(void)
 {
@@ -3568,6 +4055,13 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	if (ret) {
+		debugfs_remove_recursive(binder_debugfs_dir_entry_root);
+		destroy_workqueue(binder_deferred_workqueue);
+		return ret;
+	}
+	/* only once there is a device whose procs fill the page caches */
+	register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -3594,6 +4088,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("latency",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 	}
 	return ret;
 }
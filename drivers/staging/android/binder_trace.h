@@ -0,0 +1,160 @@
+/* binder_trace.h
+ *
+ * Tracepoints for the Android IPC Subsystem
+ *
+ * binder_transaction, binder_transaction_received and
+ * binder_transaction_buffer_release use the same names, fields and output
+ * as the binder tracepoints Arve Hjønnevåg added to mainline's
+ * drivers/staging/android/binder_trace.h (Copyright (C) 2012 Google, Inc.),
+ * so tools written for those parse them unchanged.
+ * binder_transaction_latency only exists in this tree.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE binder_trace
+
+#include <linux/tracepoint.h>
+
+struct binder_buffer;
+struct binder_node;
+struct binder_proc;
+struct binder_thread;
+struct binder_transaction;
+
+/*
+ * Tracepoint for a transaction or reply being sent
+ */
+TRACE_EVENT(binder_transaction,
+
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node),
+
+	TP_ARGS(reply, t, target_node),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+	),
+
+	TP_printk(
+		"transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		"reply=%d flags=0x%x code=0x%x",
+		__entry->debug_id, __entry->target_node,
+		__entry->to_proc, __entry->to_thread,
+		__entry->reply, __entry->flags, __entry->code
+	)
+);
+
+/*
+ * Tracepoint for a transaction or reply being handed to a reading thread
+ */
+TRACE_EVENT(binder_transaction_received,
+
+	TP_PROTO(struct binder_transaction *t),
+
+	TP_ARGS(t),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+	),
+
+	TP_printk("transaction=%d", __entry->debug_id)
+);
+
+/*
+ * Tracepoint for a reply, with the time since the transaction was sent
+ */
+TRACE_EVENT(binder_transaction_latency,
+
+	TP_PROTO(struct binder_transaction *t, struct binder_node *node,
+		 s64 latency_us),
+
+	TP_ARGS(t, node, latency_us),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, node)
+		__field(int, proc)
+		__field(unsigned int, code)
+		__field(s64, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->node = node ? node->debug_id : 0;
+		__entry->proc = t->to_proc->pid;
+		__entry->code = t->code;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("transaction=%d node=%d proc=%d code=0x%x latency=%lldus",
+		__entry->debug_id, __entry->node, __entry->proc,
+		__entry->code, __entry->latency_us)
+);
+
+/*
+ * Tracepoint for a buffer being freed with BC_FREE_BUFFER
+ */
+TRACE_EVENT(binder_transaction_buffer_release,
+
+	TP_PROTO(struct binder_buffer *buf),
+
+	TP_ARGS(buf),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(size_t, data_size)
+		__field(size_t, offsets_size)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = buf->debug_id;
+		__entry->data_size = buf->data_size;
+		__entry->offsets_size = buf->offsets_size;
+	),
+
+	TP_printk("transaction=%d data_size=%zd offsets_size=%zd",
+		__entry->debug_id, __entry->data_size,
+		__entry->offsets_size)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
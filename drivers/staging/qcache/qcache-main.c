@@ -127,6 +127,7 @@ struct zbud_page {
 #define MAX_CHUNK	(NCHUNKS-1)
 
 static struct {
+	spinlock_t lock;
 	struct list_head list;
 	unsigned count;
 } zbud_unbuddied[NCHUNKS];
@@ -137,8 +138,14 @@ static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
 struct list_head zbud_buddied_list;
 static unsigned long zcache_zbud_buddied_count;
 
-/* protects the buddied list and all unbuddied lists */
-static DEFINE_SPINLOCK(zbud_budlists_spinlock);
+/*
+ * Each unbuddied list is protected by its own lock and the buddied list
+ * by zbud_buddied_lock, so that puts of different sizes do not contend.
+ * A zbpg's lock nests outside these, and no two list locks are ever
+ * held at once: a zbpg moving between lists is kept off both by its
+ * own lock in the meantime.
+ */
+static DEFINE_SPINLOCK(zbud_buddied_lock);
 
 static atomic_t zcache_zbud_curr_raw_pages;
 static atomic_t zcache_zbud_curr_zpages;
@@ -316,20 +323,22 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 	zh_other = &zbpg->buddy[(budnum == 0) ? 1 : 0];
 	if (zh_other->size == 0) { /* was unbuddied: unlist and free */
 		chunks = zbud_size_to_chunks(size) ;
-		spin_lock(&zbud_budlists_spinlock);
+		spin_lock(&zbud_unbuddied[chunks].lock);
 		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
 		list_del_init(&zbpg->bud_list);
 		zbud_unbuddied[chunks].count--;
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[chunks].lock);
 		zbud_free_raw_page(zbpg);
 	} else { /* was buddied: move remaining buddy to unbuddied list */
 		chunks = zbud_size_to_chunks(zh_other->size) ;
-		spin_lock(&zbud_budlists_spinlock);
+		spin_lock(&zbud_buddied_lock);
 		list_del_init(&zbpg->bud_list);
 		zcache_zbud_buddied_count--;
+		spin_unlock(&zbud_buddied_lock);
+		spin_lock(&zbud_unbuddied[chunks].lock);
 		list_add_tail(&zbpg->bud_list, &zbud_unbuddied[chunks].list);
 		zbud_unbuddied[chunks].count++;
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[chunks].lock);
 		spin_unlock(&zbpg->lock);
 	}
 }
@@ -347,17 +356,21 @@ static struct zbud_hdr *zbud_create(uint16_t client_id, uint16_t pool_id,
 
 	nchunks = zbud_size_to_chunks(size) ;
 	for (i = MAX_CHUNK - nchunks + 1; i > 0; i--) {
-		spin_lock(&zbud_budlists_spinlock);
-		if (!list_empty(&zbud_unbuddied[i].list)) {
-			list_for_each_entry_safe(zbpg, ztmp,
-				    &zbud_unbuddied[i].list, bud_list) {
-				if (spin_trylock(&zbpg->lock)) {
-					found_good_buddy = i;
-					goto found_unbuddied;
-				}
+		/*
+		 * Most lists are empty at any time. Peeking without the
+		 * lock can only cost a missed or a wasted lookup.
+		 */
+		if (list_empty(&zbud_unbuddied[i].list))
+			continue;
+		spin_lock(&zbud_unbuddied[i].lock);
+		list_for_each_entry_safe(zbpg, ztmp,
+			    &zbud_unbuddied[i].list, bud_list) {
+			if (spin_trylock(&zbpg->lock)) {
+				found_good_buddy = i;
+				goto found_unbuddied;
 			}
 		}
-		spin_unlock(&zbud_budlists_spinlock);
+		spin_unlock(&zbud_unbuddied[i].lock);
 	}
 	/* didn't find a good buddy, try allocating a new page */
 	zbpg = zbud_alloc_raw_page();
@@ -365,9 +378,10 @@ static struct zbud_hdr *zbud_create(uint16_t client_id, uint16_t pool_id,
 		goto out;
 	/* ok, have a page, now compress the data before taking locks */
 	spin_lock(&zbpg->lock);
-	spin_lock(&zbud_budlists_spinlock);
+	spin_lock(&zbud_unbuddied[nchunks].lock);
 	list_add_tail(&zbpg->bud_list, &zbud_unbuddied[nchunks].list);
 	zbud_unbuddied[nchunks].count++;
+	spin_unlock(&zbud_unbuddied[nchunks].lock);
 	zh = &zbpg->buddy[0];
 	goto init_zh;
 
@@ -385,8 +399,11 @@ found_unbuddied:
 		BUG();
 	list_del_init(&zbpg->bud_list);
 	zbud_unbuddied[found_good_buddy].count--;
+	spin_unlock(&zbud_unbuddied[found_good_buddy].lock);
+	spin_lock(&zbud_buddied_lock);
 	list_add_tail(&zbpg->bud_list, &zbud_buddied_list);
 	zcache_zbud_buddied_count++;
+	spin_unlock(&zbud_buddied_lock);
 
 init_zh:
 	SET_SENTINEL(zh, ZBH);
@@ -395,8 +412,6 @@ init_zh:
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
 	zh->client_id = client_id;
-	/* can wait to copy the data until the list locks are dropped */
-	spin_unlock(&zbud_budlists_spinlock);
 
 	to = zbud_data(zh, size);
 	memcpy(to, cdata, size);
@@ -450,6 +465,7 @@ static void zbud_init(void)
 	INIT_LIST_HEAD(&zbud_buddied_list);
 	zcache_zbud_buddied_count = 0;
 	for (i = 0; i < NCHUNKS; i++) {
+		spin_lock_init(&zbud_unbuddied[i].lock);
 		INIT_LIST_HEAD(&zbud_unbuddied[i].list);
 		zbud_unbuddied[i].count = 0;
 	}
@@ -0,0 +1,152 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/*
+ * Identical pages compress to identical data, so compressed objects
+ * are looked up by a checksum of their contents. Table slots holding
+ * the same data all point to one zram_dedup_entry, which owns the
+ * zsmalloc object and frees it with its last reference.
+ *
+ * dedup_lock protects the hash table, every entry's refcount and the
+ * pages_dup stat. It nests inside table_lock.
+ */
+
+static struct hlist_head *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->dedup_hash[checksum & ((1 << zram->dedup_bits) - 1)];
+}
+
+u32 zram_dedup_checksum(const void *mem, size_t len)
+{
+	return jhash(mem, len, 0);
+}
+
+/*
+ * Returns the entry holding an object identical to @mem, with a new
+ * reference taken on it, or NULL if there is none.
+ */
+struct zram_dedup_entry *zram_dedup_get(struct zram *zram, const void *mem,
+				size_t len, u32 checksum)
+{
+	int match;
+	unsigned char *cmem;
+	struct hlist_node *pos;
+	struct zram_dedup_entry *entry;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(entry, pos, zram_dedup_bucket(zram, checksum),
+				node) {
+		if (entry->checksum != checksum || entry->size != len)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(cmem, mem, len);
+		zs_unmap_object(zram->mem_pool, entry->handle);
+
+		if (match) {
+			entry->refcount++;
+			zram_stat_inc(&zram->stats.pages_dup);
+			spin_unlock(&zram->dedup_lock);
+			return entry;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return NULL;
+}
+
+/*
+ * Makes @handle, already holding @len bytes of compressed data, known
+ * to later lookups. Returns NULL if no entry could be allocated, in
+ * which case the object is simply not shared.
+ */
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+				unsigned long handle, size_t len, u32 checksum)
+{
+	struct zram_dedup_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOWAIT | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->checksum = checksum;
+	entry->size = len;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&entry->node, zram_dedup_bucket(zram, checksum));
+	spin_unlock(&zram->dedup_lock);
+
+	zram_stat64_add(zram, &zram->stats.compr_size, len);
+	zram_stat64_add(zram, &zram->stats.dedup_mem, ksize(entry));
+	return entry;
+}
+
+/* Drops a slot's reference, freeing the object with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	spin_lock(&zram->dedup_lock);
+	if (--entry->refcount) {
+		zram_stat_dec(&zram->stats.pages_dup);
+		spin_unlock(&zram->dedup_lock);
+		return;
+	}
+	hlist_del(&entry->node);
+	spin_unlock(&zram->dedup_lock);
+
+	zram_stat64_sub(zram, &zram->stats.compr_size, entry->size);
+	zram_stat64_sub(zram, &zram->stats.dedup_mem, ksize(entry));
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	if (!zram->dedup_enable)
+		return 0;
+
+	/* About one bucket for every 16 pages */
+	zram->dedup_bits = clamp(ilog2(max_t(size_t, num_pages >> 4, 1)),
+				8, 16);
+	zram->dedup_hash = vzalloc(sizeof(*zram->dedup_hash) <<
+				zram->dedup_bits);
+	if (!zram->dedup_hash) {
+		pr_err("Error allocating dedup hash table\n");
+		return -ENOMEM;
+	}
+	zram_stat64_add(zram, &zram->stats.dedup_mem,
+			sizeof(*zram->dedup_hash) << zram->dedup_bits);
+
+	return 0;
+}
+
+/* All entries must have been put before this is called */
+void zram_dedup_destroy(struct zram *zram)
+{
+	vfree(zram->dedup_hash);
+	zram->dedup_hash = NULL;
+}
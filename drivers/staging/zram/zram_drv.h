@@ -17,8 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/crypto.h>
 
-#include "xvmalloc.h"
+#include "../zsmalloc/zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,33 +27,26 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Default compression algorithm (see comp_algorithm in sysfs) */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
- * uncompressed in memory.
+ * uncompressed in memory. zsmalloc packs objects across page
+ * boundaries, so anything that saves at least 1/8 of a page is
+ * worth keeping compressed.
  */
-static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
+static const unsigned max_zpage_size = PAGE_SIZE / 8 * 7;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -63,24 +57,43 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_LOGICAL_BLOCK_SIZE	4096
 
+/* Worst case compressor output for a page is larger than PAGE_SIZE */
+#define ZRAM_COMP_BUF_SIZE	(2 * PAGE_SIZE)
+
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word, which is kept
+	 * in the handle. Zero filled pages are the common case.
+	 */
+	ZRAM_SAME,
+
+	/* handle is a zram_dedup_entry shared with identical pages */
+	ZRAM_DEDUP,
+
+	/* handle is a block on the backing device */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
-/* Allocated for each disk page */
+/*
+ * Allocated for each disk page. handle is a zsmalloc handle, or as
+ * described by the ZRAM_UNCOMPRESSED, ZRAM_SAME, ZRAM_DEDUP and ZRAM_WB
+ * flags.
+ */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
+	unsigned long handle;
+	u16 size;	/* object size (excluding header) */
+	u8 age;		/* idle periods since last access */
 	u8 flags;
 } __attribute__((aligned(4)));
 
@@ -92,25 +105,65 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 same_hits;		/* writes of same filled pages */
+	u64 dedup_hits;		/* writes matching a stored object */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same filled pages, incl. zero */
+	u32 pages_dup;		/* no. of pages sharing another's object */
+	u32 pages_wb;		/* no. of pages on the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 dedup_mem;		/* dedup entries and hash table, in bytes */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
 };
 
+/*
+ * Per-CPU compression state, so that writes compress in parallel.
+ * A transform carries its algorithm's working memory, so reads
+ * decompress through it as well.
+ */
+struct zram_comp_strm {
+	struct crypto_comp *tfm;
+	void *buffer;
+};
+
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;	/* zsmalloc handle of the shared object */
+	u32 checksum;
+	u16 size;
+	unsigned int refcount;
+};
+
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zram_comp_strm __percpu *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and page stats */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
+	/* Crypto API name of the compressor, fixed once initialized */
+	char compressor[CRYPTO_MAX_ALG_NAME];
+	/* Share identical compressed pages, fixed once initialized */
+	int dedup_enable;
+	struct hlist_head *dedup_hash;
+	unsigned int dedup_bits;
+	spinlock_t dedup_lock;	/* protect dedup_hash and refcounts */
+	/* Optional backing device, fixed once initialized */
+	struct block_device *bdev;
+	unsigned long *bd_bitmap;	/* blocks in use */
+	unsigned long bd_nr_blocks;
+	u16 *bd_pins;		/* reads in flight per block, ZRAM_BD_FREED */
+	spinlock_t bd_lock;	/* protect bd_pins */
+	/* Pages idle for this many periods are written back */
+	unsigned int idle_age;
+	unsigned int wb_rate;	/* KB/s, 0 if unlimited */
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
 	 * we can store in a disk.
@@ -128,5 +181,107 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern int zram_read_slot(struct zram *zram, struct page *page, u32 index);
+extern void zram_free_page(struct zram *zram, size_t index);
+
+extern u32 zram_dedup_checksum(const void *mem, size_t len);
+extern struct zram_dedup_entry *zram_dedup_get(struct zram *zram,
+			const void *mem, size_t len, u32 checksum);
+extern struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+			unsigned long handle, size_t len, u32 checksum);
+extern void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry);
+extern int zram_dedup_init(struct zram *zram, size_t num_pages);
+extern void zram_dedup_destroy(struct zram *zram);
+
+/*
+ * Reads of pages on the backing device share one of these per bio. It
+ * holds a pin on every block read, released when the bio completes.
+ */
+struct zram_bd_read {
+	struct zram *zram;
+	struct bio *parent;
+	atomic_t pending;
+	int error;
+	unsigned int nr_blocks;
+	unsigned long blocks[0];
+};
+
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,		/* pages stored uncompressed */
+	ZRAM_WB_IDLE,		/* pages idle for idle_age periods, or huge */
+};
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_bd_attach(struct zram *zram, const char *path);
+extern void zram_bd_detach(struct zram *zram);
+extern void zram_bd_free_block(struct zram *zram, unsigned long block);
+extern void zram_bd_pin(struct zram *zram, unsigned long block);
+extern int zram_bd_read(struct zram *zram, struct page *page,
+			unsigned long block, struct bio *parent,
+			struct zram_bd_read **rdp);
+extern void zram_bd_read_done(struct zram_bd_read *rd, int err);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#else
+static inline void zram_bd_detach(struct zram *zram) {}
+static inline void zram_bd_free_block(struct zram *zram,
+			unsigned long block) {}
+static inline void zram_bd_pin(struct zram *zram, unsigned long block) {}
+static inline int zram_bd_read(struct zram *zram, struct page *page,
+			unsigned long block, struct bio *parent,
+			struct zram_bd_read **rdp)
+{
+	return -EIO;
+}
+static inline void zram_bd_read_done(struct zram_bd_read *rd, int err) {}
+#endif
+
+static inline int zram_test_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	return zram->table[index].flags & BIT(flag);
+}
+
+static inline void zram_set_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	zram->table[index].flags |= BIT(flag);
+}
+
+static inline void zram_clear_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	zram->table[index].flags &= ~BIT(flag);
+}
+
+
+static inline void zram_stat_inc(u32 *v)
+{
+	*v = *v + 1;
+}
+
+static inline void zram_stat_dec(u32 *v)
+{
+	*v = *v - 1;
+}
+
+static inline void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
+{
+	spin_lock(&zram->stat64_lock);
+	*v = *v + inc;
+	spin_unlock(&zram->stat64_lock);
+}
+
+static inline void zram_stat64_sub(struct zram *zram, u64 *v, u64 dec)
+{
+	spin_lock(&zram->stat64_lock);
+	*v = *v - dec;
+	spin_unlock(&zram->stat64_lock);
+}
+
+static inline void zram_stat64_inc(struct zram *zram, u64 *v)
+{
+	zram_stat64_add(zram, v, 1);
+}
 
 #endif
@@ -0,0 +1,457 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/bio.h>
+#include <linux/bitops.h>
+#include <linux/blkdev.h>
+#include <linux/completion.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/*
+ * Pages that compress badly, or that nobody has touched for a while,
+ * can be moved out to a backing block device. Their table slot then
+ * holds the block number, and reads go to the backing device.
+ *
+ * Writeback runs from sysfs under init_lock, so there is only ever one
+ * writer of the block bitmap; slots are freed with clear_bit().
+ *
+ * A read from the backing device is issued after table_lock is dropped,
+ * by which time the slot may have been freed and its block handed to
+ * another page by writeback. Readers therefore pin the block under
+ * table_lock. Freeing a pinned block only marks it ZRAM_BD_FREED, and
+ * the last reader releases it.
+ */
+
+#define ZRAM_BD_FREED	0x8000
+
+/* Pages gathered before the writes are issued */
+#define ZRAM_WB_BATCH	32
+
+#define ZRAM_BD_MODE	(FMODE_READ | FMODE_WRITE | FMODE_EXCL)
+
+int zram_bd_attach(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_blocks, *bitmap;
+	struct block_device *bdev;
+	u16 *pins;
+
+	bdev = blkdev_get_by_path(path, ZRAM_BD_MODE, zram);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_blocks < 2) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	pins = vzalloc(nr_blocks * sizeof(*pins));
+	if (!bitmap || !pins) {
+		vfree(bitmap);
+		vfree(pins);
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	/* Block 0 is never used, so that a slot's handle is never 0 */
+	set_bit(0, bitmap);
+
+	zram_bd_detach(zram);
+	zram->bdev = bdev;
+	zram->bd_bitmap = bitmap;
+	zram->bd_pins = pins;
+	zram->bd_nr_blocks = nr_blocks;
+
+	return 0;
+
+fail:
+	blkdev_put(bdev, ZRAM_BD_MODE);
+	return ret;
+}
+
+void zram_bd_detach(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, ZRAM_BD_MODE);
+	vfree(zram->bd_bitmap);
+	vfree(zram->bd_pins);
+
+	zram->bdev = NULL;
+	zram->bd_bitmap = NULL;
+	zram->bd_pins = NULL;
+	zram->bd_nr_blocks = 0;
+}
+
+/* Returns a free block at or after @hint if possible, 0 if full */
+static unsigned long zram_bd_alloc_block(struct zram *zram,
+					unsigned long hint)
+{
+	unsigned long block = hint;
+
+	for (;;) {
+		block = find_next_zero_bit(zram->bd_bitmap,
+					zram->bd_nr_blocks, block);
+		if (block >= zram->bd_nr_blocks) {
+			if (hint <= 1)
+				return 0;
+			block = hint = 1;
+			continue;
+		}
+
+		if (!test_and_set_bit(block, zram->bd_bitmap))
+			return block;
+	}
+}
+
+void zram_bd_free_block(struct zram *zram, unsigned long block)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zram->bd_lock, flags);
+	if (zram->bd_pins[block])
+		zram->bd_pins[block] |= ZRAM_BD_FREED;
+	else
+		clear_bit(block, zram->bd_bitmap);
+	spin_unlock_irqrestore(&zram->bd_lock, flags);
+}
+
+/* Called with table_lock held, before the slot's block is read */
+void zram_bd_pin(struct zram *zram, unsigned long block)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zram->bd_lock, flags);
+	zram->bd_pins[block]++;
+	spin_unlock_irqrestore(&zram->bd_lock, flags);
+}
+
+static void zram_bd_unpin(struct zram *zram, unsigned long block)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zram->bd_lock, flags);
+	if (--zram->bd_pins[block] == ZRAM_BD_FREED) {
+		zram->bd_pins[block] = 0;
+		clear_bit(block, zram->bd_bitmap);
+	}
+	spin_unlock_irqrestore(&zram->bd_lock, flags);
+}
+
+void zram_bd_read_done(struct zram_bd_read *rd, int err)
+{
+	unsigned int i;
+
+	if (err)
+		rd->error = err;
+
+	if (!atomic_dec_and_test(&rd->pending))
+		return;
+
+	for (i = 0; i < rd->nr_blocks; i++)
+		zram_bd_unpin(rd->zram, rd->blocks[i]);
+
+	if (rd->error) {
+		bio_io_error(rd->parent);
+	} else {
+		set_bit(BIO_UPTODATE, &rd->parent->bi_flags);
+		bio_endio(rd->parent, 0);
+	}
+	kfree(rd);
+}
+
+static void zram_bd_read_end_io(struct bio *bio, int err)
+{
+	struct zram_bd_read *rd = bio->bi_private;
+
+	if (!err && !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		err = -EIO;
+	if (!err)
+		flush_dcache_page(bio->bi_io_vec[0].bv_page);
+
+	bio_put(bio);
+	zram_bd_read_done(rd, err);
+}
+
+/*
+ * Start reading @block, pinned by the caller, into @page for @parent.
+ * We are called from zram_make_request(), where a bio we submit is only
+ * issued after we return, so the read cannot be waited for. Instead
+ * every page read holds a reference on *@rdp, and the last one
+ * completes @parent and drops the pins.
+ */
+int zram_bd_read(struct zram *zram, struct page *page, unsigned long block,
+		struct bio *parent, struct zram_bd_read **rdp)
+{
+	struct bio *bio;
+	struct zram_bd_read *rd = *rdp;
+
+	if (!rd) {
+		rd = kmalloc(sizeof(*rd) + bio_segments(parent) *
+				sizeof(rd->blocks[0]), GFP_NOIO);
+		if (!rd) {
+			zram_bd_unpin(zram, block);
+			return -ENOMEM;
+		}
+
+		rd->zram = zram;
+		rd->parent = parent;
+		atomic_set(&rd->pending, 1);
+		rd->error = 0;
+		rd->nr_blocks = 0;
+		*rdp = rd;
+	}
+	rd->blocks[rd->nr_blocks++] = block;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = block << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bd_read_end_io;
+	bio->bi_private = rd;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	atomic_inc(&rd->pending);
+	submit_bio(READ, bio);
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return 0;
+}
+
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		struct table *t = &zram->table[index];
+
+		write_lock(&zram->table_lock);
+		if (t->handle && !(t->flags & BIT(ZRAM_WB)) &&
+				t->age != (u8)~0)
+			t->age++;
+		write_unlock(&zram->table_lock);
+
+		cond_resched();
+	}
+}
+
+static int zram_wb_candidate(struct zram *zram, u32 index,
+			enum zram_wb_mode mode)
+{
+	struct table *t = &zram->table[index];
+
+	if (!t->handle || (t->flags & (BIT(ZRAM_SAME) | BIT(ZRAM_WB) |
+					BIT(ZRAM_UNDER_WB))))
+		return 0;
+
+	if (t->flags & BIT(ZRAM_UNCOMPRESSED))
+		return 1;
+
+	return mode == ZRAM_WB_IDLE && t->age >= zram->idle_age;
+}
+
+static void zram_wb_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Write @nr pages to consecutive blocks starting at @block */
+static int zram_wb_submit(struct zram *zram, struct page **pages,
+			unsigned long block, int nr)
+{
+	int i, ret;
+	struct bio *bio;
+
+	while (nr) {
+		DECLARE_COMPLETION_ONSTACK(done);
+
+		bio = bio_alloc(GFP_KERNEL, nr);
+		bio->bi_bdev = zram->bdev;
+		bio->bi_sector = block << SECTORS_PER_PAGE_SHIFT;
+		bio->bi_end_io = zram_wb_end_io;
+		bio->bi_private = &done;
+
+		/* The queue limits may cap how much one bio carries */
+		for (i = 0; i < nr; i++) {
+			if (!bio_add_page(bio, pages[i], PAGE_SIZE, 0))
+				break;
+		}
+		if (!i) {
+			bio_put(bio);
+			return -EIO;
+		}
+
+		submit_bio(WRITE, bio);
+		wait_for_completion(&done);
+		ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+		bio_put(bio);
+		if (ret)
+			return ret;
+
+		pages += i;
+		block += i;
+		nr -= i;
+	}
+
+	return 0;
+}
+
+/*
+ * Move the slot to its block, unless it was freed or rewritten while
+ * the data was being written.
+ */
+static void zram_wb_complete(struct zram *zram, u32 index,
+			unsigned long block, int err)
+{
+	write_lock(&zram->table_lock);
+	if (err || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->table_lock);
+		zram_bd_free_block(zram, block);
+		return;
+	}
+
+	zram_free_page(zram, index);
+	zram->table[index].handle = block;
+	zram_set_flag(zram, index, ZRAM_WB);
+	zram_stat_inc(&zram->stats.pages_wb);
+	write_unlock(&zram->table_lock);
+
+	zram_stat64_inc(zram, &zram->stats.bd_writes);
+}
+
+static int zram_wb_flush(struct zram *zram, struct page **pages,
+			u32 *indices, unsigned long *blocks, int nr)
+{
+	int i, j, k, err, ret = 0;
+
+	for (i = 0; i < nr; i = j) {
+		for (j = i + 1; j < nr && blocks[j] == blocks[i] + (j - i); j++)
+			;
+
+		err = zram_wb_submit(zram, pages + i, blocks[i], j - i);
+		for (k = i; k < j; k++)
+			zram_wb_complete(zram, indices[k], blocks[k], err);
+		if (err)
+			ret = err;
+	}
+
+	return ret;
+}
+
+/* Sleep as needed to keep @nr pages since @start under wb_rate */
+static void zram_wb_throttle(struct zram *zram, unsigned long start,
+			unsigned long nr)
+{
+	unsigned long due;
+	unsigned int rate = zram->wb_rate;
+
+	if (!rate)
+		return;
+
+	due = start + msecs_to_jiffies(div_u64((u64)nr * (PAGE_SIZE >> 10) *
+					MSEC_PER_SEC, rate));
+	if (time_before(jiffies, due))
+		schedule_timeout_interruptible(due - jiffies);
+}
+
+/*
+ * Write pages selected by @mode to the backing device, ZRAM_WB_BATCH at
+ * a time. Called with init_lock held on an initialized device.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int i, nr, ret = 0;
+	size_t index = 0, nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long block, hint = 1, written = 0, start = jiffies;
+	struct page *pages[ZRAM_WB_BATCH];
+	unsigned long blocks[ZRAM_WB_BATCH];
+	u32 indices[ZRAM_WB_BATCH];
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	while (index < nr_pages && !ret) {
+		/* Gather a batch */
+		for (nr = 0; nr < ZRAM_WB_BATCH && index < nr_pages; index++) {
+			write_lock(&zram->table_lock);
+			if (!zram_wb_candidate(zram, index, mode)) {
+				write_unlock(&zram->table_lock);
+				continue;
+			}
+
+			block = zram_bd_alloc_block(zram, hint);
+			if (!block) {
+				write_unlock(&zram->table_lock);
+				ret = -ENOSPC;
+				break;
+			}
+
+			if (zram_read_slot(zram, pages[nr], index)) {
+				write_unlock(&zram->table_lock);
+				zram_bd_free_block(zram, block);
+				continue;
+			}
+
+			zram_set_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->table_lock);
+
+			indices[nr] = index;
+			blocks[nr] = block;
+			hint = block + 1;
+			nr++;
+		}
+
+		if (!nr)
+			break;
+
+		if (zram_wb_flush(zram, pages, indices, blocks, nr))
+			ret = -EIO;
+
+		written += nr;
+		zram_wb_throttle(zram, start, written);
+
+		if (fatal_signal_pending(current))
+			ret = -EINTR;
+	}
+
+out:
+	while (i--)
+		__free_page(pages[i]);
+
+	return ret;
+}
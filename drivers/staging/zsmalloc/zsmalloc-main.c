@@ -0,0 +1,775 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Derived from zsmalloc by Nitin Gupta, Copyright (C) 2011, as merged
+ * into drivers/staging/zsmalloc in Linux 3.3. The allocator interface
+ * and size classes follow that version; handles, fullness tracking and
+ * compaction were reworked for this tree.
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped by size into size classes. Each class allocates
+ * "zspages": 1 to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages, chosen so that
+ * objects of that size waste as little of the zspage as possible. The
+ * objects are laid out back to back, so an object may span two pages.
+ * Unlike xvmalloc this keeps objects larger than PAGE_SIZE/2 dense.
+ *
+ * Callers get a handle rather than a pointer. The handle points to a
+ * word holding the current object location, which lets zs_compact()
+ * move objects out of sparsely used zspages and release them.
+ *
+ * Each struct page of a zspage has its private field pointing to the
+ * struct zspage that describes it.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cachep;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Find the zspage size (in pages) that wastes the least space when
+ * filled with objects of class_size bytes.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static unsigned long location_to_obj(struct zspage *zspage, unsigned int idx)
+{
+	unsigned long obj;
+
+	obj = page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS;
+	obj |= idx & OBJ_INDEX_MASK;
+
+	return obj << OBJ_TAG_BITS;
+}
+
+static struct zspage *obj_to_location(unsigned long obj, unsigned int *idx)
+{
+	obj >>= OBJ_TAG_BITS;
+	*idx = obj & OBJ_INDEX_MASK;
+
+	return (struct zspage *)page_private(pfn_to_page(obj >> OBJ_INDEX_BITS));
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle & ~BIT(HANDLE_PIN_BIT);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/* Update the location of a pinned object, keeping it pinned */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	*(unsigned long *)handle = obj | BIT(HANDLE_PIN_BIT);
+}
+
+/* Page and in-page offset of byte @off of zspage's linear space */
+static struct page *zspage_page(struct zspage *zspage, unsigned long off,
+				unsigned long *page_off)
+{
+	*page_off = off & ~PAGE_MASK;
+	return zspage->pages[off >> PAGE_SHIFT];
+}
+
+/*
+ * Read and write the header word of object @idx. Class sizes are
+ * multiples of ZS_SIZE_CLASS_DELTA, so the word never straddles pages.
+ */
+static unsigned long obj_read_head(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	struct page *page;
+	unsigned long off, head;
+	void *addr;
+
+	page = zspage_page(zspage, (unsigned long)idx * class->size, &off);
+	addr = kmap_atomic(page, KM_USER1);
+	head = *(unsigned long *)(addr + off);
+	kunmap_atomic(addr, KM_USER1);
+
+	return head;
+}
+
+static void obj_write_head(struct size_class *class, struct zspage *zspage,
+			unsigned int idx, unsigned long head)
+{
+	struct page *page;
+	unsigned long off;
+	void *addr;
+
+	page = zspage_page(zspage, (unsigned long)idx * class->size, &off);
+	addr = kmap_atomic(page, KM_USER1);
+	*(unsigned long *)(addr + off) = head;
+	kunmap_atomic(addr, KM_USER1);
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse <= 3 * max_objects / fullness_threshold_frac)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Move a zspage to the fullness list matching its current usage, or to
+ * the full list. Empty zspages are kept off the lists.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		goto out;
+
+	if (zspage->fullness != ZS_EMPTY)
+		list_del_init(&zspage->list);
+	if (newfg < _ZS_NR_FULLNESS_GROUPS)
+		list_add(&zspage->list, &class->fullness_list[newfg]);
+	else if (newfg == ZS_FULL)
+		list_add(&zspage->list, &class->full_list);
+	zspage->fullness = newfg;
+
+out:
+	return newfg;
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		struct page *page = zspage->pages[i];
+
+		if (!page)
+			break;
+		set_page_private(page, 0);
+		__free_page(page);
+	}
+
+	kfree(zspage);
+}
+
+/* Allocate a zspage for @class and thread all its objects on the free list */
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	int i;
+	unsigned int idx;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = alloc_page(flags);
+
+		if (!page) {
+			free_zspage(zspage);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[i] = page;
+	}
+
+	for (idx = 0; idx < class->objs_per_zspage; idx++) {
+		unsigned long next = idx + 1;
+
+		if (next == class->objs_per_zspage)
+			next = OBJ_FREE_END;
+		obj_write_head(class, zspage, idx, next << OBJ_TAG_BITS);
+	}
+	zspage->freeobj = 0;
+
+	return zspage;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+/* Take the first free object of @zspage for @handle. Needs class->lock. */
+static unsigned long obj_alloc(struct size_class *class, struct zspage *zspage,
+			unsigned long handle)
+{
+	unsigned int idx = zspage->freeobj;
+
+	BUG_ON(idx == OBJ_FREE_END);
+
+	zspage->freeobj = obj_read_head(class, zspage, idx) >> OBJ_TAG_BITS;
+	obj_write_head(class, zspage, idx, handle | OBJ_ALLOCATED_TAG);
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return location_to_obj(zspage, idx);
+}
+
+/* Return object @idx to the free list of @zspage. Needs class->lock. */
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	obj_write_head(class, zspage, idx,
+			(unsigned long)zspage->freeobj << OBJ_TAG_BITS);
+	zspage->freeobj = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/*
+ * Copy @len bytes starting at byte @off of object @idx to/from @buf,
+ * following the object into the next page if needed.
+ */
+static void obj_copy(struct size_class *class, struct zspage *zspage,
+		unsigned int idx, unsigned long off, char *buf,
+		unsigned long len, int to_obj)
+{
+	off += (unsigned long)idx * class->size;
+
+	while (len) {
+		struct page *page;
+		unsigned long page_off, chunk;
+		char *addr;
+
+		page = zspage_page(zspage, off, &page_off);
+		chunk = min(len, PAGE_SIZE - page_off);
+
+		addr = kmap_atomic(page, KM_USER1);
+		if (to_obj)
+			memcpy(addr + page_off, buf, chunk);
+		else
+			memcpy(buf, addr + page_off, chunk);
+		kunmap_atomic(addr, KM_USER1);
+
+		off += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool to be created
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int j;
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->index = i;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+					class->size;
+		spin_lock_init(&class->lock);
+		for (j = 0; j < _ZS_NR_FULLNESS_GROUPS; j++)
+			INIT_LIST_HEAD(&class->fullness_list[j]);
+		INIT_LIST_HEAD(&class->full_list);
+	}
+
+	pool->name = name;
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+static void free_zspage_list(struct size_class *class, struct list_head *head,
+			enum fullness_group fg)
+{
+	struct zspage *zspage, *tmp;
+
+	list_for_each_entry_safe(zspage, tmp, head, list) {
+		pr_info("Freeing non-empty class with size %db, "
+			"fullness group %d\n", class->size, fg);
+		list_del(&zspage->list);
+		free_zspage(zspage);
+	}
+}
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			free_zspage_list(class, &class->fullness_list[fg], fg);
+		free_zspage_list(class, &class->full_list, ZS_FULL);
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: gfp flags used if the pool needs to grow
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	unsigned long handle, obj;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = (unsigned long)kmem_cache_alloc(zs_handle_cachep,
+						flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cachep, (void *)handle);
+			return 0;
+		}
+
+		spin_lock(&class->lock);
+		class->pages_allocated += class->pages_per_zspage;
+	}
+
+	obj = obj_alloc(class, zspage, handle);
+	fix_fullness_group(class, zspage);
+	*(unsigned long *)handle = obj;
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int idx;
+	struct zspage *zspage;
+	struct size_class *class;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	/* Keeps zs_compact() from moving the object under us */
+	pin_tag(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, idx);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		class->pages_allocated -= class->pages_per_zspage;
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	if (fullness == ZS_EMPTY)
+		free_zspage(zspage);
+
+	kmem_cache_free(zs_handle_cachep, (void *)handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. Preemption is
+ * disabled between the two calls.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned int idx;
+	unsigned long off;
+	struct page *page;
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	/* Pinning disables preemption, keeping area ours until unmap */
+	pin_tag(handle);
+	zspage = obj_to_location(handle_to_obj(handle), &idx);
+	class = zspage->class;
+	area = &__get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+
+	page = zspage_page(zspage, (unsigned long)idx * class->size, &off);
+	if (off + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(page, KM_USER1);
+		return area->vm_addr + off + ZS_HANDLE_SIZE;
+	}
+
+	/* this object spans two pages */
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		obj_copy(class, zspage, idx, ZS_HANDLE_SIZE, area->vm_buf,
+			class->size - ZS_HANDLE_SIZE, 0);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int idx;
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+		area->vm_addr = NULL;
+	} else if (area->vm_mm != ZS_MM_RO) {
+		zspage = obj_to_location(handle_to_obj(handle), &idx);
+		class = zspage->class;
+		obj_copy(class, zspage, idx, ZS_HANDLE_SIZE, area->vm_buf,
+			class->size - ZS_HANDLE_SIZE, 1);
+	}
+
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	int i;
+	u64 npages = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		npages += class->pages_allocated;
+		spin_unlock(&class->lock);
+	}
+
+	return npages << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_get_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->pages_used += class->pages_allocated;
+		stats->obj_bytes += class->objs_inuse * class->size;
+		stats->pages_compacted += class->pages_compacted;
+		stats->objs_migrated += class->objs_migrated;
+		spin_unlock(&class->lock);
+	}
+}
+EXPORT_SYMBOL_GPL(zs_get_pool_stats);
+
+/*
+ * Move every allocated object of @src into @dst until @src is empty or
+ * @dst is full. Returns -EAGAIN if an object is pinned (mapped or being
+ * freed) and so cannot be moved right now. Needs class->lock.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *src,
+			struct zspage *dst)
+{
+	unsigned int idx, new_idx;
+	struct mapping_area *area = &get_cpu_var(zs_map_area);
+	int ret = 0;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		unsigned long head, handle, new_obj;
+
+		if (dst->inuse == class->objs_per_zspage)
+			break;
+
+		head = obj_read_head(class, src, idx);
+		if (!(head & OBJ_ALLOCATED_TAG))
+			continue;
+
+		handle = head & ~OBJ_ALLOCATED_TAG;
+		if (!trypin_tag(handle)) {
+			ret = -EAGAIN;
+			break;
+		}
+
+		new_obj = obj_alloc(class, dst, handle);
+		obj_copy(class, src, idx, ZS_HANDLE_SIZE, area->vm_buf,
+			class->size - ZS_HANDLE_SIZE, 0);
+		obj_to_location(new_obj, &new_idx);
+		obj_copy(class, dst, new_idx, ZS_HANDLE_SIZE,
+			area->vm_buf, class->size - ZS_HANDLE_SIZE, 1);
+		record_obj(handle, new_obj);
+		obj_free(class, src, idx);
+		unpin_tag(handle);
+
+		class->objs_migrated++;
+	}
+
+	put_cpu_var(zs_map_area);
+	return ret;
+}
+
+/* Pick a destination for migration: the fullest zspage that is not @src */
+static struct zspage *find_target_zspage(struct size_class *class,
+					struct zspage *src)
+{
+	int fg;
+
+	for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+		struct zspage *zspage;
+
+		list_for_each_entry(zspage, &class->fullness_list[fg], list)
+			if (zspage != src)
+				return zspage;
+	}
+
+	return NULL;
+}
+
+static unsigned long zs_compact_class(struct size_class *class)
+{
+	unsigned long freed = 0;
+	unsigned long wasted;
+
+	spin_lock(&class->lock);
+
+	/* Only as many zspages as the free objects in the class add up to */
+	wasted = class->pages_allocated / class->pages_per_zspage *
+			class->objs_per_zspage - class->objs_inuse;
+
+	while (wasted >= class->objs_per_zspage) {
+		struct list_head *head;
+		struct zspage *src, *dst;
+
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+		if (list_empty(head))
+			break;
+		src = list_entry(head->prev, struct zspage, list);
+
+		while (src->inuse) {
+			dst = find_target_zspage(class, src);
+			if (!dst || migrate_zspage(class, src, dst))
+				break;
+			fix_fullness_group(class, dst);
+		}
+
+		if (fix_fullness_group(class, src) != ZS_EMPTY)
+			break;
+
+		class->pages_allocated -= class->pages_per_zspage;
+		class->pages_compacted += class->pages_per_zspage;
+		freed += class->pages_per_zspage;
+		wasted -= class->objs_per_zspage;
+
+		spin_unlock(&class->lock);
+		free_zspage(src);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - Release sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Moves objects out of almost empty zspages into fuller zspages of the
+ * same size class and frees the zspages emptied this way. Objects that
+ * are mapped at the time are skipped. May sleep.
+ *
+ * Returns the number of pages released.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		freed += zs_compact_class(&pool->size_class[i]);
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static void zs_free_map_areas(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		kfree(area->vm_buf);
+		area->vm_buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	/*
+	 * Areas are allocated for every possible CPU up front so that
+	 * zs_map_object() never has to deal with CPU hotplug.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf) {
+			zs_free_map_areas();
+			kmem_cache_destroy(zs_handle_cachep);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	zs_free_map_areas();
+	kmem_cache_destroy(zs_handle_cachep);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
@@ -0,0 +1,59 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Derived from zsmalloc by Nitin Gupta, Copyright (C) 2011, as merged
+ * into drivers/staging/zsmalloc in Linux 3.3. The allocator interface
+ * and size classes follow that version; handles, fullness tracking and
+ * compaction were reworked for this tree.
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/*
+ * zs_map_object() mapping modes. With ZS_MM_WO the previous contents are
+ * not copied in, with ZS_MM_RO they are not written back on unmap.
+ */
+enum zs_mapmode {
+	ZS_MM_RW,
+	ZS_MM_RO,
+	ZS_MM_WO,
+};
+
+struct zs_pool_stats {
+	u64 pages_used;		/* pages backing the pool */
+	u64 obj_bytes;		/* bytes occupied by live objects */
+	u64 pages_compacted;	/* pages released by zs_compact() */
+	u64 objs_migrated;	/* objects moved by zs_compact() */
+};
+
+struct zs_pool;
+
+struct zs_pool *zs_create_pool(const char *name);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+/*
+ * Objects may straddle a page boundary, so they must be mapped before
+ * use. The mapping is per-cpu and uses the KM_USER1 kmap slot; the caller
+ * must not sleep or use KM_USER1 until zs_unmap_object().
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+void zs_get_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats);
+unsigned long zs_compact(struct zs_pool *pool);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Derived from zsmalloc by Nitin Gupta, Copyright (C) 2011, as merged
+ * into drivers/staging/zsmalloc in Linux 3.3. The allocator interface
+ * and size classes follow that version; handles, fullness tracking and
+ * compaction were reworked for this tree.
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages
+ * holding objects of a single size class back to back, so an object may
+ * start in one page and end in the next.
+ */
+#define ZS_MAX_ZSPAGE_ORDER	2
+#define ZS_MAX_PAGES_PER_ZSPAGE	(_AC(1, UL) << ZS_MAX_ZSPAGE_ORDER)
+
+/*
+ * Every object starts with a word holding its handle (allocated) or the
+ * index of the next free object (free). The handle lets zs_compact()
+ * find and update the owner of an object it moves.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
+/*
+ * Object locations are encoded as <PFN of first zspage page, obj_idx>.
+ * OBJ_INDEX_BITS must cover the most objects a zspage can hold,
+ * ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE / ZS_MIN_ALLOC_SIZE, plus one
+ * spare value (OBJ_INDEX_MASK) that terminates the free list.
+ */
+#define OBJ_INDEX_BITS		(PAGE_SHIFT + ZS_MAX_ZSPAGE_ORDER - 4)
+#define OBJ_INDEX_MASK		((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
+#define OBJ_FREE_END		OBJ_INDEX_MASK
+
+/* Low bit of the object header word: set if the object is allocated */
+#define OBJ_TAG_BITS		1
+#define OBJ_ALLOCATED_TAG	1
+
+/* Low bit of the word a handle points to: set while the object is pinned */
+#define HANDLE_PIN_BIT		0
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA bytes apart. This must be a
+ * multiple of sizeof(unsigned long) so that object header words never
+ * straddle a page boundary.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * Full zspages are kept on their own list, out of the way of allocation
+ * and compaction, which only look at the fullness lists. Zspages become
+ * empty only transiently and are freed right away.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+	ZS_FULL
+};
+
+/*
+ * A zspage is ZS_ALMOST_EMPTY while at most this fraction
+ * (n/fullness_threshold_frac) of its objects are in use.
+ */
+static const int fullness_threshold_frac = 4;
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* fullness list of its class */
+	struct size_class *class;
+	unsigned int inuse;		/* allocated objects */
+	unsigned int freeobj;		/* first free object index */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct size_class {
+	/* Protects fullness lists, free lists and the stats below */
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	struct list_head full_list;
+
+	/* Size of objects in this class, including the header word */
+	int size;
+	unsigned int index;
+	int pages_per_zspage;
+	int objs_per_zspage;
+
+	unsigned long pages_allocated;
+	unsigned long objs_inuse;
+	unsigned long pages_compacted;
+	unsigned long objs_migrated;
+};
+
+/* Per-cpu staging buffer for objects that straddle two pages */
+struct mapping_area {
+	char *vm_buf;
+	char *vm_addr;
+	enum zs_mapmode vm_mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	const char *name;
+};
+
+#endif
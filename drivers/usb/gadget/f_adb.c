@@ -26,11 +26,13 @@
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
-#define ADB_BULK_BUFFER_SIZE           4096
+#define ADB_BULK_BUFFER_SIZE           16384
 
 /* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
 
 static const char adb_shortname[] = "android_adb";
 
@@ -50,6 +52,8 @@ struct adb_dev {
 	atomic_t open_excl;
 
 	struct list_head tx_idle;
+	/* tx request being filled by adb_splice_write() */
+	struct usb_request *splice_req;
 
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
@@ -406,6 +410,105 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/* queue the tx request adb_pipe_to_req() has been filling */
+static int adb_splice_flush(struct adb_dev *dev)
+{
+	struct usb_request *req = dev->splice_req;
+	int ret;
+
+	if (!req)
+		return 0;
+	dev->splice_req = NULL;
+
+	if (atomic_read(&dev->error)) {
+		adb_req_put(dev, &dev->tx_idle, req);
+		return -EIO;
+	}
+
+	ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+	if (ret < 0) {
+		pr_debug("adb_splice_write: xfer error %d\n", ret);
+		atomic_set(&dev->error, 1);
+		adb_req_put(dev, &dev->tx_idle, req);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int adb_pipe_to_req(struct pipe_inode_info *pipe,
+		struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct adb_dev *dev = sd->u.file->private_data;
+	struct usb_request *req = dev->splice_req;
+	void *src;
+	int xfer, ret;
+
+	if (!req) {
+		ret = wait_event_interruptible(dev->write_wq,
+			((req = adb_req_get(dev, &dev->tx_idle)) ||
+			 atomic_read(&dev->error)));
+		if (ret < 0)
+			return ret;
+		if (!req)
+			return -EIO;
+
+		req->length = 0;
+		dev->splice_req = req;
+	}
+
+	xfer = min_t(unsigned, sd->len, ADB_BULK_BUFFER_SIZE - req->length);
+	src = buf->ops->map(pipe, buf, 0);
+	memcpy(req->buf + req->length, src + buf->offset, xfer);
+	buf->ops->unmap(pipe, buf, src);
+	req->length += xfer;
+
+	if (req->length == ADB_BULK_BUFFER_SIZE) {
+		ret = adb_splice_flush(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return xfer;
+}
+
+/*
+ * Pipe pages are copied straight into tx requests, which are sent as
+ * they fill up, rather than written one page per request as the
+ * default splice_write would do through adb_write(). What is left when
+ * the pipe runs dry is sent before returning, so the host sees the
+ * same transfers as for a write() of the same data.
+ */
+static ssize_t adb_splice_write(struct pipe_inode_info *pipe, struct file *fp,
+				loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct adb_dev *dev = fp->private_data;
+	ssize_t r;
+	int ret;
+
+	if (!_adb_dev)
+		return -ENODEV;
+	pr_debug("adb_splice_write(%zu)\n", len);
+
+	if (adb_lock(&dev->write_excl))
+		return -EBUSY;
+
+	if (atomic_read(&dev->error)) {
+		r = -EIO;
+		goto done;
+	}
+
+	r = splice_from_pipe(pipe, fp, ppos, len, flags, adb_pipe_to_req);
+	ret = adb_splice_flush(dev);
+	if (ret < 0)
+		r = ret;
+
+done:
+	adb_unlock(&dev->write_excl);
+	pr_debug("adb_splice_write returning %zd\n", r);
+	return r;
+}
+
 static int adb_open(struct inode *ip, struct file *fp)
 {
 	printk(KERN_INFO "adb_open\n");
@@ -435,6 +538,7 @@ static struct file_operations adb_fops = {
 	.owner = THIS_MODULE,
 	.read = adb_read,
 	.write = adb_write,
+	.splice_write = adb_splice_write,
 	.open = adb_open,
 	.release = adb_release,
 };
@@ -284,7 +284,9 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/pagemap.h>
 #include <linux/rwsem.h>
+#include <linux/uio.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
@@ -316,6 +318,28 @@ static const char fsg_string_interface[] = "Mass Storage";
 static int write_error_after_csw_sent;
 static int csw_hack_sent;
 #endif
+
+/*
+ * Number and size of the data buffers, read when the function is set
+ * up. With more buffers, more of the USB transfers overlap the backing
+ * file I/O of the others; larger ones mean fewer, larger file I/Os.
+ */
+#define FSG_MAX_BUFFERS		32
+#define FSG_MAX_BUFLEN		((u32)1048576)
+
+/*
+ * ci13xxx_udc and msm72k_udc give each request a single dTD, which
+ * cannot describe more than 16KB.
+ */
+#define FSG_DTD_MAX_BUFLEN	((u32)16384)
+
+static unsigned int fsg_num_buffers = FSG_NUM_BUFFERS;
+module_param_named(num_buffers, fsg_num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(num_buffers, "Number of data buffers");
+
+static unsigned int fsg_buflen = FSG_BUFLEN;
+module_param_named(buflen, fsg_buflen, uint, S_IRUGO);
+MODULE_PARM_DESC(buflen, "Size of each data buffer");
 /*-------------------------------------------------------------------------*/
 
 struct fsg_dev;
@@ -366,7 +390,16 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	unsigned int		num_buffers;
+	u32			buflen;
+
+	/* buffers gathered by do_write() into one vfs_writev() */
+	struct iovec		*write_iov;
+
+	/* where the last READ ended, to spot sequential streams */
+	struct fsg_lun		*ra_lun;
+	loff_t			ra_offset;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -740,6 +773,37 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Called when a READ has been read up to @offset. If it began where the
+ * previous READ on the LUN ended, the host is most likely streaming, so
+ * have the backing device start on a READ of the same size after this
+ * one. It can then work while this one is sent and the next command
+ * comes in, instead of only once vfs_read() asks for the data.
+ */
+static void fsg_read_ahead(struct fsg_common *common, loff_t offset)
+{
+	struct fsg_lun		*curlun = common->curlun;
+	struct file		*filp = curlun->filp;
+	u32			size = common->data_size_from_cmnd;
+	pgoff_t			index;
+	unsigned long		nr_pages;
+
+	if (common->ra_lun != curlun || common->ra_offset != offset - size)
+		goto out;
+	if (offset >= curlun->file_length)
+		goto out;
+
+	size = min((loff_t)size, curlun->file_length - offset);
+	index = offset >> PAGE_CACHE_SHIFT;
+	nr_pages = ((offset + size - 1) >> PAGE_CACHE_SHIFT) - index + 1;
+	page_cache_sync_readahead(filp->f_mapping, &filp->f_ra, filp,
+				  index, nr_pages);
+
+out:
+	common->ra_lun = curlun;
+	common->ra_offset = offset;
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
@@ -796,7 +860,7 @@ static int do_read(struct fsg_common *common)
 		 * If this means reading 0 then we were asked to read past
 		 *	the end of file.
 		 */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t)amount,
 			     curlun->file_length - file_offset);
 		partial_page = file_offset & (PAGE_CACHE_SIZE - 1);
@@ -867,8 +931,10 @@ static int do_read(struct fsg_common *common)
 			break;
 		}
 
-		if (amount_left == 0)
+		if (amount_left == 0) {
+			fsg_read_ahead(common, file_offset);
 			break;		/* No more left to read */
+		}
 
 		/* Send this buffer and go read some more */
 		bh->inreq->zero = 0;
@@ -896,6 +962,9 @@ static int do_write(struct fsg_common *common)
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	struct fsg_buffhd	*last;
+	int			nr_iov;
+	u32			excess;
 
 #ifdef CONFIG_USB_CSW_HACK
 	int			i;
@@ -965,7 +1034,7 @@ static int do_write(struct fsg_common *common)
 			 *	to write past the end of file.
 			 * Finally, round down to a block boundary.
 			 */
-			amount = min(amount_left_to_req, FSG_BUFLEN);
+			amount = min(amount_left_to_req, common->buflen);
 			amount = min((loff_t)amount,
 				     curlun->file_length - usb_offset);
 			partial_page = usb_offset & (PAGE_CACHE_SIZE - 1);
@@ -1040,13 +1109,51 @@ static int do_write(struct fsg_common *common)
 				break;
 			}
 
+			/*
+			 * Gather the full buffers that follow into the same
+			 * write, up to one that failed or was cut short by
+			 * the host.
+			 */
+			common->write_iov[0].iov_base = bh->buf;
+			common->write_iov[0].iov_len = bh->outreq->actual;
 			amount = bh->outreq->actual;
+			nr_iov = 1;
+			for (last = bh, bh = bh->next;
+			     bh->state == BUF_STATE_FULL &&
+			     bh->outreq->status == 0 &&
+			     last->outreq->actual == last->outreq->length &&
+			     amount < amount_left_to_write;
+			     last = bh, bh = bh->next) {
+				smp_rmb();
+				common->next_buffhd_to_drain = bh->next;
+				bh->state = BUF_STATE_EMPTY;
+				common->write_iov[nr_iov].iov_base = bh->buf;
+				common->write_iov[nr_iov].iov_len =
+							bh->outreq->actual;
+				amount += bh->outreq->actual;
+				nr_iov++;
+			}
+			bh = last;
+
 			if (curlun->file_length - file_offset < amount) {
 				LERROR(curlun,
 				       "write %u @ %llu beyond end %llu\n",
 				       amount, (unsigned long long)file_offset,
 				       (unsigned long long)curlun->file_length);
-				amount = curlun->file_length - file_offset;
+				excess = amount -
+					(curlun->file_length - file_offset);
+				amount -= excess;
+				while (excess) {
+					struct iovec *iov =
+						&common->write_iov[nr_iov - 1];
+					u32 cut = min_t(u32, excess,
+							iov->iov_len);
+
+					iov->iov_len -= cut;
+					excess -= cut;
+					if (!iov->iov_len)
+						nr_iov--;
+				}
 			}
 
 			/* Perform the write */
@@ -1054,9 +1161,9 @@ static int do_write(struct fsg_common *common)
 #ifdef CONFIG_USB_MSC_PROFILING
 			start = ktime_get();
 #endif
-			nwritten = vfs_write(curlun->filp,
-					     (char __user *)bh->buf,
-					     amount, &file_offset_tmp);
+			nwritten = vfs_writev(curlun->filp,
+					(struct iovec __user *)common->write_iov,
+					nr_iov, &file_offset_tmp);
 			VLDBG(curlun, "file write %u @ %llu -> %d\n", amount,
 			      (unsigned long long)file_offset, (int)nwritten);
 #ifdef CONFIG_USB_MSC_PROFILING
@@ -1106,12 +1213,13 @@ write_error:
 				 * yet from the host. So there is no point in
 				 * csw right away without the complete data.
 				 */
-				for (i = 0; i < FSG_NUM_BUFFERS; i++) {
+				for (i = 0; i < common->num_buffers; i++) {
 					if (common->buffhds[i].state ==
 							BUF_STATE_BUSY)
 						break;
 				}
-				if (!amount_left_to_req && i == FSG_NUM_BUFFERS) {
+				if (!amount_left_to_req &&
+				    i == common->num_buffers) {
 					csw_hack_sent = 1;
 					send_status(common);
 				}
@@ -1220,7 +1328,7 @@ static int do_verify(struct fsg_common *common)
 		 * If this means reading 0 then we were asked to read
 		 * past the end of file.
 		 */
-		amount = min(amount_left, FSG_BUFLEN);
+		amount = min(amount_left, common->buflen);
 		amount = min((loff_t)amount,
 			     curlun->file_length - file_offset);
 		if (amount == 0) {
@@ -1688,7 +1796,7 @@ static int throw_away_data(struct fsg_common *common)
 		bh = common->next_buffhd_to_fill;
 		if (bh->state == BUF_STATE_EMPTY
 		 && common->usb_amount_left > 0) {
-			amount = min(common->usb_amount_left, FSG_BUFLEN);
+			amount = min(common->usb_amount_left, common->buflen);
 
 			/*
 			 * amount is always divisible by 512, hence by
@@ -2441,7 +2549,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2468,7 +2576,7 @@ reset:
 
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2572,7 +2680,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2584,7 +2692,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2607,7 +2715,7 @@ static void handle_exception(struct fsg_common *common)
 	 */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2693,9 +2801,43 @@ static void handle_exception(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+static void fsg_perf_cmd_done(struct fsg_common *common, ktime_t start)
+{
+	struct fsg_lun	*curlun = common->curlun;
+	ktime_t		diff = ktime_sub(ktime_get(), start);
+	int		cmd;
+
+	if (!curlun)
+		return;
+
+	switch (common->cmnd[0]) {
+	case READ_6:
+	case READ_10:
+	case READ_12:
+		cmd = FSG_PERF_READ;
+		break;
+	case WRITE_6:
+	case WRITE_10:
+	case WRITE_12:
+		cmd = FSG_PERF_WRITE;
+		break;
+	default:
+		cmd = FSG_PERF_OTHER;
+	}
+
+	spin_lock(&curlun->lock);
+	curlun->latency[cmd].count++;
+	curlun->latency[cmd].total = ktime_add(curlun->latency[cmd].total,
+					       diff);
+	if (ktime_to_ns(diff) > ktime_to_ns(curlun->latency[cmd].max))
+		curlun->latency[cmd].max = diff;
+	spin_unlock(&curlun->lock);
+}
+
 static int fsg_main_thread(void *common_)
 {
 	struct fsg_common	*common = common_;
+	ktime_t			start;
 
 	/*
 	 * Allow the thread to be killed by a signal, but set the signal mask
@@ -2730,6 +2872,7 @@ static int fsg_main_thread(void *common_)
 
 		if (get_next_command(common))
 			continue;
+		start = ktime_get();
 
 		spin_lock_irq(&common->lock);
 		if (!exception_in_progress(common))
@@ -2738,6 +2881,7 @@ static int fsg_main_thread(void *common_)
 
 		if (do_scsi_command(common) || finish_reply(common))
 			continue;
+		fsg_perf_cmd_done(common, start);
 
 		spin_lock_irq(&common->lock);
 		if (!exception_in_progress(common))
@@ -2790,10 +2934,63 @@ static int fsg_main_thread(void *common_)
 
 /*************************** DEVICE ATTRIBUTES ***************************/
 
+/*
+ * Time from receiving each command to being done with its data, per
+ * kind of command.
+ */
+static ssize_t fsg_show_latency(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	static const char * const names[FSG_PERF_NR] = {
+		[FSG_PERF_READ]		= "read",
+		[FSG_PERF_WRITE]	= "write",
+		[FSG_PERF_OTHER]	= "other",
+	};
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+	unsigned long count;
+	int64_t total, max;
+	ssize_t rc = 0;
+	int i;
+
+	for (i = 0; i < FSG_PERF_NR; i++) {
+		spin_lock(&curlun->lock);
+		count = curlun->latency[i].count;
+		total = ktime_to_us(curlun->latency[i].total);
+		max = ktime_to_us(curlun->latency[i].max);
+		spin_unlock(&curlun->lock);
+
+		rc += snprintf(buf + rc, PAGE_SIZE - rc,
+			       "%s: %lu commands, avg %lld us, max %lld us\n",
+			       names[i], count,
+			       count ? div64_s64(total, count) : 0LL, max);
+	}
+
+	return rc;
+}
+
+/* Writing 0 resets the figures */
+static ssize_t fsg_store_latency(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+	int value;
+
+	if (sscanf(buf, "%d", &value) != 1 || value)
+		return -EINVAL;
+
+	spin_lock(&curlun->lock);
+	memset(curlun->latency, 0, sizeof(curlun->latency));
+	spin_unlock(&curlun->lock);
+
+	return count;
+}
+
 /* Write permission is checked per LUN in store_*() functions. */
 static DEVICE_ATTR(ro, 0644, fsg_show_ro, fsg_store_ro);
 static DEVICE_ATTR(nofua, 0644, fsg_show_nofua, fsg_store_nofua);
 static DEVICE_ATTR(file, 0644, fsg_show_file, fsg_store_file);
+static DEVICE_ATTR(latency, 0644, fsg_show_latency, fsg_store_latency);
 #ifdef CONFIG_USB_MSC_PROFILING
 static DEVICE_ATTR(perf, 0644, fsg_show_perf, fsg_store_perf);
 #endif
@@ -2826,6 +3023,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	struct fsg_lun *curlun;
 	struct fsg_lun_config *lcfg;
 	int nluns, i, rc;
+	u32 max_buflen;
 	char *pathbuf;
 
 	/* Find out how many LUNs there should be */
@@ -2909,6 +3107,10 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		rc = device_create_file(&curlun->dev, &dev_attr_nofua);
 		if (rc)
 			goto error_luns;
+		spin_lock_init(&curlun->lock);
+		rc = device_create_file(&curlun->dev, &dev_attr_latency);
+		if (rc)
+			goto error_luns;
 #ifdef CONFIG_USB_MSC_PROFILING
 		rc = device_create_file(&curlun->dev, &dev_attr_perf);
 		if (rc)
@@ -2928,14 +3130,34 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	common->nluns = nluns;
 
 	/* Data buffers cyclic list */
+	common->num_buffers = clamp_t(unsigned, fsg_num_buffers,
+				      FSG_NUM_BUFFERS, FSG_MAX_BUFFERS);
+	max_buflen = FSG_MAX_BUFLEN;
+	if (gadget_is_ci13xxx_msm(gadget) || gadget_is_ci13xxx_pci(gadget) ||
+	    gadget_is_msm72k(gadget))
+		max_buflen = FSG_DTD_MAX_BUFLEN;
+	if (fsg_buflen > max_buflen)
+		INFO(common, "buflen limited to %u by %s\n", max_buflen,
+		     gadget->name);
+	common->buflen = clamp_t(u32, fsg_buflen, FSG_BUFLEN, max_buflen) &
+				PAGE_CACHE_MASK;
+	common->buffhds = kcalloc(common->num_buffers,
+				  sizeof *common->buffhds, GFP_KERNEL);
+	common->write_iov = kcalloc(common->num_buffers,
+				    sizeof *common->write_iov, GFP_KERNEL);
+	if (unlikely(!common->buffhds || !common->write_iov)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+
 	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	i = common->num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
 		++bh;
 buffhds_first_it:
-		bh->buf = kmalloc(FSG_BUFLEN, GFP_KERNEL);
+		bh->buf = kmalloc(common->buflen, GFP_KERNEL);
 		if (unlikely(!bh->buf)) {
 			rc = -ENOMEM;
 			goto error_release;
@@ -3046,6 +3268,7 @@ static void fsg_common_release(struct kref *ref)
 #ifdef CONFIG_USB_MSC_PROFILING
 			device_remove_file(&lun->dev, &dev_attr_perf);
 #endif
+			device_remove_file(&lun->dev, &dev_attr_latency);
 			device_remove_file(&lun->dev, &dev_attr_nofua);
 			device_remove_file(&lun->dev, &dev_attr_ro);
 			device_remove_file(&lun->dev, &dev_attr_file);
@@ -3056,13 +3279,15 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
+	if (likely(common->buffhds)) {
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
+		unsigned i = common->num_buffers;
 		do {
 			kfree(bh->buf);
 		} while (++bh, --i);
+		kfree(common->buffhds);
 	}
+	kfree(common->write_iov);
 
 	if (common->free_storage_on_release)
 		kfree(common);
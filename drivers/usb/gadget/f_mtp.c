@@ -28,6 +28,7 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/backing-dev.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 
@@ -54,6 +55,33 @@
 #define RX_REQ_MAX 2
 #define INTR_REQ_MAX 5
 
+/* upper bound for mtp_rx_reqs */
+#define RX_REQ_LIMIT 16
+
+/*
+ * File transfers keep this many requests of this size in flight, so
+ * that vfs_read()/vfs_write() of one overlaps the USB transfer of the
+ * others. Requests stay at MTP_BULK_BUFFER_SIZE by default: ci13xxx_udc
+ * cannot take more than 16KB in one request; larger sizes are for
+ * controllers that can. If the buffers cannot all be allocated at bind
+ * time we fall back to MTP_BULK_BUFFER_SIZE and TX_REQ_MAX/RX_REQ_MAX.
+ */
+static unsigned int mtp_tx_req_len = MTP_BULK_BUFFER_SIZE;
+module_param(mtp_tx_req_len, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_tx_req_len, "MTP tx request buffer size");
+
+static unsigned int mtp_tx_reqs = 16;
+module_param(mtp_tx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_tx_reqs, "MTP tx request count");
+
+static unsigned int mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
+module_param(mtp_rx_req_len, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_rx_req_len, "MTP rx request buffer size");
+
+static unsigned int mtp_rx_reqs = 8;
+module_param(mtp_rx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(mtp_rx_reqs, "MTP rx request count");
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -91,9 +119,15 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
+	struct usb_request *rx_req[RX_REQ_LIMIT];
+	/* number of rx requests completed since it was last zeroed */
 	int rx_done;
 
+	/* sizes chosen at bind time */
+	unsigned int tx_req_len;
+	unsigned int rx_req_len;
+	unsigned int rx_reqs;
+
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
 	 */
@@ -361,7 +395,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -388,6 +422,7 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	struct usb_composite_dev *cdev = dev->cdev;
 	struct usb_request *req;
 	struct usb_ep *ep;
+	unsigned int tx_reqs;
 	int i;
 
 	DBG(cdev, "create_bulk_endpoints dev: %p\n", dev);
@@ -429,17 +464,42 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+	dev->tx_req_len = max(mtp_tx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE);
+	tx_reqs = max(mtp_tx_reqs, 2U);
+retry_tx_alloc:
+	for (i = 0; i < tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len == MTP_BULK_BUFFER_SIZE &&
+					tx_reqs <= TX_REQ_MAX)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			tx_reqs = TX_REQ_MAX;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+
+	dev->rx_req_len = max(mtp_rx_req_len, (unsigned)MTP_BULK_BUFFER_SIZE);
+	dev->rx_reqs = clamp(mtp_rx_reqs, 2U, (unsigned)RX_REQ_LIMIT);
+retry_rx_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req) {
+			if (dev->rx_req_len == MTP_BULK_BUFFER_SIZE &&
+					dev->rx_reqs <= RX_REQ_MAX)
+				goto fail;
+			while (i--) {
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+				dev->rx_req[i] = NULL;
+			}
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+			dev->rx_reqs = RX_REQ_MAX;
+			goto retry_rx_alloc;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
@@ -589,8 +649,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -605,6 +665,15 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			r = -EIO;
 			break;
 		}
+		/* the UDC may have cut the request short, losing the rest */
+		if (req->length != xfer) {
+			DBG(cdev, "mtp_write: %d of %d bytes queued\n",
+				req->length, xfer);
+			/* it completes back to tx_idle */
+			req = 0;
+			r = -EIO;
+			break;
+		}
 
 		buf += xfer;
 		count -= xfer;
@@ -662,6 +731,14 @@ static void send_file_work(struct work_struct *data) {
 		sendZLP = 1;
 	}
 
+	/*
+	 * The file is read in order while earlier requests are still on
+	 * the bus; have the page cache read further ahead, as for
+	 * POSIX_FADV_SEQUENTIAL.
+	 */
+	filp->f_ra.ra_pages = max_t(unsigned int, filp->f_ra.ra_pages,
+		filp->f_mapping->backing_dev_info->ra_pages * 2);
+
 	while (count > 0 || sendZLP) {
 		/* so we exit after sending ZLP */
 		if (count == 0)
@@ -681,8 +758,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -711,6 +788,14 @@ static void send_file_work(struct work_struct *data) {
 			r = -EIO;
 			break;
 		}
+		if (req->length != xfer) {
+			DBG(cdev, "send_file_work: %d of %d bytes queued\n",
+				req->length, xfer);
+			req = 0;
+			dev->state = STATE_ERROR;
+			r = -EIO;
+			break;
+		}
 
 		count -= xfer;
 
@@ -732,11 +817,11 @@ static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *read_req, *write_req = NULL;
 	struct file *filp;
 	loff_t offset;
 	int64_t count;
-	int ret, cur_buf = 0;
+	int ret, head = 0, tail = 0, queued = 0, completed = 0;
 	int r = 0;
 
 	/* read our parameters */
@@ -747,21 +832,31 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
-
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
+	/*
+	 * Reads are queued on rx_req[] as a ring, oldest at head, so that
+	 * the host can keep sending while we write out the last one.
+	 * count is what remains to be queued. If xfer_file_length is
+	 * 0xFFFFFFFF the length is unknown and the data ends with a short
+	 * packet; then only one read is queued at a time, so that none is
+	 * left waiting past the end of the data.
+	 */
+	dev->rx_done = 0;
+	for (;;) {
+		while (count > 0 && queued + !!write_req < dev->rx_reqs &&
+				(count != 0xFFFFFFFF || !queued)) {
+			read_req = dev->rx_req[tail];
+			read_req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
 			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			if (count != 0xFFFFFFFF)
+				count -= read_req->length;
+			tail = (tail + 1) % dev->rx_reqs;
+			queued++;
 		}
 
 		if (write_req) {
@@ -772,35 +867,51 @@ static void receive_file_work(struct work_struct *data)
 			if (ret != write_req->actual) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
 			write_req = NULL;
 		}
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
-			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+		if (!queued)
+			break;
+
+		/* wait for the oldest read to complete */
+		ret = wait_event_interruptible(dev->read_wq,
+			dev->rx_done != completed || dev->state != STATE_BUSY);
+		if (dev->state != STATE_BUSY) {
+			r = dev->state == STATE_CANCELED ? -ECANCELED : -EIO;
+			goto out;
+		}
+		if (ret < 0) {
+			r = ret;
+			goto out;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		read_req = dev->rx_req[head];
+		head = (head + 1) % dev->rx_reqs;
+		queued--;
+		completed++;
+
+		if (read_req->actual < read_req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			count = 0;
+			if (queued) {
+				/* the host sent less than it announced */
+				r = -EIO;
+				dev->state = STATE_ERROR;
+				goto out;
+			}
 		}
+
+		write_req = read_req;
+	}
+
+out:
+	/* reads still queued are cut short */
+	while (queued--) {
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[head]);
+		head = (head + 1) % dev->rx_reqs;
 	}
 
 	DBG(cdev, "receive_file_work returning %d\n", r);
@@ -1117,8 +1228,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < RX_REQ_LIMIT; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
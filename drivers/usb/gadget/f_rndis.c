@@ -76,6 +76,23 @@
  *   - MS-Windows drivers sometimes emit undocumented requests.
  */
 
+/*
+ * RNDIS lets one transfer carry several packets, which saves a request
+ * and an interrupt per packet at high packet rates.  Packets from the
+ * host are limited by what we announce; packets to the host are also
+ * limited by the MaxTransferSize the host sends in its INITIALIZE.
+ * Zero or one means one packet per transfer.
+ */
+static unsigned int rndis_ul_max_pkt_per_xfer = 3;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+		"Maximum packets per transfer from the host");
+
+static unsigned int rndis_dl_max_pkt_per_xfer = 3;
+module_param(rndis_dl_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_dl_max_pkt_per_xfer,
+		"Maximum packets per transfer to the host");
+
 struct rndis_ep_descs {
 	struct usb_endpoint_descriptor	*in;
 	struct usb_endpoint_descriptor	*out;
@@ -398,6 +415,10 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 	if (status < 0)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
+
+	/* set by INITIALIZE, cleared by HALT */
+	rndis->port.dl_max_xfer_size =
+		rndis_get_dl_max_xfer_size(rndis->config);
 //	spin_unlock(&dev->lock);
 }
 
@@ -528,6 +549,13 @@ static int rndis_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 		 */
 		rndis->port.cdc_filter = 0;
 
+		/* packets per transfer; the host says how big they may be */
+		rndis->port.ul_max_pkts_per_xfer = rndis_ul_max_pkt_per_xfer;
+		rndis->port.dl_max_pkts_per_xfer = rndis_dl_max_pkt_per_xfer;
+		rndis->port.dl_max_xfer_size = 0;
+		rndis_set_max_pkt_xfer(rndis->config,
+				rndis_ul_max_pkt_per_xfer);
+
 		DBG(cdev, "RNDIS RX/TX early activation ... \n");
 		net = gether_connect(&rndis->port);
 		if (IS_ERR(net))
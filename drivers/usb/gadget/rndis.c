@@ -597,6 +597,9 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 		return -ENOMEM;
 	resp = (rndis_init_cmplt_type *)r->buf;
 
+	/* the most the host takes in one transfer from us */
+	params->dl_max_xfer_size = get_unaligned_le32(&buf->MaxTransferSize);
+
 	resp->MessageType = cpu_to_le32(REMOTE_NDIS_INITIALIZE_CMPLT);
 	resp->MessageLength = cpu_to_le32(52);
 	resp->RequestID = buf->RequestID; /* Still LE in msg buffer */
@@ -605,13 +608,15 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32(1);
-	resp->MaxTransferSize = cpu_to_le32(
-		  params->dev->mtu
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer
+		* (params->dev->mtu
 		+ sizeof(struct ethhdr)
-		+ sizeof(struct rndis_packet_msg_type)
+		+ sizeof(struct rndis_packet_msg_type))
 		+ 22);
-	resp->PacketAlignmentFactor = cpu_to_le32(0);
+	/* keep the IP headers of packed packets 32-bit aligned */
+	resp->PacketAlignmentFactor = cpu_to_le32(
+		params->max_pkt_per_xfer > 1 ? 2 : 0);
 	resp->AFListOffset = cpu_to_le32(0);
 	resp->AFListSize = cpu_to_le32(0);
 
@@ -799,6 +804,7 @@ void rndis_uninit(int configNr)
 	if (configNr >= RNDIS_MAX_CONFIGS)
 		return;
 	rndis_per_dev_params[configNr].state = RNDIS_UNINITIALIZED;
+	rndis_per_dev_params[configNr].dl_max_xfer_size = 0;
 
 	/* drain the response queue */
 	while ((buf = rndis_get_next_response(configNr, &length)))
@@ -848,6 +854,7 @@ int rndis_msg_parser(u8 configNr, u8 *buf)
 		pr_debug("%s: REMOTE_NDIS_HALT_MSG\n",
 			__func__);
 		params->state = RNDIS_UNINITIALIZED;
+		params->dl_max_xfer_size = 0;
 		if (params->dev) {
 			netif_carrier_off(params->dev);
 			netif_stop_queue(params->dev);
@@ -975,6 +982,23 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+void rndis_set_max_pkt_xfer(u8 configNr, u32 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS) return;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		max_pkt_per_xfer ? : 1;
+}
+
+/* zero until the host has sent REMOTE_NDIS_INITIALIZE_MSG */
+u32 rndis_get_dl_max_xfer_size(u8 configNr)
+{
+	if (configNr >= RNDIS_MAX_CONFIGS) return 0;
+
+	return rndis_per_dev_params[configNr].dl_max_xfer_size;
+}
+
 void rndis_add_hdr(struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type *header;
@@ -1043,30 +1067,63 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * A transfer from the host may carry up to max_pkt_per_xfer packet
+ * messages back to back.  All but the last go out as clones sharing
+ * the transfer's buffer; a tail too short for a header is padding.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	struct rndis_packet_msg_type	*hdr;
+	struct sk_buff			*skb2;
+	u32				msg_len, data_offset, data_len;
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
+	if (skb->len < sizeof(*hdr)) {
 		dev_kfree_skb_any(skb);
 		return -EINVAL;
 	}
-	tmp++;
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
-	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
+	for (;;) {
+		hdr = (void *)skb->data;
 
-	skb_queue_tail(list, skb);
-	return 0;
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(&hdr->MessageType)) {
+			dev_kfree_skb_any(skb);
+			return -EINVAL;
+		}
+
+		msg_len = get_unaligned_le32(&hdr->MessageLength);
+		data_offset = get_unaligned_le32(&hdr->DataOffset) + 8;
+		data_len = get_unaligned_le32(&hdr->DataLength);
+
+		if (data_offset > skb->len
+				|| data_len > skb->len - data_offset) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
+
+		/* the last (or only) packet keeps the original skb */
+		if (msg_len < data_offset + data_len || msg_len >= skb->len
+				|| skb->len - msg_len < sizeof(*hdr)) {
+			skb_pull(skb, data_offset);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
+
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
+
+		skb_pull(skb, msg_len);
+	}
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -1195,6 +1252,7 @@ int rndis_init(void)
 		rndis_per_dev_params[i].media_state
 				= NDIS_MEDIA_STATE_DISCONNECTED;
 		INIT_LIST_HEAD(&(rndis_per_dev_params[i].resp_queue));
+		rndis_per_dev_params[i].max_pkt_per_xfer = 1;
 	}
 
 	return 0;
@@ -229,6 +229,13 @@ struct interrupt_data {
 /*-------------------------------------------------------------------------*/
 
 
+enum fsg_perf_cmd {
+	FSG_PERF_READ,
+	FSG_PERF_WRITE,
+	FSG_PERF_OTHER,
+	FSG_PERF_NR
+};
+
 struct fsg_lun {
 	struct file	*filp;
 	loff_t		file_length;
@@ -248,8 +255,16 @@ struct fsg_lun {
 	u32		unit_attention_data;
 
 	struct device	dev;
-#ifdef CONFIG_USB_MSC_PROFILING
 	spinlock_t	lock;
+
+	/* commands handled, indexed by enum fsg_perf_cmd */
+	struct {
+		unsigned long count;
+		ktime_t total;
+		ktime_t max;
+	} latency[FSG_PERF_NR];
+
+#ifdef CONFIG_USB_MSC_PROFILING
 	struct {
 
 		unsigned long rbytes;
@@ -714,6 +729,7 @@ static ssize_t fsg_show_perf(struct device *dev, struct device_attribute *attr,
 					"%lu bytes in %lld microseconds\n",
 					wbytes, wtime, rbytes, rtime);
 }
+
 static ssize_t fsg_store_perf(struct device *dev, struct device_attribute *attr,
 			const char *buf, size_t count)
 {
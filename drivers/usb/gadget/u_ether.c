@@ -24,6 +24,7 @@
 
 #include <linux/kernel.h>
 #include <linux/gfp.h>
+#include <linux/slab.h>
 #include <linux/device.h>
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
@@ -69,6 +70,14 @@ struct eth_dev {
 	struct list_head	tx_reqs, rx_reqs;
 	atomic_t		tx_qlen;
 
+	/* with multi-packet transfers, tx requests own their buffers;
+	 * tx_agg is the one being filled, queued once it's full or the
+	 * transfer ahead of it completes
+	 */
+	unsigned		tx_bufsize;
+	struct usb_request	*tx_agg;
+	unsigned		tx_agg_pkts;
+
 	struct sk_buff_head	rx_frames;
 
 	unsigned		header_len;
@@ -235,8 +244,11 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 * means receivers can't recover lost synch on their own (because
 	 * new packets don't only start after a short RX).
 	 */
-	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
+	size += sizeof(struct ethhdr) + dev->net->mtu;
 	size += dev->port_usb->header_len;
+	if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+		size *= dev->port_usb->ul_max_pkts_per_xfer;
+	size += RX_EXTRA;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -425,6 +437,32 @@ done:
 	return status;
 }
 
+static int alloc_tx_buffers(struct eth_dev *dev, unsigned size)
+{
+	struct usb_request	*req, *req2;
+
+	spin_lock(&dev->req_lock);
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		/* one spare byte, in case we must avoid a zlp */
+		req->buf = kmalloc(size + 1, GFP_ATOMIC);
+		if (!req->buf)
+			goto fail;
+	}
+	dev->tx_bufsize = size;
+	spin_unlock(&dev->req_lock);
+	return 0;
+
+fail:
+	list_for_each_entry(req2, &dev->tx_reqs, list) {
+		if (req2 == req)
+			break;
+		kfree(req2->buf);
+		req2->buf = NULL;
+	}
+	spin_unlock(&dev->req_lock);
+	return -ENOMEM;
+}
+
 static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	struct usb_request	*req;
@@ -489,6 +527,199 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 		netif_wake_queue(dev->net);
 }
 
+static void tx_agg_complete(struct usb_ep *ep, struct usb_request *req);
+
+static void tx_agg_queue(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req)
+{
+	unsigned long	flags;
+	int		retval;
+
+	while (req) {
+		/* same zlp avoidance as eth_start_xmit(); RNDIS ignores it */
+		req->zero = 1;
+		if (!dev->zlp && (req->length % in->maxpacket) == 0)
+			req->length++;
+
+		/* completions are what flush dev->tx_agg, don't delay them */
+		req->no_interrupt = 0;
+		req->complete = tx_agg_complete;
+
+		retval = usb_ep_queue(in, req, GFP_ATOMIC);
+		if (!retval) {
+			dev->net->trans_start = jiffies;
+			return;
+		}
+
+		DBG(dev, "tx queue err %d\n", retval);
+		dev->net->stats.tx_errors++;
+		spin_lock_irqsave(&dev->req_lock, flags);
+		list_add(&req->list, &dev->tx_reqs);
+		req = NULL;
+		/*
+		 * Frames collected behind the failed transfer wait for a
+		 * completion; if it was the last one in flight none comes,
+		 * so they take its place instead of stalling until the
+		 * next frame is sent.
+		 */
+		if (atomic_read(&dev->tx_qlen) == 1 && dev->tx_agg) {
+			req = dev->tx_agg;
+			dev->tx_agg = NULL;
+		} else {
+			atomic_dec(&dev->tx_qlen);
+		}
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+	}
+
+	if (netif_carrier_ok(dev->net))
+		netif_wake_queue(dev->net);
+}
+
+static void tx_agg_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct eth_dev		*dev = ep->driver_data;
+	struct usb_request	*next;
+
+	switch (req->status) {
+	default:
+		dev->net->stats.tx_errors++;
+		VDBG(dev, "tx err %d\n", req->status);
+		/* FALLTHROUGH */
+	case -ECONNRESET:		/* unlink */
+	case -ESHUTDOWN:		/* disconnect etc */
+	case 0:
+		break;
+	}
+
+	spin_lock(&dev->req_lock);
+	list_add(&req->list, &dev->tx_reqs);
+
+	/* whatever piled up meanwhile takes this transfer's place */
+	next = dev->tx_agg;
+	dev->tx_agg = NULL;
+	if (next && (req->status == -ECONNRESET
+			|| req->status == -ESHUTDOWN)) {
+		dev->net->stats.tx_dropped += dev->tx_agg_pkts;
+		list_add(&next->list, &dev->tx_reqs);
+		next = NULL;
+	}
+	if (!next)
+		atomic_dec(&dev->tx_qlen);
+	spin_unlock(&dev->req_lock);
+
+	if (next)
+		tx_agg_queue(dev, ep, next);
+
+	if (netif_carrier_ok(dev->net))
+		netif_wake_queue(dev->net);
+}
+
+/*
+ * Copy the wrapped frame into the request being filled.  That request
+ * goes out right away if nothing is in flight; otherwise it collects
+ * frames until it holds dl_max_pkts_per_xfer of them, the next one
+ * won't fit, or the transfer ahead of it completes.
+ */
+static netdev_tx_t eth_agg_xmit(struct eth_dev *dev, struct sk_buff *skb,
+		struct usb_ep *in)
+{
+	struct net_device	*net = dev->net;
+	struct usb_request	*req, *full = NULL;
+	unsigned		max_pkts = 1, max_len = 0;
+	unsigned long		flags;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (list_empty(&dev->tx_reqs)) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return NETDEV_TX_BUSY;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->port_usb) {
+		struct gether	*port = dev->port_usb;
+
+		if (port->dl_max_xfer_size) {
+			max_pkts = port->dl_max_pkts_per_xfer;
+			/* leave room for the byte that avoids a zlp */
+			max_len = min(port->dl_max_xfer_size - !dev->zlp,
+					dev->tx_bufsize);
+		}
+		if (dev->wrap)
+			skb = dev->wrap(port, skb);
+	} else {
+		dev_kfree_skb_any(skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (!skb)
+		goto drop;
+	if (skb->len > dev->tx_bufsize) {
+		dev_kfree_skb_any(skb);
+		goto drop;
+	}
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	req = dev->tx_agg;
+	dev->tx_agg = NULL;
+	if (req && req->length + skb->len > max_len) {
+		full = req;
+		req = NULL;
+	}
+
+	if (!req) {
+		/* disconnect() may have emptied the freelist */
+		if (list_empty(&dev->tx_reqs)) {
+			if (full)
+				list_add(&full->list, &dev->tx_reqs);
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			dev_kfree_skb_any(skb);
+			goto drop;
+		}
+		req = container_of(dev->tx_reqs.next,
+				struct usb_request, list);
+		list_del(&req->list);
+		req->length = 0;
+		dev->tx_agg_pkts = 0;
+
+		/* temporarily stop TX queue when the freelist empties */
+		if (list_empty(&dev->tx_reqs))
+			netif_stop_queue(net);
+	}
+
+	memcpy(req->buf + req->length, skb->data, skb->len);
+	req->length += skb->len;
+	net->stats.tx_packets++;
+	net->stats.tx_bytes += skb->len;
+
+	/* queue the full one before "req" can be seen, keeping order */
+	if (full) {
+		atomic_inc(&dev->tx_qlen);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		tx_agg_queue(dev, in, full);
+		spin_lock_irqsave(&dev->req_lock, flags);
+	}
+
+	if (++dev->tx_agg_pkts >= max_pkts || !atomic_read(&dev->tx_qlen)) {
+		atomic_inc(&dev->tx_qlen);
+	} else {
+		dev->tx_agg = req;
+		req = NULL;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	dev_kfree_skb_any(skb);
+
+	if (req)
+		tx_agg_queue(dev, in, req);
+	return NETDEV_TX_OK;
+
+drop:
+	net->stats.tx_dropped++;
+	return NETDEV_TX_OK;
+}
+
 static inline int is_promisc(u16 cdc_filter)
 {
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
@@ -542,6 +773,9 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		/* ignores USB_CDC_PACKET_TYPE_DIRECTED */
 	}
 
+	if (dev->tx_bufsize)
+		return eth_agg_xmit(dev, skb, in);
+
 	spin_lock_irqsave(&dev->req_lock, flags);
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
@@ -909,6 +1143,14 @@ struct net_device *gether_connect(struct gether *link)
 	if (result == 0)
 		result = alloc_requests(dev, link, qlen(dev->gadget));
 
+	if (result == 0 && link->dl_max_pkts_per_xfer > 1) {
+		/* without buffers we just send one packet per transfer */
+		if (alloc_tx_buffers(dev, link->dl_max_pkts_per_xfer *
+				(sizeof(struct ethhdr) + dev->net->mtu
+				 + link->header_len)))
+			DBG(dev, "no tx buffers, one packet per transfer\n");
+	}
+
 	if (result == 0) {
 		dev->zlp = link->is_zlp_ok;
 		DBG(dev, "qlen %d\n", qlen(dev->gadget));
@@ -977,15 +1219,22 @@ void gether_disconnect(struct gether *link)
 	 */
 	usb_ep_disable(link->in_ep);
 	spin_lock(&dev->req_lock);
+	if (dev->tx_agg) {
+		list_add(&dev->tx_agg->list, &dev->tx_reqs);
+		dev->tx_agg = NULL;
+	}
 	while (!list_empty(&dev->tx_reqs)) {
 		req = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
+		if (dev->tx_bufsize)
+			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
+	dev->tx_bufsize = 0;
 	spin_unlock(&dev->req_lock);
 	link->in_ep->driver_data = NULL;
 	link->in = NULL;
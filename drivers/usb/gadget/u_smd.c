@@ -25,6 +25,7 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/termios.h>
+#include <linux/uio.h>
 #include <mach/msm_smd.h>
 #include <linux/debugfs.h>
 
@@ -242,25 +243,27 @@ static void gsmd_rx_push(struct work_struct *w)
 			goto rx_push_end;
 
 		if (req->actual) {
-			char		*packet = req->buf;
-			unsigned	size = req->actual;
+			struct kvec	iov;
 			unsigned	n;
-			unsigned	count;
+			int		count;
 
+			iov.iov_base = req->buf;
+			iov.iov_len = req->actual;
 			n = port->n_read;
 			if (n) {
-				packet += n;
-				size -= n;
+				iov.iov_base += n;
+				iov.iov_len -= n;
 			}
 
-			count = smd_write(pi->ch, packet, size);
+			/* one interrupt for the whole queue, see below */
+			count = smd_writev(pi->ch, &iov, 1, SMD_WRITEV_MORE);
 			if (count < 0) {
 				pr_err("%s: smd write failed err:%d\n",
 						__func__, count);
 				goto rx_push_end;
 			}
 
-			if (count != size) {
+			if (count != iov.iov_len) {
 				port->n_read += count;
 				goto rx_push_end;
 			}
@@ -273,6 +276,8 @@ static void gsmd_rx_push(struct work_struct *w)
 	}
 
 rx_push_end:
+	if (port->pi->ch)
+		smd_writev(port->pi->ch, NULL, 0, 0);
 	spin_unlock_irq(&port->port_lock);
 
 	gsmd_start_rx(port);
@@ -0,0 +1,61 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Public Kernel Interface
+ *  Block format compatible with the LZ4 library
+ *
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  Derived from LZ4 svn r90 (http://code.google.com/p/lz4/); the
+ *  interface is the kernel's own, see lib/lz4/.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_HASH_LOG		12
+#define LZ4_MEM_COMPRESS	((1 << LZ4_HASH_LOG) * sizeof(u32))
+
+/* Largest input a single lz4_compress() call accepts */
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+/* Worst case output size for an incompressible input of size x */
+#define lz4_worst_compress(x)	((x) + ((x) / 255) + 16)
+
+/*
+ * lz4_compress()
+ *	src	: source address of the original data
+ *	src_len	: size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len	: on entry the size of dst, on return the compressed size;
+ *		  lz4_worst_compress(src_len) is always enough
+ *	wrkmem	: address of the working memory, LZ4_MEM_COMPRESS bytes
+ *	return	: LZ4_E_OK on success, < 0 otherwise
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4_decompress_safe()
+ *	src	: source address of the compressed data
+ *	src_len	: size of the compressed data
+ *	dst	: output buffer address of the decompressed data
+ *	dst_len	: on entry the size of dst, on return the decompressed size
+ *	return	: LZ4_E_OK on success, < 0 if the input is malformed or
+ *		  would overrun dst
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+/*
+ * Return values (< 0 = Error)
+ */
+#define LZ4_E_OK			0
+#define LZ4_E_ERROR			(-1)
+#define LZ4_E_OUTPUT_OVERRUN		(-2)
+#define LZ4_E_INPUT_OVERRUN		(-3)
+#define LZ4_E_LOOKBEHIND_OVERRUN	(-4)
+
+#endif
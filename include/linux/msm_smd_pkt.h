@@ -14,10 +14,40 @@
 #define __LINUX_MSM_SMD_PKT_H
 
 #include <linux/ioctl.h>
+#include <linux/types.h>
 
 #define SMD_PKT_IOCTL_MAGIC (0xC2)
 
 #define SMD_PKT_IOCTL_BLOCKING_WRITE \
 	_IOR(SMD_PKT_IOCTL_MAGIC, 0, unsigned int)
 
+/*
+ * Receive ring.  Once set up with SMD_PKT_IOCTL_RX_RING, the driver copies
+ * incoming packets from the SMD fifo straight into a ring of buffers that
+ * userspace maps with mmap() at offset 0, and read() is no longer used.
+ *
+ * The mapping starts with struct smd_pkt_rx_ring.  Buffer n lives at
+ * data_offset + (n % nr_bufs) * buf_size and starts with the __u32 length
+ * of the packet it holds.  The driver advances produced after filling a
+ * buffer; userspace advances consumed after it is done with one.  Both
+ * are free running.  poll() reports POLLIN while produced != consumed.
+ * Packets longer than buf_size - 4 are dropped and counted in dropped.
+ */
+struct smd_pkt_rx_ring_req {
+	__u32 nr_bufs;		/* power of two */
+	__u32 buf_size;		/* multiple of 4, length word included */
+};
+
+struct smd_pkt_rx_ring {
+	__u32 nr_bufs;
+	__u32 buf_size;
+	__u32 data_offset;
+	__u32 produced;		/* written by the driver */
+	__u32 consumed;		/* written by userspace */
+	__u32 dropped;
+};
+
+#define SMD_PKT_IOCTL_RX_RING \
+	_IOW(SMD_PKT_IOCTL_MAGIC, 1, struct smd_pkt_rx_ring_req)
+
 #endif /* __LINUX_MSM_SMD_PKT_H */
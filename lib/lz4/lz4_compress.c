@@ -0,0 +1,178 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  Derived from lz4.c of LZ4 svn r90 (http://code.google.com/p/lz4/):
+ *  the hash, the match search with its skip heuristic and the block
+ *  format follow LZ4_compressCtx() there, rewritten for the kernel with
+ *  a caller supplied hash table and bounded output.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Number of bytes the match starting at ip/ref extends up to limit */
+static inline size_t lz4_count(const u8 *ip, const u8 *ref, const u8 *limit)
+{
+	const u8 * const start = ip;
+
+	while (ip <= limit - sizeof(unsigned long)) {
+		unsigned long diff = LZ4_READLONG(ip) ^ LZ4_READLONG(ref);
+
+		if (!diff) {
+			ip += sizeof(unsigned long);
+			ref += sizeof(unsigned long);
+			continue;
+		}
+#ifdef __LITTLE_ENDIAN
+		ip += __ffs(diff) >> 3;
+#else
+		ip += (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+		return ip - start;
+	}
+
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+static inline u8 *lz4_put_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *hash_table = wrkmem;
+	const u8 *ip = src, *anchor = src;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	size_t len;
+
+	if (unlikely(src_len > LZ4_MAX_INPUT_SIZE))
+		return LZ4_E_ERROR;
+
+	if (src_len < MIN_LENGTH)
+		goto last_literals;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	for (;;) {
+		const u8 *ref;
+		u8 *token;
+		unsigned int step = 1;
+		unsigned int attempts = 1U << SKIPSTRENGTH;
+
+		/* Find a match */
+		for (;;) {
+			u32 h;
+
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+
+			h = lz4_hash(LZ4_READ32(ip));
+			ref = src + hash_table[h];
+			hash_table[h] = ip - src;
+
+			if ((size_t)(ip - ref) <= MAX_DISTANCE &&
+					LZ4_READ32(ref) == LZ4_READ32(ip))
+				break;
+
+			ip += step;
+			step = attempts++ >> SKIPSTRENGTH;
+		}
+
+		/* Catch up with identical bytes preceding the match */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* token + literals + length bytes + offset */
+		len = ip - anchor;
+		if (unlikely(op + 1 + len + len / 255 + 1 + 2 > oend))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		token = op++;
+		if (len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_length(op, len - RUN_MASK);
+		} else {
+			*token = len << ML_BITS;
+		}
+		memcpy(op, anchor, len);
+		op += len;
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		len = lz4_count(ip + MINMATCH, ref + MINMATCH, matchlimit);
+		ip += MINMATCH + len;
+		anchor = ip;
+
+		if (len >= ML_MASK) {
+			if (unlikely(op + len / 255 + 1 > oend))
+				return LZ4_E_OUTPUT_OVERRUN;
+			*token |= ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else {
+			*token |= len;
+		}
+
+		if (ip > mflimit)
+			break;
+
+		/* Remember a position inside the match for the next search */
+		hash_table[lz4_hash(LZ4_READ32(ip - 2))] = ip - 2 - src;
+	}
+
+last_literals:
+	len = iend - anchor;
+	if (unlikely(op + 1 + len + len / 255 + 1 > oend))
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	if (len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else {
+		*op++ = len << ML_BITS;
+	}
+	memcpy(op, anchor, len);
+	op += len;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,132 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  Derived from lz4.c of LZ4 svn r90 (http://code.google.com/p/lz4/):
+ *  follows LZ4_uncompress_unknownOutputSize() there, rewritten for the
+ *  kernel with every length checked against both buffers.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read a length continued in 255-valued bytes. Fails if the length
+ * would run past either end, which also keeps it from wrapping.
+ */
+static inline int lz4_get_length(const u8 **ipp, const u8 *iend,
+		size_t *len, size_t max)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return LZ4_E_INPUT_OVERRUN;
+		s = *ip++;
+		*len += s;
+		if (unlikely(*len > max))
+			return LZ4_E_OUTPUT_OVERRUN;
+	} while (s == 255);
+
+	*ipp = ip;
+	return LZ4_E_OK;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src;
+	const u8 * const iend = src + src_len;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	int ret;
+
+	*dst_len = 0;
+
+	for (;;) {
+		const u8 *ref;
+		unsigned int token;
+		size_t len, offset;
+
+		if (unlikely(ip >= iend))
+			return LZ4_E_INPUT_OVERRUN;
+		token = *ip++;
+
+		/* Literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK) {
+			ret = lz4_get_length(&ip, iend, &len, oend - op);
+			if (ret)
+				return ret;
+		}
+		if (unlikely(len > (size_t)(iend - ip)))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		/* The last sequence has no match part */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		/* Match */
+		len = token & ML_MASK;
+		if (len == ML_MASK) {
+			ret = lz4_get_length(&ip, iend, &len, oend - op);
+			if (ret)
+				return ret;
+		}
+		len += MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		/*
+		 * The match may overlap the bytes being written; copying a
+		 * word at a time is only correct once it is a word behind.
+		 */
+		if (offset >= sizeof(unsigned long)) {
+			for (; len >= sizeof(unsigned long);
+					len -= sizeof(unsigned long)) {
+				LZ4_COPYLONG(op, ref);
+				op += sizeof(unsigned long);
+				ref += sizeof(unsigned long);
+			}
+		}
+		while (len--)
+			*op++ = *ref++;
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ *  lz4defs.h -- LZ4 block format definitions
+ *
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ *  The constants are those of lz4.c in LZ4 svn r90
+ *  (http://code.google.com/p/lz4/).
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+/*
+ * A block is a sequence of (token, literals, offset, match length)
+ * records. The token holds the literal run length in its high nibble
+ * and the match length minus MINMATCH in its low nibble; a nibble of
+ * 15 is continued by bytes of 255 and a final byte < 255. The last
+ * record carries literals only.
+ */
+#define MINMATCH	4
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	0xffff
+
+/* The last match must start at least MFLIMIT bytes before the end */
+#define COPYLENGTH	8
+#define LASTLITERALS	5
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+#define MIN_LENGTH	(MFLIMIT + 1)
+
+/*
+ * Once this many consecutive probes have missed, the compressor starts
+ * skipping ahead faster over data that does not compress.
+ */
+#define SKIPSTRENGTH	6
+
+#define LZ4_READ32(p)		get_unaligned((const u32 *)(p))
+#define LZ4_READLONG(p)		get_unaligned((const unsigned long *)(p))
+#define LZ4_COPYLONG(d, s)	\
+		put_unaligned(LZ4_READLONG(s), (unsigned long *)(d))
@@ -0,0 +1,275 @@
+/*
+ * ashmem-bench.c -- measure ashmem pin/unpin throughput from N threads,
+ * with and without the shrinker purging underneath.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Run, here with up to four threads and a purging thread (which needs
+ * CAP_SYS_ADMIN for ASHMEM_PURGE_ALL_CACHES):
+ *
+ *	ashmem-bench -t 4 -P
+ *
+ * Every thread works on its own -p page area, or with -s on its own
+ * slice of one area shared by all threads.  Every fourth page of the
+ * area is left unpinned, so the area always holds -p / 4 unpinned
+ * ranges that pin and unpin have to search.  Each thread then unpins
+ * and re-pins random single pages between those, which never merge
+ * with their neighbours, for -d seconds.  Purged pages are touched
+ * again so that the shrinker always has something to drop.
+ *
+ * Passes run with 1, 2, 4 ... -t threads and report pin plus unpin
+ * calls per second over all threads, the slowest single call and the
+ * number of pins that found their page purged.  Separate areas show how
+ * the per-area lock scales; -s puts every thread behind one lock, and
+ * -P shows how long the shrinker keeps pin and unpin waiting.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+/* from include/linux/ashmem.h, which is not exported */
+struct ashmem_pin {
+	uint32_t	offset;
+	uint32_t	len;
+};
+
+#define __ASHMEMIOC		0x77
+#define ASHMEM_SET_SIZE		_IOW(__ASHMEMIOC, 3, size_t)
+#define ASHMEM_PIN		_IOW(__ASHMEMIOC, 7, struct ashmem_pin)
+#define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
+#define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+#define ASHMEM_WAS_PURGED	1
+
+#define ASHMEM_DEV	"/dev/ashmem"
+#define PAGE_SIZE	4096
+
+struct thread {
+	pthread_t	thread;
+	int		fd;
+	char		*map;
+	unsigned	first;		/* first page of this thread's slice */
+	unsigned long	ops;
+	unsigned long	purged;
+	double		max;
+};
+
+static pthread_barrier_t barrier;
+static volatile int stop;
+static unsigned pages = 256;
+static unsigned duration = 2;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Map a new area of @nr pages with every page populated */
+static int area(unsigned nr, char **map)
+{
+	int fd;
+
+	fd = open(ASHMEM_DEV, O_RDWR);
+	if (fd < 0)
+		die(ASHMEM_DEV);
+	if (ioctl(fd, ASHMEM_SET_SIZE, (size_t)nr * PAGE_SIZE) < 0)
+		die("ASHMEM_SET_SIZE");
+	*map = mmap(NULL, (size_t)nr * PAGE_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	if (*map == MAP_FAILED)
+		die("mmap");
+	memset(*map, 0x5a, (size_t)nr * PAGE_SIZE);
+	return fd;
+}
+
+static int pin(struct thread *t, int cmd, unsigned page)
+{
+	struct ashmem_pin p = {
+		.offset	= (t->first + page) * PAGE_SIZE,
+		.len	= PAGE_SIZE,
+	};
+	double start = now();
+	int ret;
+
+	ret = ioctl(t->fd, cmd, &p);
+	if (ret < 0)
+		die(cmd == ASHMEM_PIN ? "ASHMEM_PIN" : "ASHMEM_UNPIN");
+	start = now() - start;
+	if (start > t->max)
+		t->max = start;
+	t->ops++;
+	return ret;
+}
+
+static void *worker(void *arg)
+{
+	struct thread *t = arg;
+	unsigned seed = t->first + 1, page, i;
+
+	for (i = 3; i < pages; i += 4)
+		pin(t, ASHMEM_UNPIN, i);
+	t->ops = 0;
+	t->max = 0;
+
+	pthread_barrier_wait(&barrier);
+	while (!stop) {
+		seed = seed * 1103515245 + 12345;
+		/* pages 1 mod 4 sit between two pinned pages */
+		page = ((seed >> 16) % (pages / 4)) * 4 + 1;
+		pin(t, ASHMEM_UNPIN, page);
+		if (pin(t, ASHMEM_PIN, page) == ASHMEM_WAS_PURGED) {
+			t->map[(size_t)(t->first + page) * PAGE_SIZE] = 0x5a;
+			t->purged++;
+		}
+	}
+	return NULL;
+}
+
+static void *purger(void *arg)
+{
+	unsigned long *purges = arg;
+	int fd;
+
+	fd = open(ASHMEM_DEV, O_RDWR);
+	if (fd < 0)
+		die(ASHMEM_DEV);
+	pthread_barrier_wait(&barrier);
+	while (!stop) {
+		if (ioctl(fd, ASHMEM_PURGE_ALL_CACHES) < 0)
+			die("ASHMEM_PURGE_ALL_CACHES");
+		(*purges)++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void run(unsigned nr, int shared, int purge)
+{
+	static double base;
+	struct thread *threads;
+	pthread_t purge_thread;
+	unsigned long ops = 0, purged = 0, purges = 0;
+	double max = 0, rate;
+	char *map = NULL;
+	int fd = -1;
+	unsigned i;
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	if (shared)
+		fd = area(pages * nr, &map);
+	for (i = 0; i < nr; i++) {
+		if (shared) {
+			threads[i].fd = fd;
+			threads[i].map = map;
+			threads[i].first = i * pages;
+		} else {
+			threads[i].fd = area(pages, &threads[i].map);
+		}
+	}
+
+	stop = 0;
+	pthread_barrier_init(&barrier, NULL, nr + 1 + !!purge);
+	for (i = 0; i < nr; i++)
+		pthread_create(&threads[i].thread, NULL, worker, &threads[i]);
+	if (purge)
+		pthread_create(&purge_thread, NULL, purger, &purges);
+	pthread_barrier_wait(&barrier);
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(threads[i].thread, NULL);
+		ops += threads[i].ops;
+		purged += threads[i].purged;
+		if (threads[i].max > max)
+			max = threads[i].max;
+	}
+	if (purge)
+		pthread_join(purge_thread, NULL);
+	pthread_barrier_destroy(&barrier);
+
+	rate = ops / (double)duration;
+	if (!base)
+		base = rate;
+	printf("%u threads: %.0f ops/s (%.2fx), max %.0f us, %lu pins purged",
+	       nr, rate, rate / base, max * 1e6, purged);
+	if (purge)
+		printf(", %lu purges", purges);
+	printf("\n");
+
+	for (i = 0; i < nr; i++) {
+		if (shared && i)
+			continue;
+		munmap(threads[i].map,
+		       (size_t)pages * (shared ? nr : 1) * PAGE_SIZE);
+		close(threads[i].fd);
+	}
+	free(threads);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t max-threads] [-p pages] [-d seconds] "
+		"[-s] [-P]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned threads = sysconf(_SC_NPROCESSORS_ONLN), nr;
+	int shared = 0, purge = 0, c;
+
+	while ((c = getopt(argc, argv, "t:p:d:sP")) != -1) {
+		switch (c) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			shared = 1;
+			break;
+		case 'P':
+			purge = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !threads || pages < 4 || !duration)
+		usage(argv[0]);
+
+	for (nr = 1; ; nr *= 2) {
+		if (nr > threads)
+			nr = threads;
+		run(nr, shared, purge);
+		if (nr == threads)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * binder-bench.c -- raw binder transactions, for measuring the driver
+ * without libbinder in the way.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The process forks a server, which becomes the context manager, and
+ * the client then calls handle 0 in a loop.  Must run as root, with no
+ * servicemanager running (stop servicemanager first on Android).
+ *
+ *	binder-bench -m flat -s 65536	payload memcpy()ed into the parcel
+ *	binder-bench -m sg -s 65536	payload as a BINDER_TYPE_PTR object
+ *	binder-bench -m latency -H 4	SCHED_FIFO client, four CPU hogs
+ *
+ * flat and sg report MB/s of payload delivered to the server, which
+ * reads one byte per cache line of it, so the two compare the cost of
+ * flattening against the driver's scatter-gather copy.
+ *
+ * latency pins the client, the server and -H busy looping processes to
+ * one CPU, makes the client SCHED_FIFO and reports the round trip time.
+ * With priority inheritance the server runs at the client's priority
+ * and the hogs do not matter; the server also reports the policy it
+ * ran the call with.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define MAP_SIZE	(4 << 20)
+#define CLIENT_PRIO	50
+
+enum { MODE_FLAT, MODE_SG, MODE_LATENCY };
+
+static int mode = MODE_SG;
+static size_t size = 65536;
+static unsigned iterations = 2000;
+static unsigned hogs = 4;
+
+struct reply {
+	int policy;
+	int priority;
+};
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static int open_binder(void)
+{
+	struct binder_version version;
+	int fd;
+
+	fd = open("/dev/binder", O_RDWR);
+	if (fd < 0)
+		die("/dev/binder");
+	if (ioctl(fd, BINDER_VERSION, &version) < 0)
+		die("BINDER_VERSION");
+	if (version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol %ld, built for %d\n",
+			version.protocol_version,
+			BINDER_CURRENT_PROTOCOL_VERSION);
+		exit(1);
+	}
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		die("mmap");
+	return fd;
+}
+
+/* One BINDER_WRITE_READ; returns the number of bytes read */
+static size_t write_read(int fd, void *wbuf, size_t wlen, void *rbuf,
+			 size_t rlen)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.write_size = wlen;
+	bwr.read_buffer = (unsigned long)rbuf;
+	bwr.read_size = rlen;
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0)
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	return bwr.read_consumed;
+}
+
+/*
+ * Find the next return code @want in the read buffer and copy its
+ * payload to @out; the payloads are only 4 byte aligned there.
+ */
+static int find_cmd(uint8_t **pos, uint8_t *end, uint32_t want, void *out)
+{
+	while (*pos + sizeof(uint32_t) <= end) {
+		uint32_t cmd;
+
+		memcpy(&cmd, *pos, sizeof(cmd));
+		*pos += sizeof(cmd);
+		if (cmd == want) {
+			memcpy(out, *pos, _IOC_SIZE(cmd));
+			*pos += _IOC_SIZE(cmd);
+			return 1;
+		}
+		if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY) {
+			fprintf(stderr, "transaction failed (%#x)\n", cmd);
+			exit(1);
+		}
+		*pos += _IOC_SIZE(cmd);
+	}
+	return 0;
+}
+
+/* Append a command and its payload to a write buffer */
+static uint8_t *put_cmd(uint8_t *p, uint32_t cmd, const void *payload,
+			size_t len)
+{
+	memcpy(p, &cmd, sizeof(cmd));
+	memcpy(p + sizeof(cmd), payload, len);
+	return p + sizeof(cmd) + len;
+}
+
+static void free_buffer(int fd, const void *buffer)
+{
+	uint8_t wbuf[16], *p;
+
+	p = put_cmd(wbuf, BC_FREE_BUFFER, &buffer, sizeof(buffer));
+	write_read(fd, wbuf, p - wbuf, NULL, 0);
+}
+
+static unsigned touch(const uint8_t *p, size_t len)
+{
+	unsigned sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i += 64)
+		sum += p[i];
+	return sum;
+}
+
+static void server(int ready)
+{
+	static uint8_t rbuf[4096];
+	struct reply reply;
+	struct sched_param param;
+	uint32_t cmd = BC_ENTER_LOOPER;
+	volatile unsigned sink;
+	int fd;
+
+	fd = open_binder();
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR");
+	write_read(fd, &cmd, sizeof(cmd), NULL, 0);
+	if (write(ready, "", 1) != 1)
+		die("write");
+	close(ready);
+
+	for (;;) {
+		uint8_t *pos = rbuf, *end, wbuf[128], *p;
+		struct binder_transaction_data txn, tr;
+
+		end = rbuf + write_read(fd, NULL, 0, rbuf, sizeof(rbuf));
+		while (find_cmd(&pos, end, BR_TRANSACTION, &txn)) {
+			const uint8_t *data = txn.data.ptr.buffer;
+
+			if (mode == MODE_SG) {
+				struct binder_buffer_object bp;
+
+				memcpy(&bp, data, sizeof(bp));
+				sink = touch(bp.buffer, bp.length);
+			} else {
+				sink = touch(data, txn.data_size);
+			}
+
+			reply.policy = sched_getscheduler(0);
+			sched_getparam(0, &param);
+			reply.priority = reply.policy == SCHED_OTHER ?
+				getpriority(PRIO_PROCESS, 0) :
+				param.sched_priority;
+
+			memset(&tr, 0, sizeof(tr));
+			tr.data_size = sizeof(reply);
+			tr.data.ptr.buffer = &reply;
+			p = put_cmd(wbuf, BC_FREE_BUFFER, &txn.data.ptr.buffer,
+				    sizeof(txn.data.ptr.buffer));
+			p = put_cmd(p, BC_REPLY, &tr, sizeof(tr));
+			write_read(fd, wbuf, p - wbuf, NULL, 0);
+		}
+	}
+	(void)sink;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One call to the context manager; returns the server's reply */
+static struct reply call(int fd, const void *payload, void *parcel)
+{
+	static uint8_t rbuf[4096];
+	static const size_t offsets[1] = { 0 };
+	struct binder_buffer_object bp;
+	struct binder_transaction_data_sg sg;
+	struct binder_transaction_data *tr = &sg.transaction_data;
+	struct reply reply = { 0, 0 };
+	uint8_t wbuf[128], *p;
+
+	memset(&sg, 0, sizeof(sg));
+	tr->target.handle = 0;
+	if (mode == MODE_SG) {
+		bp.type = BINDER_TYPE_PTR;
+		bp.flags = 0;
+		bp.buffer = (void *)payload;
+		bp.length = size;
+		tr->data_size = sizeof(bp);
+		tr->data.ptr.buffer = &bp;
+		tr->offsets_size = sizeof(offsets);
+		tr->data.ptr.offsets = offsets;
+		sg.buffers_size = (size + sizeof(void *) - 1) &
+				  ~(sizeof(void *) - 1);
+		p = put_cmd(wbuf, BC_TRANSACTION_SG, &sg, sizeof(sg));
+	} else {
+		/* what a parcel does with a blob: copy it in */
+		memcpy(parcel, payload, size);
+		tr->data_size = size;
+		tr->data.ptr.buffer = parcel;
+		p = put_cmd(wbuf, BC_TRANSACTION, tr, sizeof(*tr));
+	}
+	write_read(fd, wbuf, p - wbuf, NULL, 0);
+
+	for (;;) {
+		struct binder_transaction_data txn;
+		uint8_t *pos = rbuf, *end;
+
+		end = rbuf + write_read(fd, NULL, 0, rbuf, sizeof(rbuf));
+		if (!find_cmd(&pos, end, BR_REPLY, &txn))
+			continue;
+		if (txn.data_size >= sizeof(reply))
+			memcpy(&reply, txn.data.ptr.buffer, sizeof(reply));
+		free_buffer(fd, txn.data.ptr.buffer);
+		return reply;
+	}
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		die("sched_setaffinity");
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m flat|sg|latency] [-s size] "
+		"[-n iterations] [-H hogs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sched_param param = { .sched_priority = CLIENT_PRIO };
+	pid_t server_pid, *hog_pids = NULL;
+	struct reply reply = { 0, 0 };
+	double start, *lat = NULL;
+	uint8_t *payload, *parcel;
+	int c, fd, pipefd[2];
+	unsigned i, inherited = 0;
+	char byte;
+
+	while ((c = getopt(argc, argv, "m:s:n:H:")) != -1) {
+		switch (c) {
+		case 'm':
+			if (!strcmp(optarg, "flat"))
+				mode = MODE_FLAT;
+			else if (!strcmp(optarg, "sg"))
+				mode = MODE_SG;
+			else if (!strcmp(optarg, "latency"))
+				mode = MODE_LATENCY;
+			else
+				usage(argv[0]);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			hogs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (mode == MODE_LATENCY)
+		size = 64;
+	if (!iterations || size > MAP_SIZE / 4)
+		usage(argv[0]);
+
+	if (mode == MODE_LATENCY)
+		pin(0);
+
+	if (pipe(pipefd) < 0)
+		die("pipe");
+	server_pid = fork();
+	if (server_pid < 0)
+		die("fork");
+	if (!server_pid) {
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		close(pipefd[0]);
+		server(pipefd[1]);
+		exit(0);
+	}
+	close(pipefd[1]);
+	if (read(pipefd[0], &byte, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		return 1;
+	}
+
+	fd = open_binder();
+	payload = malloc(size);
+	parcel = malloc(size);
+	memset(payload, 0x5a, size);
+
+	if (mode == MODE_LATENCY) {
+		hog_pids = calloc(hogs, sizeof(*hog_pids));
+		for (i = 0; i < hogs; i++) {
+			hog_pids[i] = fork();
+			if (hog_pids[i] < 0)
+				die("fork");
+			if (!hog_pids[i]) {
+				/* don't outlive a client that died */
+				prctl(PR_SET_PDEATHSIG, SIGKILL);
+				for (;;)
+					;
+			}
+		}
+		if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+			die("sched_setscheduler");
+		lat = malloc(iterations * sizeof(*lat));
+	}
+
+	/* warm up the target's buffer allocator */
+	for (i = 0; i < 10; i++)
+		call(fd, payload, parcel);
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		double t = now();
+
+		reply = call(fd, payload, parcel);
+		if (lat) {
+			lat[i] = now() - t;
+			if (reply.policy == SCHED_FIFO &&
+			    reply.priority == CLIENT_PRIO)
+				inherited++;
+		}
+	}
+
+	if (mode == MODE_LATENCY) {
+		param.sched_priority = 0;
+		sched_setscheduler(0, SCHED_OTHER, &param);
+		for (i = 0; i < hogs; i++)
+			kill(hog_pids[i], SIGKILL);
+		qsort(lat, iterations, sizeof(*lat), cmp_double);
+		printf("%u calls, %u hogs: p50 %.0f us, p99 %.0f us, "
+		       "max %.0f us\n", iterations, hogs,
+		       lat[iterations / 2] * 1e6,
+		       lat[iterations * 99 / 100] * 1e6,
+		       lat[iterations - 1] * 1e6);
+		printf("server ran %u of them at SCHED_FIFO %d\n",
+		       inherited, CLIENT_PRIO);
+	} else {
+		double secs = now() - start;
+
+		printf("%s, %zu bytes: %.0f calls/s, %.1f MB/s\n",
+		       mode == MODE_SG ? "sg" : "flat", size,
+		       iterations / secs, size / 1e6 * iterations / secs);
+	}
+
+	kill(server_pid, SIGKILL);
+	while (wait(NULL) > 0)
+		;
+	return 0;
+}
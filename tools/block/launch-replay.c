@@ -0,0 +1,245 @@
+/*
+ * launch-replay.c -- replay the reads of an application launch from a
+ * blktrace, optionally against a background writer, and report how
+ * long the launch took.  Used to compare io schedulers (e.g. row
+ * against cfq and deadline) on the read latency that users notice.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Record the launch on the device, then turn the trace into the input
+ * format, one request per line: <seconds> <rwbs> <sector> <nr_sectors>.
+ *
+ *	blktrace -d /dev/block/mmcblk0 -o launch &
+ *	am start -W -n com.example/.Main; kill %1
+ *	blkparse -i launch -a issue -f "%T.%9t %d %S %n\n" > launch.txt
+ *
+ * Replay it, here with a writer filling a file on the same device:
+ *
+ *	echo row > /sys/block/mmcblk0/queue/scheduler
+ *	launch-replay -r 10 -w /data/fill /dev/block/mmcblk0 launch.txt
+ *
+ * Reads are issued with O_DIRECT, one at a time, each no earlier than
+ * its recorded offset from the first one: the launch is a chain of
+ * dependent reads, so a late read delays all those that follow.  Only
+ * reads are replayed, the device is opened read only.  The writer
+ * does buffered 1MB writes with an fsync() every 32MB, the way a
+ * package install or a sync does.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE	512
+#define WRITE_CHUNK	(1 << 20)
+#define WRITE_SYNC	32		/* chunks between fsync() */
+#define WRITE_MAX	(256 << 20)	/* wrap the fill file here */
+
+struct req {
+	double		at;		/* seconds after the first read */
+	unsigned long long sector;
+	unsigned	nr_sectors;
+};
+
+static struct req *reqs;
+static unsigned nr_reqs;
+static volatile int stop_writer;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_trace(const char *path)
+{
+	unsigned alloc = 0;
+	double t, t0 = -1;
+	unsigned long long sector;
+	unsigned n;
+	char line[256], rwbs[16];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lf %15s %llu %u", &t, rwbs, &sector,
+			   &n) != 4 || !strchr(rwbs, 'R') || !n)
+			continue;
+		if (t0 < 0)
+			t0 = t;
+		if (nr_reqs == alloc) {
+			alloc = alloc ? alloc * 2 : 256;
+			reqs = realloc(reqs, alloc * sizeof(*reqs));
+			if (!reqs) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		reqs[nr_reqs].at = t - t0;
+		reqs[nr_reqs].sector = sector;
+		reqs[nr_reqs].nr_sectors = n;
+		nr_reqs++;
+	}
+	fclose(f);
+	if (!nr_reqs) {
+		fprintf(stderr, "%s: no reads in trace\n", path);
+		exit(1);
+	}
+}
+
+static void *writer(void *arg)
+{
+	const char *path = arg;
+	unsigned long long off = 0;
+	unsigned chunks = 0;
+	char *buf;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	buf = malloc(WRITE_CHUNK);
+	memset(buf, 0x5a, WRITE_CHUNK);
+	while (!stop_writer) {
+		if (pwrite(fd, buf, WRITE_CHUNK, off) != WRITE_CHUNK) {
+			perror("write");
+			exit(1);
+		}
+		off = (off + WRITE_CHUNK) % WRITE_MAX;
+		if (++chunks % WRITE_SYNC == 0)
+			fsync(fd);
+	}
+	close(fd);
+	unlink(path);
+	free(buf);
+	return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* returns the launch time, fills lat[] with per read latencies */
+static double replay(int fd, void *buf, double *lat)
+{
+	double start, t;
+	unsigned i;
+	ssize_t len;
+
+	start = now();
+	for (i = 0; i < nr_reqs; i++) {
+		while ((t = now() - start) < reqs[i].at) {
+			if (usleep((reqs[i].at - t) * 1e6) && errno != EINTR)
+				break;
+		}
+		len = (ssize_t)reqs[i].nr_sectors * SECTOR_SIZE;
+		t = now();
+		if (pread(fd, buf, len, reqs[i].sector * SECTOR_SIZE) != len) {
+			fprintf(stderr, "read of sector %llu failed\n",
+				reqs[i].sector);
+			exit(1);
+		}
+		lat[i] = now() - t;
+	}
+	return now() - start;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-r runs] [-w fill-file] device trace\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *fill = NULL;
+	unsigned runs = 5, max_sectors = 0, i, r;
+	double *lat, *all, total = 0, worst = 0, launch;
+	pthread_t thread;
+	void *buf;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "r:w:")) != -1) {
+		switch (c) {
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 'w':
+			fill = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || !runs)
+		usage(argv[0]);
+
+	load_trace(argv[optind + 1]);
+	for (i = 0; i < nr_reqs; i++)
+		if (reqs[i].nr_sectors > max_sectors)
+			max_sectors = reqs[i].nr_sectors;
+
+	fd = open(argv[optind], O_RDONLY | O_DIRECT);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (posix_memalign(&buf, 4096, max_sectors * SECTOR_SIZE))
+		return 1;
+	lat = malloc(nr_reqs * sizeof(*lat));
+	all = malloc(nr_reqs * runs * sizeof(*all));
+
+	if (fill) {
+		pthread_create(&thread, NULL, writer, (void *)fill);
+		/* let the writer fill the queue first */
+		sleep(2);
+	}
+
+	printf("%u reads, %.1f ms recorded\n", nr_reqs,
+	       reqs[nr_reqs - 1].at * 1e3);
+	for (r = 0; r < runs; r++) {
+		launch = replay(fd, buf, lat);
+		printf("run %u: launch %.1f ms\n", r, launch * 1e3);
+		total += launch;
+		if (launch > worst)
+			worst = launch;
+		memcpy(all + r * nr_reqs, lat, nr_reqs * sizeof(*lat));
+	}
+
+	if (fill) {
+		stop_writer = 1;
+		pthread_join(thread, NULL);
+	}
+
+	qsort(all, nr_reqs * runs, sizeof(*all), cmp_double);
+	printf("launch: mean %.1f ms, max %.1f ms\n",
+	       total / runs * 1e3, worst * 1e3);
+	printf("read latency: p50 %.0f us, p99 %.0f us, max %.0f us\n",
+	       all[nr_reqs * runs / 2] * 1e6,
+	       all[nr_reqs * runs * 99 / 100] * 1e6,
+	       all[nr_reqs * runs - 1] * 1e6);
+
+	close(fd);
+	return 0;
+}
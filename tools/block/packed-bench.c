@@ -0,0 +1,240 @@
+/*
+ * packed-bench.c -- measure small random write throughput on an mmc
+ * card for several eMMC packed write thresholds.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Run it on a filesystem of the card under test, naming the card's
+ * disk so that its packing_threshold can be set:
+ *
+ *	packed-bench -d mmcblk0 -T 0,2,4,8 /data/packed-bench
+ *
+ * The file is created at -s MB and written out once, so that the timed
+ * writes overwrite blocks that are already allocated.  For every
+ * threshold in -T (0 turns packing off) each of -t threads then does
+ * -b byte writes at random -b aligned offsets for -r seconds, calling
+ * fdatasync() after every -f writes, the way SQLite commits a
+ * transaction.  Writeback then has many small, non-contiguous writes
+ * queued at once, which is what packing merges.  With -o the writes go
+ * out with O_DIRECT instead, and at most -t requests are queued.
+ *
+ * Each pass prints writes per second and MB/s, followed by the disk's
+ * packing_stats for the pass.  The threshold the disk had before is
+ * restored at the end.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHUNK		(1 << 20)
+
+struct thread {
+	pthread_t	thread;
+	unsigned	seed;
+	unsigned long	writes;
+};
+
+static const char *path;
+static off_t size = 64 << 20;
+static unsigned bs = 4096;
+static unsigned sync_every = 16;
+static unsigned duration = 10;
+static int direct;
+static volatile int stop;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sysfs_write(const char *disk, const char *attr, const char *val)
+{
+	char file[256];
+	int fd;
+
+	snprintf(file, sizeof(file), "/sys/block/%s/%s", disk, attr);
+	fd = open(file, O_WRONLY);
+	if (fd < 0 || write(fd, val, strlen(val)) != (ssize_t)strlen(val)) {
+		fprintf(stderr, "%s < %s: %s\n", file, val, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+}
+
+static void sysfs_read(const char *disk, const char *attr, char *buf,
+		       size_t len)
+{
+	char file[256];
+	ssize_t n;
+	int fd;
+
+	snprintf(file, sizeof(file), "/sys/block/%s/%s", disk, attr);
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || (n = read(fd, buf, len - 1)) < 0)
+		die(file);
+	buf[n] = '\0';
+	close(fd);
+}
+
+static void create(void)
+{
+	char *buf = malloc(CHUNK);
+	off_t off;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0 || !buf)
+		die(path);
+	memset(buf, 0x5a, CHUNK);
+	for (off = 0; off < size; off += CHUNK)
+		if (pwrite(fd, buf, CHUNK, off) != CHUNK)
+			die(path);
+	fsync(fd);
+	close(fd);
+	free(buf);
+}
+
+static void *worker(void *arg)
+{
+	struct thread *t = arg;
+	off_t blocks = size / bs, off;
+	void *buf;
+	int fd;
+
+	fd = open(path, O_WRONLY | (direct ? O_DIRECT : 0));
+	if (fd < 0 || posix_memalign(&buf, 4096, bs))
+		die(path);
+	memset(buf, t->seed, bs);
+	while (!stop) {
+		t->seed = t->seed * 1103515245 + 12345;
+		off = (off_t)((t->seed >> 8) % blocks) * bs;
+		if (pwrite(fd, buf, bs, off) != (ssize_t)bs)
+			die("write");
+		if (++t->writes % sync_every == 0)
+			fdatasync(fd);
+	}
+	fdatasync(fd);
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void run(const char *disk, const char *threshold, unsigned nr)
+{
+	struct thread *threads;
+	unsigned long writes = 0;
+	char stats[4096];
+	double t;
+	unsigned i;
+
+	sysfs_write(disk, "packing_threshold", threshold);
+	sysfs_write(disk, "packing_stats", "0");
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	stop = 0;
+	t = now();
+	for (i = 0; i < nr; i++) {
+		threads[i].seed = i + 1;
+		pthread_create(&threads[i].thread, NULL, worker, &threads[i]);
+	}
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(threads[i].thread, NULL);
+		writes += threads[i].writes;
+	}
+	/* the final fdatasync() of every thread is part of the pass */
+	t = now() - t;
+	free(threads);
+
+	printf("threshold %s: %.0f writes/s, %.2f MB/s\n", threshold,
+	       writes / t, writes * (double)bs / 1e6 / t);
+	sysfs_read(disk, "packing_stats", stats, sizeof(stats));
+	fputs(stats, stdout);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -d disk [-T threshold[,threshold...]] "
+		"[-t threads] [-s size-mb] [-b bytes] [-f writes-per-sync] "
+		"[-r seconds] [-o] file\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *disk = NULL, *thresholds = "0,2,8";
+	unsigned threads = 4;
+	char old[16], *list, *th;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:T:t:s:b:f:r:o")) != -1) {
+		switch (c) {
+		case 'd':
+			disk = optarg;
+			break;
+		case 'T':
+			thresholds = optarg;
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = (off_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			sync_every = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			direct = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !disk || !threads || !sync_every ||
+	    !duration || !bs || bs % 512 || size < bs)
+		usage(argv[0]);
+	path = argv[optind];
+	size = (size + CHUNK - 1) / CHUNK * CHUNK;
+
+	sysfs_read(disk, "packing_threshold", old, sizeof(old));
+	create();
+
+	list = strdup(thresholds);
+	for (th = strtok(list, ","); th; th = strtok(NULL, ","))
+		run(disk, th, threads);
+	free(list);
+
+	old[strcspn(old, "\n")] = '\0';
+	sysfs_write(disk, "packing_threshold", old);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * hdlc-test.c -- check drivers/char/diag/diagchar_hdlc.c against the
+ * byte at a time encoder and decoder it replaced, and time both.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * Packets of random length and content, from plain to mostly escape
+ * characters, are encoded with destination windows of random size,
+ * the way diag fills USB buffers, and every call must leave the same
+ * output, pointers, state and CRC behind.  The encoded stream is then
+ * fed to both decoders in random source and destination chunks.
+ * Finally both are timed on a 1MB packet that is three quarters zeros,
+ * roughly what a log stream looks like.
+ *
+ *	make && ./hdlc-test [-n packets] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "diagchar_hdlc.h"
+
+#define MAX_PKT		1024
+#define BENCH_SIZE	(1 << 20)
+#define BENCH_REPS	100
+
+#define CRC_16_L_SEED           0xFFFF
+
+#define CRC_16_L_STEP(xx_crc, xx_c) \
+	crc_ccitt_byte(xx_crc, xx_c)
+
+/* The code before the word at a time version, as the reference */
+
+static void ref_hdlc_encode(struct diag_send_desc_type *src_desc,
+		      struct diag_hdlc_dest_type *enc)
+{
+	uint8_t *dest;
+	uint8_t *dest_last;
+	const uint8_t *src;
+	const uint8_t *src_last;
+	uint16_t crc;
+	unsigned char src_byte = 0;
+	enum diag_send_state_enum_type state;
+	unsigned int used = 0;
+
+	if (src_desc && enc) {
+
+		/* Copy parts to local variables. */
+		src = src_desc->pkt;
+		src_last = src_desc->last;
+		state = src_desc->state;
+		dest = enc->dest;
+		dest_last = enc->dest_last;
+
+		if (state == DIAG_STATE_START) {
+			crc = CRC_16_L_SEED;
+			state++;
+		} else {
+			/* Get a local copy of the CRC */
+			crc = enc->crc;
+		}
+
+		/* dest or dest_last may be NULL to trigger a
+		   state transition only */
+		if (dest && dest_last) {
+			/* This condition needs to include the possibility
+			   of 2 dest bytes for an escaped byte */
+			while (src <= src_last && dest <= dest_last) {
+
+				src_byte = *src++;
+
+				if ((src_byte == CONTROL_CHAR) ||
+				    (src_byte == ESC_CHAR)) {
+
+					/* If the escape character is not the
+					   last byte */
+					if (dest != dest_last) {
+						crc = CRC_16_L_STEP(crc,
+								    src_byte);
+
+						*dest++ = ESC_CHAR;
+						used++;
+
+						*dest++ = src_byte
+							  ^ ESC_MASK;
+						used++;
+					} else {
+
+						src--;
+						break;
+					}
+
+				} else {
+					crc = CRC_16_L_STEP(crc, src_byte);
+					*dest++ = src_byte;
+					used++;
+				}
+			}
+
+			if (src > src_last) {
+
+				if (state == DIAG_STATE_BUSY) {
+					if (src_desc->terminate) {
+						crc = ~crc;
+						state++;
+					} else {
+						/* Done with fragment */
+						state = DIAG_STATE_COMPLETE;
+					}
+				}
+
+				while (dest <= dest_last &&
+				       state >= DIAG_STATE_CRC1 &&
+				       state < DIAG_STATE_TERM) {
+					/* Encode a byte of the CRC next */
+					src_byte = crc & 0xFF;
+
+					if ((src_byte == CONTROL_CHAR)
+					    || (src_byte == ESC_CHAR)) {
+
+						if (dest != dest_last) {
+
+							*dest++ = ESC_CHAR;
+							used++;
+							*dest++ = src_byte ^
+								  ESC_MASK;
+							used++;
+
+							crc >>= 8;
+						} else {
+
+							break;
+						}
+					} else {
+
+						crc >>= 8;
+						*dest++ = src_byte;
+						used++;
+					}
+
+					state++;
+				}
+
+				if (state == DIAG_STATE_TERM) {
+					if (dest_last >= dest) {
+						*dest++ = CONTROL_CHAR;
+						used++;
+						state++;	/* Complete */
+					}
+				}
+			}
+		}
+		/* Copy local variables back into the encode structure. */
+
+		enc->dest = dest;
+		enc->dest_last = dest_last;
+		enc->crc = crc;
+		src_desc->pkt = src;
+		src_desc->last = src_last;
+		src_desc->state = state;
+	}
+
+	return;
+}
+
+
+static int ref_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
+{
+	uint8_t *src_ptr = NULL, *dest_ptr = NULL;
+	unsigned int src_length = 0, dest_length = 0;
+
+	unsigned int len = 0;
+	unsigned int i;
+	uint8_t src_byte;
+
+	int pkt_bnd = 0;
+
+	if (hdlc && hdlc->src_ptr && hdlc->dest_ptr &&
+	    (hdlc->src_size - hdlc->src_idx > 0) &&
+	    (hdlc->dest_size - hdlc->dest_idx > 0)) {
+
+		src_ptr = hdlc->src_ptr;
+		src_ptr = &src_ptr[hdlc->src_idx];
+		src_length = hdlc->src_size - hdlc->src_idx;
+
+		dest_ptr = hdlc->dest_ptr;
+		dest_ptr = &dest_ptr[hdlc->dest_idx];
+		dest_length = hdlc->dest_size - hdlc->dest_idx;
+
+		for (i = 0; i < src_length; i++) {
+
+			src_byte = src_ptr[i];
+
+			if (hdlc->escaping) {
+				dest_ptr[len++] = src_byte ^ ESC_MASK;
+				hdlc->escaping = 0;
+			} else if (src_byte == ESC_CHAR) {
+				if (i == (src_length - 1)) {
+					hdlc->escaping = 1;
+					i++;
+					break;
+				} else {
+					dest_ptr[len++] = src_ptr[++i]
+							  ^ ESC_MASK;
+				}
+			} else if (src_byte == CONTROL_CHAR) {
+				dest_ptr[len++] = src_byte;
+				pkt_bnd = 1;
+				i++;
+				break;
+			} else {
+				dest_ptr[len++] = src_byte;
+			}
+
+			if (len >= dest_length) {
+				i++;
+				break;
+			}
+		}
+
+		hdlc->src_idx += i;
+		hdlc->dest_idx += len;
+	}
+
+	return pkt_bnd;
+}
+
+static unsigned long long rnd_state = 1;
+
+static unsigned rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state >> 16;
+}
+
+static void fill_pkt(u8 *p, unsigned len)
+{
+	static const u8 special[] = { 0x7C, 0x7D, 0x7E, 0x7F };
+	unsigned kind = rnd() % 3, i;
+
+	for (i = 0; i < len; i++) {
+		if (kind == 0)
+			p[i] = rnd();
+		else if (kind == 1)
+			p[i] = rnd() & 1 ? special[rnd() % 4] : rnd();
+		else
+			p[i] = rnd() % 64 ? 0 : 0x7E;
+	}
+}
+
+static void fail(const char *what, unsigned n)
+{
+	fprintf(stderr, "packet %u: %s differs\n", n, what);
+	exit(1);
+}
+
+/* Encode @pkt through random windows, returns the encoded length */
+static unsigned check_encode(const u8 *pkt, unsigned len, u8 *out,
+			     unsigned n)
+{
+	static u8 ref_out[4 * MAX_PKT + 8];
+	struct diag_send_desc_type s[2];
+	struct diag_hdlc_dest_type e[2];
+	u8 *d[2] = { ref_out, out };
+	unsigned w;
+	int i, terminate = rnd() % 4 != 0;
+
+	for (i = 0; i < 2; i++) {
+		s[i].pkt = pkt;
+		s[i].last = pkt + len - 1;
+		s[i].state = DIAG_STATE_START;
+		s[i].terminate = terminate;
+		e[i].crc = 0;
+	}
+
+	while (s[0].state != DIAG_STATE_COMPLETE) {
+		w = 1 + rnd() % 64;
+		for (i = 0; i < 2; i++) {
+			/* no destination only moves the state on */
+			e[i].dest = w == 64 ? NULL : d[i];
+			e[i].dest_last = d[i] + w - 1;
+		}
+		ref_hdlc_encode(&s[0], &e[0]);
+		diag_hdlc_encode(&s[1], &e[1]);
+
+		if (s[0].pkt != s[1].pkt)
+			fail("source position", n);
+		if (s[0].state != s[1].state)
+			fail("state", n);
+		if (e[0].crc != e[1].crc)
+			fail("crc", n);
+		if (w != 64) {
+			if ((u8 *)e[0].dest - ref_out != (u8 *)e[1].dest - out)
+				fail("encoded length", n);
+			if (memcmp(ref_out, out, (u8 *)e[0].dest - ref_out))
+				fail("encoded data", n);
+			d[0] = e[0].dest;
+			d[1] = e[1].dest;
+		}
+	}
+
+	return d[1] - out;
+}
+
+/* Decode @src in random chunks into random sized destinations */
+static void check_decode(u8 *src, unsigned len, unsigned n)
+{
+	static u8 dest[2][4 * MAX_PKT + 8];
+	struct diag_hdlc_decode_type h[2];
+	int i, ret[2];
+
+	memset(h, 0, sizeof(h));
+	for (i = 0; i < 2; i++) {
+		h[i].src_ptr = src;
+		h[i].dest_ptr = dest[i];
+	}
+
+	while (h[0].src_idx < len) {
+		unsigned src_size = h[0].src_idx + 1 + rnd() % 96;
+		unsigned dest_size = h[0].dest_idx + 1 + rnd() % 96;
+
+		if (src_size > len)
+			src_size = len;
+		for (i = 0; i < 2; i++) {
+			h[i].src_size = src_size;
+			h[i].dest_size = dest_size;
+		}
+		ret[0] = ref_hdlc_decode(&h[0]);
+		ret[1] = diag_hdlc_decode(&h[1]);
+
+		if (ret[0] != ret[1])
+			fail("packet boundary", n);
+		if (h[0].src_idx != h[1].src_idx)
+			fail("decode source index", n);
+		if (h[0].dest_idx != h[1].dest_idx)
+			fail("decode destination index", n);
+		if (h[0].escaping != h[1].escaping)
+			fail("escape state", n);
+		if (memcmp(dest[0], dest[1], h[0].dest_idx))
+			fail("decoded data", n);
+
+		/* like diag, start over at a packet boundary */
+		if (ret[0] || h[0].dest_idx >= 4 * MAX_PKT) {
+			h[0].dest_idx = 0;
+			h[1].dest_idx = 0;
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef void (*encode_fn)(struct diag_send_desc_type *,
+			  struct diag_hdlc_dest_type *);
+typedef int (*decode_fn)(struct diag_hdlc_decode_type *);
+
+static double bench_encode(encode_fn encode, const u8 *pkt, u8 *out)
+{
+	struct diag_send_desc_type s;
+	struct diag_hdlc_dest_type e;
+	double start = now();
+	int r;
+
+	for (r = 0; r < BENCH_REPS; r++) {
+		s.pkt = pkt;
+		s.last = pkt + BENCH_SIZE - 1;
+		s.state = DIAG_STATE_START;
+		s.terminate = 1;
+		e.dest = out;
+		e.dest_last = out + 2 * BENCH_SIZE + 7;
+		encode(&s, &e);
+	}
+	return BENCH_SIZE / 1e6 * BENCH_REPS / (now() - start);
+}
+
+static double bench_decode(decode_fn decode, u8 *src, unsigned len,
+			   u8 *out)
+{
+	struct diag_hdlc_decode_type h;
+	double start = now();
+	int r;
+
+	for (r = 0; r < BENCH_REPS; r++) {
+		memset(&h, 0, sizeof(h));
+		h.src_ptr = src;
+		h.src_size = len;
+		h.dest_ptr = out;
+		h.dest_size = BENCH_SIZE + 8;
+		while (!decode(&h) && h.src_idx < len)
+			;
+	}
+	return BENCH_SIZE / 1e6 * BENCH_REPS / (now() - start);
+}
+
+int main(int argc, char **argv)
+{
+	static u8 pkt[MAX_PKT], enc[4 * MAX_PKT + 8];
+	unsigned nr = 300000, len, n, i;
+	u8 *big, *big_enc, *big_dec;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 0) | 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n packets] [-s seed]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	diag_hdlc_init();
+
+	for (n = 0; n < nr; n++) {
+		len = rnd() % (MAX_PKT + 1);
+		fill_pkt(pkt, len);
+		len = check_encode(pkt, len, enc, n);
+		check_decode(enc, len, n);
+	}
+	printf("%u packets: encode and decode match\n", nr);
+
+	big = malloc(BENCH_SIZE);
+	big_enc = malloc(2 * BENCH_SIZE + 8);
+	big_dec = malloc(BENCH_SIZE + 8);
+	for (i = 0; i < BENCH_SIZE; i++)
+		big[i] = rnd() % 4 ? 0 : rnd();
+
+	printf("encode: %.0f MB/s byte at a time, %.0f MB/s now\n",
+	       bench_encode(ref_hdlc_encode, big, big_enc),
+	       bench_encode(diag_hdlc_encode, big, big_enc));
+	{
+		struct diag_send_desc_type s = {
+			big, big + BENCH_SIZE - 1, DIAG_STATE_START, 1
+		};
+		struct diag_hdlc_dest_type e = {
+			big_enc, big_enc + 2 * BENCH_SIZE + 7, 0
+		};
+
+		diag_hdlc_encode(&s, &e);
+		len = (u8 *)e.dest - big_enc;
+	}
+	printf("decode: %.0f MB/s byte at a time, %.0f MB/s now\n",
+	       bench_decode(ref_hdlc_decode, big_enc, len, big_dec),
+	       bench_decode(diag_hdlc_decode, big_enc, len, big_dec));
+
+	return 0;
+}
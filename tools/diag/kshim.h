@@ -0,0 +1,37 @@
+/*
+ * Just enough of the kernel for drivers/char/diag/diagchar_hdlc.c and
+ * lib/crc-ccitt.c to build in userspace; the Makefile strips their
+ * #include <...> lines and force-includes this instead.
+ */
+#ifndef _KSHIM_H
+#define _KSHIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define EXPORT_SYMBOL(x)
+
+#define get_unaligned(p) ({			\
+	__typeof__(*(p)) __v;			\
+	memcpy(&__v, (p), sizeof(__v));		\
+	__v; })
+#define put_unaligned(v, p) do {		\
+	__typeof__(*(p)) __v = (v);		\
+	memcpy((p), &__v, sizeof(__v));		\
+} while (0)
+
+extern u16 const crc_ccitt_table[256];
+
+static inline u16 crc_ccitt_byte(u16 crc, const u8 c)
+{
+	return (crc >> 8) ^ crc_ccitt_table[(crc ^ c) & 0xff];
+}
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * ipc-bench.c -- measure ipc_router loopback message rate and server
+ * lookup latency from N threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Run it on the target, here with up to four threads:
+ *
+ *	ipc-bench -t 4
+ *
+ * Every thread binds a server socket to its own name (-S service,
+ * instance -I plus the thread number) and opens a client socket.  For
+ * -d seconds it then sends -s byte messages from the client to its
+ * server by name and reads each one back.  Every send resolves the name
+ * in the server list and queues the message on the local port through
+ * loopback_data(); no transport is involved.  The threads share nothing
+ * but the router's own tables, so what does not scale is their locking.
+ *
+ * A second phase has every thread call IPC_ROUTER_IOCTL_LOOKUP_SERVER
+ * for its name in a loop, which is the name lookup alone.
+ *
+ * Passes run with 1, 2, 4 ... -t threads and report messages per second
+ * over all threads with the scaling against one thread, and lookups per
+ * second with the average and slowest single lookup.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+/* from include/linux/msm_ipc.h, which is not exported */
+struct msm_ipc_port_addr {
+	uint32_t	node_id;
+	uint32_t	port_id;
+};
+
+struct msm_ipc_port_name {
+	uint32_t	service;
+	uint32_t	instance;
+};
+
+struct msm_ipc_addr {
+	unsigned char	addrtype;
+	union {
+		struct msm_ipc_port_addr port_addr;
+		struct msm_ipc_port_name port_name;
+	} addr;
+};
+
+struct sockaddr_msm_ipc {
+	unsigned short	family;
+	struct msm_ipc_addr address;
+	unsigned char	reserved;
+};
+
+struct server_lookup_args {
+	struct msm_ipc_port_name port_name;
+	int		num_entries_in_array;
+	int		num_entries_found;
+	uint32_t	lookup_mask;
+	struct msm_ipc_port_addr port_addr[0];
+};
+
+#define AF_MSM_IPC		27
+#define MSM_IPC_ADDR_NAME	1
+#define IPC_ROUTER_IOCTL_MAGIC	(0xC3)
+#define IPC_ROUTER_IOCTL_LOOKUP_SERVER \
+	_IOWR(IPC_ROUTER_IOCTL_MAGIC, 2, struct sockaddr_msm_ipc)
+
+struct thread {
+	pthread_t	thread;
+	unsigned	nr;
+	int		server;
+	int		client;
+	struct sockaddr_msm_ipc name;
+	unsigned long	msgs;
+	unsigned long	lookups;
+	double		lookup_time;
+	double		lookup_max;
+};
+
+static pthread_barrier_t barrier;
+static volatile int stop;
+static unsigned service = 0x4242;
+static unsigned instance = 1;
+static unsigned size = 64;
+static unsigned duration = 2;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void open_pair(struct thread *t)
+{
+	t->name.family = AF_MSM_IPC;
+	t->name.address.addrtype = MSM_IPC_ADDR_NAME;
+	t->name.address.addr.port_name.service = service;
+	t->name.address.addr.port_name.instance = instance + t->nr;
+
+	t->server = socket(AF_MSM_IPC, SOCK_DGRAM, 0);
+	t->client = socket(AF_MSM_IPC, SOCK_DGRAM, 0);
+	if (t->server < 0 || t->client < 0)
+		die("socket(AF_MSM_IPC)");
+	if (bind(t->server, (struct sockaddr *)&t->name, sizeof(t->name)) < 0)
+		die("bind");
+}
+
+static void *sender(void *arg)
+{
+	struct thread *t = arg;
+	char *buf = malloc(size);
+
+	if (!buf)
+		die("malloc");
+	memset(buf, 0x5a, size);
+	pthread_barrier_wait(&barrier);
+	while (!stop) {
+		if (sendto(t->client, buf, size, 0, (struct sockaddr *)&t->name,
+			   sizeof(t->name)) < 0)
+			die("sendto");
+		if (recv(t->server, buf, size, 0) != (ssize_t)size)
+			die("recv");
+		t->msgs++;
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *lookup(void *arg)
+{
+	struct thread *t = arg;
+	struct {
+		struct server_lookup_args args;
+		struct msm_ipc_port_addr addr[1];
+	} req;
+	double start;
+
+	pthread_barrier_wait(&barrier);
+	while (!stop) {
+		memset(&req, 0, sizeof(req));
+		req.args.port_name = t->name.address.addr.port_name;
+		req.args.num_entries_in_array = 1;
+		start = now();
+		if (ioctl(t->client, IPC_ROUTER_IOCTL_LOOKUP_SERVER, &req) < 0)
+			die("IPC_ROUTER_IOCTL_LOOKUP_SERVER");
+		start = now() - start;
+		if (req.args.num_entries_found != 1) {
+			fprintf(stderr, "%08x:%08x: %d servers found\n",
+				req.args.port_name.service,
+				req.args.port_name.instance,
+				req.args.num_entries_found);
+			exit(1);
+		}
+		t->lookup_time += start;
+		if (start > t->lookup_max)
+			t->lookup_max = start;
+		t->lookups++;
+	}
+	return NULL;
+}
+
+/* run @fn on @nr threads at once for duration seconds */
+static void phase(struct thread *threads, unsigned nr, void *(*fn)(void *))
+{
+	unsigned i;
+
+	stop = 0;
+	pthread_barrier_init(&barrier, NULL, nr + 1);
+	for (i = 0; i < nr; i++)
+		pthread_create(&threads[i].thread, NULL, fn, &threads[i]);
+	pthread_barrier_wait(&barrier);
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].thread, NULL);
+	pthread_barrier_destroy(&barrier);
+}
+
+static void run(unsigned nr)
+{
+	static double base;
+	struct thread *threads;
+	unsigned long msgs = 0, lookups = 0;
+	double rate, lookup_time = 0, max = 0;
+	unsigned i;
+
+	threads = calloc(nr, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	for (i = 0; i < nr; i++) {
+		threads[i].nr = i;
+		open_pair(&threads[i]);
+	}
+
+	phase(threads, nr, sender);
+	phase(threads, nr, lookup);
+	for (i = 0; i < nr; i++) {
+		msgs += threads[i].msgs;
+		lookups += threads[i].lookups;
+		lookup_time += threads[i].lookup_time;
+		if (threads[i].lookup_max > max)
+			max = threads[i].lookup_max;
+		close(threads[i].client);
+		close(threads[i].server);
+	}
+	free(threads);
+
+	rate = msgs / (double)duration;
+	if (!base)
+		base = rate;
+	printf("%u threads: %.0f msgs/s (%.2fx), %.0f lookups/s, "
+	       "avg %.1f us, max %.0f us\n", nr, rate, rate / base,
+	       lookups / (double)duration,
+	       lookups ? lookup_time * 1e6 / lookups : 0, max * 1e6);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t max-threads] [-s msg-size] "
+		"[-d seconds] [-S service] [-I instance]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned threads = sysconf(_SC_NPROCESSORS_ONLN), nr;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:d:S:I:")) != -1) {
+		switch (c) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			service = strtoul(optarg, NULL, 0);
+			break;
+		case 'I':
+			instance = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !threads || !size || !duration)
+		usage(argv[0]);
+
+	for (nr = 1; ; nr *= 2) {
+		if (nr > threads)
+			nr = threads;
+		run(nr);
+		if (nr == threads)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * smd-pkt-ring.c -- exercise the smd_pkt mmap()ed receive ring against
+ * the modem's loopback channel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Run it on the target; the modem echoes every packet written to the
+ * LOOPBACK channel:
+ *
+ *	smd-pkt-ring -c 10000 /dev/smd_pkt_loopback
+ *
+ * The ring is set up with SMD_PKT_IOCTL_RX_RING (-n buffers of -b bytes)
+ * and mapped.  Packets of random length, each carrying its sequence
+ * number and a pattern derived from it, are then written with up to -w
+ * of them in flight.  The echoes are waited for with poll() and taken
+ * straight from the ring; no read() is made.  Every packet must come
+ * back once, whole and in order, and the ring's produced index must
+ * never run more than nr_bufs ahead of consumed.
+ *
+ * With -o every sixteenth packet is longer than a ring buffer holds.
+ * The driver must drop it and count it in dropped instead.
+ *
+ * At the end the packets per second, MB/s and, with -w 1, the average
+ * and slowest round trip are printed.  The exit status is 1 on the
+ * first mismatch or timeout.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+/* from include/linux/msm_smd_pkt.h, which is not exported */
+struct smd_pkt_rx_ring_req {
+	uint32_t	nr_bufs;
+	uint32_t	buf_size;
+};
+
+struct smd_pkt_rx_ring {
+	uint32_t	nr_bufs;
+	uint32_t	buf_size;
+	uint32_t	data_offset;
+	uint32_t	produced;
+	uint32_t	consumed;
+	uint32_t	dropped;
+};
+
+#define SMD_PKT_IOCTL_MAGIC	(0xC2)
+#define SMD_PKT_IOCTL_BLOCKING_WRITE \
+	_IOR(SMD_PKT_IOCTL_MAGIC, 0, unsigned int)
+#define SMD_PKT_IOCTL_RX_RING \
+	_IOW(SMD_PKT_IOCTL_MAGIC, 1, struct smd_pkt_rx_ring_req)
+
+#define TIMEOUT_MS	2000
+#define OVERSIZE_EVERY	16
+
+static unsigned nr_bufs = 16;
+static unsigned buf_size = 2048;
+static unsigned count = 1000;
+static unsigned window = 4;
+static int oversize;
+
+static volatile struct smd_pkt_rx_ring *ring;
+static char *pkt;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_oversize(unsigned seq)
+{
+	return oversize && seq % OVERSIZE_EVERY == OVERSIZE_EVERY - 1;
+}
+
+/* length of packet @seq: 4..buf_size - 4, or one more than that */
+static unsigned pkt_len(unsigned seq)
+{
+	unsigned max = buf_size - 4;
+
+	if (is_oversize(seq))
+		return max + 1 + seq % 64;
+	return 4 + (seq * 2654435761u >> 8) % (max - 3);
+}
+
+static void fill(char *p, unsigned seq, unsigned len)
+{
+	unsigned i;
+
+	memcpy(p, &seq, 4);
+	for (i = 4; i < len; i++)
+		p[i] = seq + i;
+}
+
+static void send_pkt(int fd, unsigned seq)
+{
+	unsigned len = pkt_len(seq);
+
+	fill(pkt, seq, len);
+	if (write(fd, pkt, len) != (ssize_t)len)
+		die("write");
+}
+
+/* check the buffer the ring holds at @idx against packet @seq */
+static void check(unsigned idx, unsigned seq)
+{
+	const char *buf = (const char *)ring + ring->data_offset +
+			  (size_t)(idx & (ring->nr_bufs - 1)) * ring->buf_size;
+	unsigned len = pkt_len(seq), got_len, got_seq, i;
+
+	memcpy(&got_len, buf, 4);
+	memcpy(&got_seq, buf + 4, 4);
+	if (got_len != len || got_seq != seq) {
+		fprintf(stderr, "buffer %u: packet %u of %u bytes, "
+			"expected %u of %u\n", idx, got_seq, got_len, seq, len);
+		exit(1);
+	}
+	for (i = 4; i < len; i++) {
+		if (buf[4 + i] != (char)(seq + i)) {
+			fprintf(stderr, "packet %u: byte %u is %02x, "
+				"expected %02x\n", seq, i,
+				(unsigned char)buf[4 + i],
+				(unsigned char)(seq + i));
+			exit(1);
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n bufs] [-b buf-size] [-c packets] "
+		"[-w window] [-o] device\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct smd_pkt_rx_ring_req req;
+	unsigned sent = 0, seq = 0, consumed = 0, produced, dropped = 0;
+	unsigned long long bytes = 0;
+	double start, rtt, rtt_total = 0, rtt_max = 0, sent_at = 0, t;
+	size_t map_len, page = sysconf(_SC_PAGESIZE);
+	struct pollfd pfd;
+	int fd, c, one = 1;
+	void *map;
+
+	while ((c = getopt(argc, argv, "n:b:c:w:o")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_bufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			buf_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			oversize = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !count || !window || buf_size < 16 ||
+	    buf_size % 4 || !nr_bufs || (nr_bufs & (nr_bufs - 1)))
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0)
+		die(argv[optind]);
+	if (ioctl(fd, SMD_PKT_IOCTL_BLOCKING_WRITE, &one) < 0)
+		die("SMD_PKT_IOCTL_BLOCKING_WRITE");
+	req.nr_bufs = nr_bufs;
+	req.buf_size = buf_size;
+	if (ioctl(fd, SMD_PKT_IOCTL_RX_RING, &req) < 0)
+		die("SMD_PKT_IOCTL_RX_RING");
+
+	/* the header says where the buffers start, map it first */
+	map = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		die("mmap");
+	ring = map;
+	if (ring->nr_bufs != nr_bufs || ring->buf_size != buf_size) {
+		fprintf(stderr, "ring is %u x %u, asked for %u x %u\n",
+			ring->nr_bufs, ring->buf_size, nr_bufs, buf_size);
+		return 1;
+	}
+	map_len = (ring->data_offset + (size_t)nr_bufs * buf_size +
+		   page - 1) / page * page;
+	munmap(map, page);
+	map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		die("mmap");
+	ring = map;
+	consumed = ring->consumed;
+
+	pkt = malloc(buf_size + 64);
+	if (!pkt)
+		die("malloc");
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	start = now();
+	while (seq < count) {
+		while (sent < count && sent - seq < window) {
+			if (window == 1)
+				sent_at = now();
+			send_pkt(fd, sent++);
+		}
+
+		/* a drop alone wakes nobody, so look before sleeping */
+		if (ring->produced == consumed && ring->dropped == dropped) {
+			c = poll(&pfd, 1, TIMEOUT_MS);
+			if (c < 0)
+				die("poll");
+			if (pfd.revents & POLLERR) {
+				fprintf(stderr, "channel reset\n");
+				return 1;
+			}
+			if (!c && ring->dropped == dropped) {
+				fprintf(stderr, "no echo of packet %u in "
+					"%u ms\n", seq, TIMEOUT_MS);
+				return 1;
+			}
+		}
+
+		produced = ring->produced;
+		__sync_synchronize();
+		if (produced - consumed > nr_bufs) {
+			fprintf(stderr, "produced %u runs more than %u ahead "
+				"of consumed %u\n", produced, nr_bufs,
+				consumed);
+			return 1;
+		}
+
+		/* oversized packets are counted, never put in the ring */
+		while (seq < sent && is_oversize(seq) &&
+		       ring->dropped != dropped) {
+			dropped++;
+			seq++;
+		}
+		while (consumed != produced && seq < sent) {
+			while (is_oversize(seq)) {
+				if (ring->dropped == dropped) {
+					fprintf(stderr, "packet %u was too "
+						"big but not dropped\n", seq);
+					return 1;
+				}
+				dropped++;
+				seq++;
+			}
+			check(consumed, seq);
+			bytes += pkt_len(seq);
+			seq++;
+			__sync_synchronize();
+			ring->consumed = ++consumed;
+		}
+		if (window == 1 && seq == sent) {
+			rtt = now() - sent_at;
+			rtt_total += rtt;
+			if (rtt > rtt_max)
+				rtt_max = rtt;
+		}
+	}
+	t = now() - start;
+
+	if (ring->dropped != dropped) {
+		fprintf(stderr, "dropped %u, expected %u\n", ring->dropped,
+			dropped);
+		return 1;
+	}
+	printf("%u packets OK, %u dropped as too big: %.0f pkt/s, %.2f MB/s\n",
+	       count, dropped, count / t, bytes / 1e6 / t);
+	if (window == 1)
+		printf("round trip avg %.0f us, max %.0f us\n",
+		       rtt_total * 1e6 / count, rtt_max * 1e6);
+
+	munmap(map, map_len);
+	close(fd);
+	return 0;
+}
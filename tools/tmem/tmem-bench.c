@@ -0,0 +1,238 @@
+/*
+ * tmem-bench.c -- drive cleancache puts and gets from N threads at once,
+ * to measure lock contention in the zcache and qcache backends.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Run it on a filesystem that uses cleancache (ext3, ext4, btrfs,
+ * ocfs2) with zcache or qcache enabled:
+ *
+ *	tmem-bench -t 4 -s 64 /data/local/tmp
+ *
+ * Every thread gets its own -s MB file.  A round then has two phases,
+ * with all threads starting each phase together:
+ *
+ *	put	posix_fadvise(POSIX_FADV_DONTNEED) drops the file's clean
+ *		pages from the page cache; each one goes through
+ *		__delete_from_page_cache() into cleancache_put_page()
+ *	get	the file is read back; every page readahead brings in is
+ *		first looked up with cleancache_get_page()
+ *
+ * Passes run with 1, 2, 4 ... -t threads and report pages per second
+ * for both phases over all threads.  The cleancache counters are
+ * printed with each pass: gets only measure tmem while failed_gets
+ * stays near zero, otherwise the pages came from the disk.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SIZE	4096
+#define CHUNK		(256 * 1024)
+#define CLEANCACHE	"/sys/kernel/mm/cleancache/"
+
+struct thread {
+	pthread_t	thread;
+	char		path[256];
+	off_t		size;
+};
+
+static pthread_barrier_t barrier;
+static unsigned rounds = 4;
+static double put_time, get_time;
+static pthread_mutex_t time_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long cleancache(const char *stat)
+{
+	unsigned long val = 0;
+	char path[128];
+	FILE *f;
+
+	snprintf(path, sizeof(path), CLEANCACHE "%s", stat);
+	f = fopen(path, "r");
+	if (f) {
+		if (fscanf(f, "%lu", &val) != 1)
+			val = 0;
+		fclose(f);
+	}
+	return val;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* Text-like data, so that pages compress the way file pages do */
+static void create(const char *path, off_t size)
+{
+	static const char words[] = "the of and to in is that for it as "
+		"with was on be by this are from or which an at not";
+	char *buf = malloc(CHUNK);
+	unsigned seed = size;
+	off_t off;
+	int fd, i;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0 || !buf)
+		die(path);
+	for (off = 0; off < size; off += CHUNK) {
+		for (i = 0; i < CHUNK; i++) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = (seed >> 16) % 8 ? words[(seed >> 8) %
+				(sizeof(words) - 1)] : (char)(seed >> 8);
+		}
+		if (write(fd, buf, CHUNK) != CHUNK)
+			die(path);
+	}
+	fsync(fd);
+	close(fd);
+	free(buf);
+}
+
+static void read_all(int fd, char *buf)
+{
+	off_t off = 0;
+	ssize_t len;
+
+	while ((len = pread(fd, buf, CHUNK, off)) > 0)
+		off += len;
+	if (len < 0)
+		die("read");
+}
+
+static void *worker(void *arg)
+{
+	struct thread *t = arg;
+	double start, put = 0, get = 0;
+	char *buf = malloc(CHUNK);
+	unsigned r;
+	int fd;
+
+	fd = open(t->path, O_RDONLY);
+	if (fd < 0 || !buf)
+		die(t->path);
+	/* make sure every page is in the page cache to begin with */
+	read_all(fd, buf);
+
+	for (r = 0; r < rounds; r++) {
+		pthread_barrier_wait(&barrier);
+		start = now();
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		put += now() - start;
+
+		pthread_barrier_wait(&barrier);
+		start = now();
+		read_all(fd, buf);
+		get += now() - start;
+	}
+
+	pthread_mutex_lock(&time_lock);
+	put_time += put;
+	get_time += get;
+	pthread_mutex_unlock(&time_lock);
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static void run(struct thread *threads, unsigned nr)
+{
+	unsigned long puts, gets, failed;
+	double pages;
+	unsigned i;
+
+	put_time = get_time = 0;
+	puts = cleancache("puts");
+	gets = cleancache("succ_gets");
+	failed = cleancache("failed_gets");
+
+	pthread_barrier_init(&barrier, NULL, nr);
+	for (i = 0; i < nr; i++)
+		pthread_create(&threads[i].thread, NULL, worker, &threads[i]);
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].thread, NULL);
+	pthread_barrier_destroy(&barrier);
+
+	/* per thread time, so divide the total back out */
+	pages = (double)threads[0].size / PAGE_SIZE * rounds * nr;
+	printf("%u threads: put %.0f pages/s, get %.0f pages/s "
+	       "(puts %lu, succ_gets %lu, failed_gets %lu)\n", nr,
+	       pages / (put_time / nr), pages / (get_time / nr),
+	       cleancache("puts") - puts, cleancache("succ_gets") - gets,
+	       cleancache("failed_gets") - failed);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t max-threads] [-s size-mb] "
+		"[-r rounds] dir\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned nr_threads = sysconf(_SC_NPROCESSORS_ONLN), nr, i;
+	off_t size = 64 << 20;
+	struct thread *threads;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:r:")) != -1) {
+		switch (c) {
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = (off_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !nr_threads || !size || !rounds)
+		usage(argv[0]);
+	if (access(CLEANCACHE "puts", R_OK))
+		fprintf(stderr, "warning: no cleancache in this kernel\n");
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	for (i = 0; i < nr_threads; i++) {
+		snprintf(threads[i].path, sizeof(threads[i].path),
+			 "%s/tmem-bench.%u", argv[optind], i);
+		threads[i].size = (size + CHUNK - 1) / CHUNK * CHUNK;
+		create(threads[i].path, threads[i].size);
+	}
+
+	for (nr = 1; ; nr *= 2) {
+		if (nr > nr_threads)
+			nr = nr_threads;
+		run(threads, nr);
+		if (nr == nr_threads)
+			break;
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		unlink(threads[i].path);
+	return 0;
+}
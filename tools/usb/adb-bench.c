@@ -0,0 +1,356 @@
+/*
+ * adb-bench.c -- measure f_adb throughput through read()/write() and
+ * through splice().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Both ends run on one machine through dummy_hcd, as for mtp-bench:
+ * the gadget side moves a file through /dev/android_adb, the host side
+ * streams the bulk endpoints through usbfs.  No adb protocol is spoken,
+ * only the data is timed.
+ *
+ * Build the kernel with CONFIG_USB_GADGET_DUMMY_HCD=y as the UDC and
+ * CONFIG_USB_G_ANDROID=y, on a board whose file registers the
+ * android_usb platform device, and enable adb alone:
+ *
+ *	echo 0 > /sys/class/android_usb/android0/enable
+ *	echo adb > /sys/class/android_usb/android0/functions
+ *	echo 1 > /sys/class/android_usb/android0/enable
+ *
+ * then, with BUS/DEV of the new device as lsusb shows it, for a pull:
+ *
+ *	adb-bench host-read /dev/bus/usb/BUS/DEV $((1 << 30)) &
+ *	adb-bench write /data/1G.bin		(or: splice /data/1G.bin)
+ *
+ * and for a push:
+ *
+ *	adb-bench host-write /dev/bus/usb/BUS/DEV $((1 << 30)) &
+ *	adb-bench read /data/out.bin $((1 << 30))
+ *						(or: splice-read ...)
+ *
+ * The gadget modes are:
+ *
+ *	write		read() the file and write() it to adb, -b bytes
+ *			per call, the way adbd sends a file
+ *	splice		splice() the file to a pipe and the pipe to adb,
+ *			which goes through adb_splice_write()
+ *	read		read() adb -b bytes per call and write() the file
+ *	splice-read	splice() adb to a pipe and the pipe to the file;
+ *			f_adb has no splice_read, so this measures the
+ *			generic one, which calls adb_read() once per page
+ *
+ * f_adb keeps a single rx request, queued by each adb_read() and sized
+ * to it, so read and splice-read see one request round trip per call;
+ * the per-call time printed with them shows what that costs against
+ * the size of the call.  -b is at most 16384, the f_adb request size.
+ *
+ * Both sides print MB/s.  The host side keeps -q URBs of -B bytes in
+ * flight and, like the adb host, ends no transfer with a zero length
+ * packet.  With dummy_hcd the link has no line rate, the numbers show
+ * the cost of the gadget's request handling and copies.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <linux/usb/ch9.h>
+#include <linux/usbdevice_fs.h>
+
+#define ADB_DEV		"/dev/android_adb"
+#define ADB_MAX_CALL	16384		/* ADB_BULK_BUFFER_SIZE */
+#define SPLICE_LEN	65536
+#define MAX_URBS	32
+
+static unsigned buflen = ADB_MAX_CALL;
+static unsigned urb_len = 65536;
+static unsigned nr_urbs = 8;
+static unsigned intf;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, long long bytes, double secs,
+		   unsigned long calls)
+{
+	printf("%s: %lld bytes in %.2f s, %.1f MB/s", what, bytes, secs,
+	       bytes / 1e6 / secs);
+	if (calls)
+		printf(", %lu calls, %.1f us per call", calls,
+		       secs * 1e6 / calls);
+	printf("\n");
+}
+
+/* move @length bytes with read() and write(), @buflen at a time */
+static unsigned long copy(int in, int out, long long length)
+{
+	unsigned long calls = 0;
+	char *buf = malloc(buflen);
+	ssize_t len;
+	size_t want;
+
+	if (!buf)
+		die("malloc");
+	while (length > 0) {
+		want = length < buflen ? length : buflen;
+		len = read(in, buf, want);
+		if (len <= 0)
+			die("read");
+		if (write(out, buf, len) != len)
+			die("write");
+		length -= len;
+		calls++;
+	}
+	free(buf);
+	return calls;
+}
+
+/* move @length bytes from @in to @out through a pipe */
+static unsigned long splice_all(int in, int out, long long length)
+{
+	unsigned long calls = 0;
+	ssize_t len, done;
+	size_t want;
+	int pfd[2];
+
+	if (pipe(pfd) < 0)
+		die("pipe");
+	while (length > 0) {
+		want = length < SPLICE_LEN ? length : SPLICE_LEN;
+		len = splice(in, NULL, pfd[1], NULL, want, SPLICE_F_MOVE);
+		if (len <= 0)
+			die("splice in");
+		for (done = 0; done < len; ) {
+			ssize_t n = splice(pfd[0], NULL, out, NULL, len - done,
+					   SPLICE_F_MOVE);
+			if (n <= 0)
+				die("splice out");
+			done += n;
+		}
+		length -= len;
+		calls++;
+	}
+	close(pfd[0]);
+	close(pfd[1]);
+	return calls;
+}
+
+static void gadget(const char *mode, const char *path, long long length)
+{
+	int tx = !strcmp(mode, "write") || !strcmp(mode, "splice");
+	int sp = !strncmp(mode, "splice", 6);
+	unsigned long calls;
+	struct stat st;
+	double t;
+	int fd, adb;
+
+	adb = open(ADB_DEV, O_RDWR);
+	if (adb < 0)
+		die(ADB_DEV);
+	if (tx) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0)
+			die(path);
+		length = st.st_size;
+		/* keep file reads out of the picture */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	} else {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			die(path);
+	}
+
+	t = now();
+	if (sp)
+		calls = tx ? splice_all(fd, adb, length) :
+			     splice_all(adb, fd, length);
+	else
+		calls = tx ? copy(fd, adb, length) : copy(adb, fd, length);
+	if (!tx)
+		fsync(fd);
+	/* splice calls are per SPLICE_LEN, not per adb request */
+	report(mode, length, now() - t, sp ? 0 : calls);
+	close(fd);
+	close(adb);
+}
+
+/*
+ * Walk the configuration descriptors usbfs returns after the device
+ * descriptor and pick the first bulk endpoint of interface @intf in
+ * the wanted direction.
+ */
+static unsigned find_ep(int fd, unsigned dir)
+{
+	unsigned char buf[4096], *p, *end;
+	int in_intf = 0;
+	ssize_t len;
+
+	len = read(fd, buf, sizeof(buf));
+	if (len < (ssize_t)USB_DT_DEVICE_SIZE)
+		die("read descriptors");
+	end = buf + len;
+	for (p = buf + USB_DT_DEVICE_SIZE; p + 2 <= end && p[0]; p += p[0]) {
+		if (p[1] == USB_DT_INTERFACE)
+			in_intf = p[2] == intf && p[3] == 0;
+		else if (p[1] == USB_DT_ENDPOINT && in_intf &&
+			 (p[3] & USB_ENDPOINT_XFERTYPE_MASK) ==
+			 USB_ENDPOINT_XFER_BULK &&
+			 (p[2] & USB_ENDPOINT_DIR_MASK) == dir)
+			return p[2];
+	}
+	fprintf(stderr, "interface %u has no bulk %s endpoint\n", intf,
+		dir == USB_DIR_IN ? "in" : "out");
+	exit(1);
+}
+
+/* host side: keep nr_urbs bulk URBs in flight until @length is moved */
+static void host(int in, const char *path, long long length)
+{
+	struct usbdevfs_urb urbs[MAX_URBS], *urb;
+	long long queued = 0, done = 0;
+	unsigned i, ep, busy = 0;
+	double t = 0;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		die(path);
+	if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &intf) < 0)
+		die("USBDEVFS_CLAIMINTERFACE");
+	ep = find_ep(fd, in ? USB_DIR_IN : USB_DIR_OUT);
+
+	memset(urbs, 0, sizeof(urbs));
+	for (i = 0; i < nr_urbs; i++) {
+		urbs[i].type = USBDEVFS_URB_TYPE_BULK;
+		urbs[i].endpoint = ep;
+		urbs[i].buffer = malloc(urb_len);
+		if (!urbs[i].buffer)
+			die("malloc");
+		memset(urbs[i].buffer, 0x5a, urb_len);
+	}
+
+	for (i = 0; i < nr_urbs && queued < length; i++, busy++) {
+		urbs[i].buffer_length = length - queued < urb_len ?
+					length - queued : urb_len;
+		if (ioctl(fd, USBDEVFS_SUBMITURB, &urbs[i]) < 0)
+			die("USBDEVFS_SUBMITURB");
+		queued += urbs[i].buffer_length;
+	}
+
+	while (busy) {
+		if (ioctl(fd, USBDEVFS_REAPURB, &urb) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("USBDEVFS_REAPURB");
+		}
+		busy--;
+		if (urb->status) {
+			fprintf(stderr, "urb failed: %d\n", urb->status);
+			exit(1);
+		}
+		/*
+		 * The clock starts at the first completion, when the gadget
+		 * side is moving data, so the host can be started first.
+		 */
+		if (!done)
+			t = now();
+		done += urb->actual_length;
+		if (in && urb->actual_length < urb->buffer_length) {
+			fprintf(stderr, "short read after %lld bytes\n", done);
+			exit(1);
+		}
+		if (queued < length) {
+			urb->buffer_length = length - queued < urb_len ?
+					     length - queued : urb_len;
+			if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0)
+				die("USBDEVFS_SUBMITURB");
+			queued += urb->buffer_length;
+			busy++;
+		}
+	}
+	report(in ? "host read" : "host write", done, now() - t, 0);
+
+	ioctl(fd, USBDEVFS_RELEASEINTERFACE, &intf);
+	close(fd);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-b call-len] write|splice file\n"
+		"       %s [-b call-len] read|splice-read file length\n"
+		"       %s [-B urb-len] [-q urbs] [-i interface] "
+		"host-read|host-write /dev/bus/usb/BUS/DEV length\n",
+		prog, prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode;
+	long long length = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:B:q:i:")) != -1) {
+		switch (c) {
+		case 'b':
+			buflen = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			urb_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			nr_urbs = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			intf = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!buflen || buflen > ADB_MAX_CALL || !urb_len || !nr_urbs ||
+	    nr_urbs > MAX_URBS || optind >= argc)
+		usage(argv[0]);
+
+	mode = argv[optind];
+	if (argc - optind == 3)
+		length = strtoll(argv[optind + 2], NULL, 0);
+
+	if ((!strcmp(mode, "write") || !strcmp(mode, "splice")) &&
+	    argc - optind == 2)
+		gadget(mode, argv[optind + 1], 0);
+	else if ((!strcmp(mode, "read") || !strcmp(mode, "splice-read")) &&
+		 length > 0)
+		gadget(mode, argv[optind + 1], length);
+	else if (!strcmp(mode, "host-read") && length > 0)
+		host(1, argv[optind + 1], length);
+	else if (!strcmp(mode, "host-write") && length > 0)
+		host(0, argv[optind + 1], length);
+	else
+		usage(argv[0]);
+	return 0;
+}
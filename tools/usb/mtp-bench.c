@@ -0,0 +1,279 @@
+/*
+ * mtp-bench.c -- measure f_mtp file transfer throughput.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Both ends run on one machine through dummy_hcd: the gadget side
+ * hands a file to f_mtp with MTP_SEND_FILE or MTP_RECEIVE_FILE, the
+ * host side streams the bulk endpoints through usbfs.  No MTP
+ * protocol is spoken, only the file data phase is timed.
+ *
+ * Build the kernel with CONFIG_USB_GADGET_DUMMY_HCD=y as the UDC and
+ * CONFIG_USB_G_ANDROID=y, on a board whose file registers the
+ * android_usb platform device, and enable mtp alone:
+ *
+ *	echo 0 > /sys/class/android_usb/android0/enable
+ *	echo mtp > /sys/class/android_usb/android0/functions
+ *	echo 1 > /sys/class/android_usb/android0/enable
+ *
+ * then, with BUS/DEV of the new device as lsusb shows it:
+ *
+ *	mtp-bench host-read /dev/bus/usb/BUS/DEV $((1 << 30)) &
+ *	mtp-bench send /data/1G.bin
+ *
+ *	mtp-bench host-write /dev/bus/usb/BUS/DEV $((1 << 30)) &
+ *	mtp-bench receive /data/out.bin $((1 << 30))
+ *
+ * Both sides print MB/s; the gadget side figure is the one to compare
+ * across mtp_tx_req_len, mtp_tx_reqs, mtp_rx_req_len and mtp_rx_reqs.
+ * The host side keeps -q URBs of -b bytes in flight, so it is not the
+ * bottleneck.  With dummy_hcd the link has no line rate, the numbers
+ * show the cost of the gadget's request handling and file I/O.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <linux/usb/ch9.h>
+#include <linux/usbdevice_fs.h>
+
+/* from include/linux/usb/f_mtp.h, which is not exported */
+struct mtp_file_range {
+	int		fd;
+	loff_t		offset;
+	int64_t		length;
+	uint16_t	command;
+	uint32_t	transaction_id;
+};
+
+#define MTP_SEND_FILE		_IOW('M', 0, struct mtp_file_range)
+#define MTP_RECEIVE_FILE	_IOW('M', 1, struct mtp_file_range)
+
+#define MTP_DEV		"/dev/mtp_usb"
+#define MAX_URBS	32
+
+static unsigned buflen = 65536;
+static unsigned nr_urbs = 8;
+static unsigned intf;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, long long bytes, double secs)
+{
+	printf("%s: %lld bytes in %.2f s, %.1f MB/s\n", what, bytes, secs,
+	       bytes / 1e6 / secs);
+}
+
+/* gadget side: f_mtp does the whole transfer inside the ioctl */
+static void gadget(int cmd, const char *path, long long length)
+{
+	struct mtp_file_range mfr;
+	struct stat st;
+	double t;
+	int fd, mtp;
+
+	mtp = open(MTP_DEV, O_RDWR);
+	if (mtp < 0)
+		die(MTP_DEV);
+	if (cmd == MTP_SEND_FILE) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0)
+			die(path);
+		length = st.st_size;
+	} else {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			die(path);
+	}
+
+	memset(&mfr, 0, sizeof(mfr));
+	mfr.fd = fd;
+	mfr.length = length;
+	t = now();
+	if (ioctl(mtp, cmd, &mfr) < 0)
+		die(cmd == MTP_SEND_FILE ? "MTP_SEND_FILE" :
+		    "MTP_RECEIVE_FILE");
+	if (cmd == MTP_RECEIVE_FILE)
+		fsync(fd);
+	report(cmd == MTP_SEND_FILE ? "send" : "receive", length, now() - t);
+	close(fd);
+	close(mtp);
+}
+
+/*
+ * Walk the configuration descriptors usbfs returns after the device
+ * descriptor and pick the first bulk endpoint of interface @intf in
+ * the wanted direction.
+ */
+static unsigned find_ep(int fd, unsigned dir)
+{
+	unsigned char buf[4096], *p, *end;
+	int in_intf = 0;
+	ssize_t len;
+
+	len = read(fd, buf, sizeof(buf));
+	if (len < (ssize_t)USB_DT_DEVICE_SIZE)
+		die("read descriptors");
+	end = buf + len;
+	for (p = buf + USB_DT_DEVICE_SIZE; p + 2 <= end && p[0]; p += p[0]) {
+		if (p[1] == USB_DT_INTERFACE)
+			in_intf = p[2] == intf && p[3] == 0;
+		else if (p[1] == USB_DT_ENDPOINT && in_intf &&
+			 (p[3] & USB_ENDPOINT_XFERTYPE_MASK) ==
+			 USB_ENDPOINT_XFER_BULK &&
+			 (p[2] & USB_ENDPOINT_DIR_MASK) == dir)
+			return p[2];
+	}
+	fprintf(stderr, "interface %u has no bulk %s endpoint\n", intf,
+		dir == USB_DIR_IN ? "in" : "out");
+	exit(1);
+}
+
+/* host side: keep nr_urbs bulk URBs in flight until @length is moved */
+static void host(int in, const char *path, long long length)
+{
+	struct usbdevfs_urb urbs[MAX_URBS], *urb;
+	long long queued = 0, done = 0;
+	unsigned i, ep, busy = 0;
+	double t = 0;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		die(path);
+	if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &intf) < 0)
+		die("USBDEVFS_CLAIMINTERFACE");
+	ep = find_ep(fd, in ? USB_DIR_IN : USB_DIR_OUT);
+
+	memset(urbs, 0, sizeof(urbs));
+	for (i = 0; i < nr_urbs; i++) {
+		urbs[i].type = USBDEVFS_URB_TYPE_BULK;
+		urbs[i].endpoint = ep;
+		urbs[i].buffer = malloc(buflen);
+		if (!urbs[i].buffer)
+			die("malloc");
+		memset(urbs[i].buffer, 0x5a, buflen);
+	}
+
+	for (i = 0; i < nr_urbs && queued < length; i++, busy++) {
+		urbs[i].buffer_length = length - queued < buflen ?
+					length - queued : buflen;
+		if (ioctl(fd, USBDEVFS_SUBMITURB, &urbs[i]) < 0)
+			die("USBDEVFS_SUBMITURB");
+		queued += urbs[i].buffer_length;
+	}
+
+	while (busy) {
+		if (ioctl(fd, USBDEVFS_REAPURB, &urb) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("USBDEVFS_REAPURB");
+		}
+		busy--;
+		if (urb->status) {
+			fprintf(stderr, "urb failed: %d\n", urb->status);
+			exit(1);
+		}
+		/*
+		 * The clock starts at the first completion, when the gadget
+		 * side is moving data, so the host can be started first.
+		 */
+		if (!done)
+			t = now();
+		done += urb->actual_length;
+		/* a short read means the gadget sent less than asked */
+		if (in && urb->actual_length < urb->buffer_length) {
+			fprintf(stderr, "short read after %lld bytes\n", done);
+			exit(1);
+		}
+		if (queued < length) {
+			urb->buffer_length = length - queued < buflen ?
+					     length - queued : buflen;
+			if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0)
+				die("USBDEVFS_SUBMITURB");
+			queued += urb->buffer_length;
+			busy++;
+		}
+	}
+	report(in ? "host read" : "host write", done, now() - t);
+
+	ioctl(fd, USBDEVFS_RELEASEINTERFACE, &intf);
+	close(fd);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s send file\n"
+		"       %s receive file length\n"
+		"       %s [-b urb-len] [-q urbs] [-i interface] "
+		"host-read|host-write /dev/bus/usb/BUS/DEV length\n",
+		prog, prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode;
+	long long length = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:q:i:")) != -1) {
+		switch (c) {
+		case 'b':
+			buflen = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			nr_urbs = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			intf = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!buflen || !nr_urbs || nr_urbs > MAX_URBS || optind >= argc)
+		usage(argv[0]);
+
+	mode = argv[optind];
+	if (argc - optind == 3)
+		length = strtoll(argv[optind + 2], NULL, 0);
+
+	if (!strcmp(mode, "send") && argc - optind == 2)
+		gadget(MTP_SEND_FILE, argv[optind + 1], 0);
+	else if (!strcmp(mode, "receive") && length > 0)
+		gadget(MTP_RECEIVE_FILE, argv[optind + 1], length);
+	else if (!strcmp(mode, "host-read") && length > 0)
+		host(1, argv[optind + 1], length);
+	else if (!strcmp(mode, "host-write") && length > 0)
+		host(0, argv[optind + 1], length);
+	else
+		usage(argv[0]);
+	return 0;
+}
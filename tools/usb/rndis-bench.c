@@ -0,0 +1,233 @@
+/*
+ * rndis-bench.c -- measure RNDIS packet rate and CPU cost per packet
+ * between the gadget and rndis_host.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Both ends run on one machine through dummy_hcd: u_ether's interface
+ * is the gadget end, rndis_host binds to the device on the host end.
+ * Build the kernel with CONFIG_USB_GADGET_DUMMY_HCD=y as the UDC,
+ * CONFIG_USB_G_ANDROID=y (on a board whose file registers the
+ * android_usb platform device) and CONFIG_USB_NET_RNDIS_HOST, then:
+ *
+ *	echo 0 > /sys/class/android_usb/android0/enable
+ *	echo rndis > /sys/class/android_usb/android0/functions
+ *	echo 1 > /sys/class/android_usb/android0/enable
+ *	ip link set rndis0 up; ip link set usb0 up
+ *
+ * where rndis0 is the gadget's interface and usb0 the one rndis_host
+ * created.  Then, for the downlink (device to host) and the uplink:
+ *
+ *	rndis-bench rndis0 usb0
+ *	rndis-bench usb0 rndis0
+ *
+ * Raw Ethernet frames of -s bytes with a local experimental ethertype
+ * are sent with AF_PACKET on the first interface, addressed to the
+ * second, and counted as they arrive there, for -d seconds.  No IP
+ * configuration is needed and nothing else answers them.  The sender
+ * sends as fast as the interface queue takes frames; rndis_dl/ul
+ * max_pkt_per_xfer decide how many of them share a transfer.
+ *
+ * Printed are packets per second sent and received, the loss, and from
+ * /proc/stat the CPU time used on all CPUs: as a percentage of one CPU
+ * and in microseconds per received packet, which is the figure to
+ * compare between aggregation settings.  It includes this program's
+ * own sending and receiving, which is the same for every setting.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#define ETH_P_BENCH	0x88b5		/* IEEE local experimental */
+
+static unsigned size = 1514;
+static unsigned duration = 10;
+static volatile int stop;
+static unsigned long received;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* busy jiffies over all CPUs */
+static unsigned long long cpu_time(void)
+{
+	unsigned long long v[8] = { 0 }, busy = 0;
+	FILE *f;
+	int i;
+
+	f = fopen("/proc/stat", "r");
+	if (!f || fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+			 &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			 &v[7]) < 7)
+		die("/proc/stat");
+	fclose(f);
+	/* all but idle and iowait */
+	for (i = 0; i < 8; i++)
+		if (i != 3 && i != 4)
+			busy += v[i];
+	return busy;
+}
+
+/*
+ * Open a raw socket bound to @ifname and return its address.  Only the
+ * receiving socket asks for frames; the sending one would otherwise get
+ * a copy of each frame it sends.
+ */
+static int open_if(const char *ifname, int rx, uint8_t *mac)
+{
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+	int fd;
+
+	fd = socket(AF_PACKET, SOCK_RAW, rx ? htons(ETH_P_BENCH) : 0);
+	if (fd < 0)
+		die("socket");
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0)
+		die(ifname);
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_ifindex = ifr.ifr_ifindex;
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0)
+		die(ifname);
+	memcpy(mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = rx ? htons(ETH_P_BENCH) : 0;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+		die("bind");
+	return fd;
+}
+
+static void *receiver(void *arg)
+{
+	int fd = *(int *)arg;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char buf[ETH_FRAME_LEN + 64];
+	struct sockaddr_ll from;
+	socklen_t len;
+
+	while (!stop) {
+		/* wake up now and then to see if we are done */
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+		for (;;) {
+			len = sizeof(from);
+			if (recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT,
+				     (struct sockaddr *)&from, &len) <= 0)
+				break;
+			if (from.sll_pkttype != PACKET_OUTGOING)
+				received++;
+		}
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s frame-size] [-d seconds] "
+		"tx-interface rx-interface\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long busy0, busy1;
+	unsigned long sent = 0, rx;
+	int tx_fd, rx_fd, c, rcvbuf = 4 << 20;
+	uint8_t tx_mac[ETH_ALEN], rx_mac[ETH_ALEN], *frame;
+	struct ethhdr *eth;
+	pthread_t thread;
+	double start, t, t_all, busy;
+	long hz = sysconf(_SC_CLK_TCK);
+
+	while ((c = getopt(argc, argv, "s:d:")) != -1) {
+		switch (c) {
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || size < ETH_ZLEN || size > ETH_FRAME_LEN ||
+	    !duration)
+		usage(argv[0]);
+
+	tx_fd = open_if(argv[optind], 0, tx_mac);
+	rx_fd = open_if(argv[optind + 1], 1, rx_mac);
+	setsockopt(rx_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	frame = calloc(1, size);
+	if (!frame)
+		die("calloc");
+	eth = (struct ethhdr *)frame;
+	memcpy(eth->h_dest, rx_mac, ETH_ALEN);
+	memcpy(eth->h_source, tx_mac, ETH_ALEN);
+	eth->h_proto = htons(ETH_P_BENCH);
+
+	pthread_create(&thread, NULL, receiver, &rx_fd);
+	busy0 = cpu_time();
+	start = now();
+	while (now() - start < duration) {
+		if (send(tx_fd, frame, size, 0) == (ssize_t)size) {
+			sent++;
+			continue;
+		}
+		/* the interface queue is full, let it drain */
+		if (errno != ENOBUFS && errno != EAGAIN)
+			die("send");
+		sched_yield();
+	}
+	t = now() - start;
+	/* give frames still in flight a moment to arrive */
+	usleep(200000);
+	t_all = now() - start;
+	busy1 = cpu_time();
+	stop = 1;
+	pthread_join(thread, NULL);
+	rx = received;
+
+	busy = (double)(busy1 - busy0) / hz;
+	printf("%s -> %s, %u byte frames, %.1f s\n", argv[optind],
+	       argv[optind + 1], size, t);
+	printf("sent %.0f pkt/s, received %.0f pkt/s (%.1f Mbit/s), "
+	       "lost %.2f%%\n", sent / t, rx / t, rx * size * 8 / t / 1e6,
+	       sent ? 100.0 * (sent - (rx < sent ? rx : sent)) / sent : 0);
+	printf("cpu: %.0f%% of one cpu, %.2f us per received packet\n",
+	       100 * busy / t_all, rx ? busy * 1e6 / rx : 0);
+	return 0;
+}
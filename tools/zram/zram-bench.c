@@ -0,0 +1,365 @@
+/*
+ * zram-bench.c -- measure how zram write throughput scales with the
+ * number of writers, and compare compression algorithms on real data.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Initialize the device first, then run, here with up to four writers
+ * over 256MB:
+ *
+ *	echo 1 > /sys/block/zram0/reset
+ *	echo $((512 << 20)) > /sys/block/zram0/disksize
+ *	zram-bench -t 4 -s 256 /dev/zram0
+ *
+ * Each pass splits the same -s MB between 1, 2, 4 ... -t threads, each
+ * writing its own part of the device with O_DIRECT, so every page goes
+ * straight to zram_make_request() from the writer's context rather
+ * than from the flusher.  Pages are filled with words from a small
+ * vocabulary, which lzo compresses about 2:1, and every page is
+ * stamped with its offset so that none is zero filled or identical to
+ * another.  The last pass is followed by a read back of the whole
+ * area.
+ *
+ * With -c the pages come from a corpus file instead, and the device is
+ * reset and set up once for every algorithm given with -a:
+ *
+ *	zram-bench -C $(pidof system_server) /data/local/tmp/anon.bin
+ *	zram-bench -c /data/local/tmp/anon.bin -a lzo,lz4,deflate /dev/zram0
+ *
+ * -C captures the corpus: the private writable anonymous mappings of a
+ * process ([heap], [stack], [anon:...] and unnamed ones) read through
+ * /proc/<pid>/mem, which is what zram gets to see as swap.  For each
+ * algorithm the corpus is written with -t threads, read back and
+ * compared, and the compression ratio (orig_data_size over
+ * compr_data_size), the memory zram used and write and read MB/s are
+ * reported.  The device is left reset.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SIZE	4096
+#define CHUNK		(64 * 1024)	/* bytes per pwrite() */
+
+struct worker {
+	pthread_t	thread;
+	int		fd;
+	off_t		start;
+	off_t		len;
+	int		read;
+};
+
+/* the -c corpus, padded to a whole number of chunks */
+static uint8_t *corpus;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_page(uint8_t *page, off_t off, unsigned seed)
+{
+	static const char *words[] = {
+		"zram", "page", "swap", "anon", "slot", "heap", "dalvik",
+		"0000", "ffff", "null", "true", "java", "lang", "Object",
+	};
+	size_t pos = 0;
+
+	while (pos < PAGE_SIZE) {
+		const char *w;
+		size_t len;
+
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 4 == 0) {
+			/* some noise, as in real heaps */
+			page[pos++] = seed >> 8;
+			continue;
+		}
+		w = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+		len = strlen(w);
+		if (len > PAGE_SIZE - pos)
+			len = PAGE_SIZE - pos;
+		memcpy(page + pos, w, len);
+		pos += len;
+	}
+	memcpy(page, &off, sizeof(off));
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	uint8_t *buf;
+	off_t off, i;
+
+	if (posix_memalign((void **)&buf, PAGE_SIZE, CHUNK))
+		return (void *)1;
+	for (off = w->start; off < w->start + w->len; off += CHUNK) {
+		if (w->read) {
+			if (pread(w->fd, buf, CHUNK, off) != CHUNK)
+				return (void *)1;
+			if (corpus && memcmp(buf, corpus + off, CHUNK))
+				return (void *)2;
+			continue;
+		}
+		if (corpus)
+			memcpy(buf, corpus + off, CHUNK);
+		else
+			for (i = 0; i < CHUNK; i += PAGE_SIZE)
+				fill_page(buf + i, off + i, off + i);
+		if (pwrite(w->fd, buf, CHUNK, off) != CHUNK)
+			return (void *)1;
+	}
+	free(buf);
+	return NULL;
+}
+
+/* Move @size bytes with @nr threads; returns MB/s */
+static double run(const char *dev, unsigned nr, off_t size, int read)
+{
+	struct worker *w;
+	void *ret;
+	double t;
+	unsigned i;
+	long failed = 0;
+
+	w = calloc(nr, sizeof(*w));
+	for (i = 0; i < nr; i++) {
+		w[i].fd = open(dev, (read ? O_RDONLY : O_WRONLY) | O_DIRECT);
+		if (w[i].fd < 0) {
+			perror(dev);
+			exit(1);
+		}
+		w[i].len = size / nr / CHUNK * CHUNK;
+		w[i].start = i * w[i].len;
+		w[i].read = read;
+	}
+
+	t = now();
+	for (i = 0; i < nr; i++)
+		pthread_create(&w[i].thread, NULL, worker, &w[i]);
+	for (i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, &ret);
+		failed |= (long)ret;
+	}
+	t = now() - t;
+
+	for (i = 0; i < nr; i++)
+		close(w[i].fd);
+	if (failed & 2) {
+		fprintf(stderr, "data read back differs from the corpus\n");
+		exit(1);
+	}
+	if (failed) {
+		fprintf(stderr, "%s failed, is the device big enough?\n",
+			read ? "read" : "write");
+		exit(1);
+	}
+	size = w[0].len * nr;
+	free(w);
+	return size / 1e6 / t;
+}
+
+static void sysfs_write(const char *dev, const char *attr, const char *val)
+{
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s", dev, attr);
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, val, strlen(val)) != (ssize_t)strlen(val)) {
+		fprintf(stderr, "%s < %s: %s\n", path, val, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+}
+
+static unsigned long long sysfs_read(const char *dev, const char *attr)
+{
+	unsigned long long val = 0;
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/%s", dev, attr);
+	f = fopen(path, "r");
+	if (!f || fscanf(f, "%llu", &val) != 1) {
+		perror(path);
+		exit(1);
+	}
+	fclose(f);
+	return val;
+}
+
+static off_t load_corpus(const char *path)
+{
+	off_t size, pos = 0;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || (size = lseek(fd, 0, SEEK_END)) <= 0) {
+		perror(path);
+		exit(1);
+	}
+	size = (size + CHUNK - 1) / CHUNK * CHUNK;
+	corpus = calloc(1, size);
+	if (!corpus) {
+		perror("calloc");
+		exit(1);
+	}
+	while ((len = pread(fd, corpus + pos, size - pos, pos)) > 0)
+		pos += len;
+	close(fd);
+	return size;
+}
+
+static void compare(const char *dev, const char *algs, unsigned threads,
+		    off_t size)
+{
+	char *list = strdup(algs), *alg, *name, val[32];
+	double wr, rd;
+
+	name = basename(strdup(dev));
+	printf("%-8s %7s %10s %10s %10s\n", "alg", "ratio", "used KB",
+	       "write MB/s", "read MB/s");
+	for (alg = strtok(list, ","); alg; alg = strtok(NULL, ",")) {
+		sysfs_write(name, "reset", "1");
+		sysfs_write(name, "comp_algorithm", alg);
+		snprintf(val, sizeof(val), "%llu", (unsigned long long)size);
+		sysfs_write(name, "disksize", val);
+
+		wr = run(dev, threads, size, 0);
+		rd = run(dev, threads, size, 1);
+		printf("%-8s %7.2f %10llu %10.1f %10.1f\n", alg,
+		       (double)sysfs_read(name, "orig_data_size") /
+		       sysfs_read(name, "compr_data_size"),
+		       sysfs_read(name, "mem_used_total") >> 10, wr, rd);
+	}
+	sysfs_write(name, "reset", "1");
+}
+
+/* Dump the anonymous private writable mappings of @pid to @out */
+static void capture(const char *pid, const char *out)
+{
+	unsigned long start, end, total = 0;
+	char path[64], line[512], perms[8], name[256];
+	uint8_t *buf;
+	FILE *maps;
+	int mem, fd;
+
+	snprintf(path, sizeof(path), "/proc/%s/maps", pid);
+	maps = fopen(path, "r");
+	snprintf(path, sizeof(path), "/proc/%s/mem", pid);
+	mem = open(path, O_RDONLY);
+	fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	buf = malloc(PAGE_SIZE);
+	if (!maps || mem < 0 || fd < 0 || !buf) {
+		perror("capture");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), maps)) {
+		unsigned long inode;
+
+		name[0] = '\0';
+		if (sscanf(line, "%lx-%lx %7s %*s %*s %lu %255s", &start, &end,
+			   perms, &inode, name) < 4)
+			continue;
+		if (strncmp(perms, "rw", 2) || perms[3] != 'p' || inode ||
+		    (name[0] && name[0] != '['))
+			continue;
+		for (; start < end; start += PAGE_SIZE) {
+			/* unreadable pages (guard pages and such) are skipped */
+			if (pread(mem, buf, PAGE_SIZE, start) != PAGE_SIZE)
+				continue;
+			if (write(fd, buf, PAGE_SIZE) != PAGE_SIZE) {
+				perror(out);
+				exit(1);
+			}
+			total += PAGE_SIZE;
+		}
+	}
+	printf("%lu KB captured\n", total >> 10);
+	close(fd);
+	close(mem);
+	fclose(maps);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t max-threads] [-s size-mb] device\n"
+		"       %s [-t threads] -c corpus -a alg[,alg...] device\n"
+		"       %s -C pid corpus\n", prog, prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned threads = sysconf(_SC_NPROCESSORS_ONLN), nr;
+	off_t size = 256 << 20;
+	double base = 0, mbs;
+	const char *algs = NULL, *file = NULL, *pid = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:a:c:C:")) != -1) {
+		switch (c) {
+		case 'a':
+			algs = optarg;
+			break;
+		case 'c':
+			file = optarg;
+			break;
+		case 'C':
+			pid = optarg;
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = (off_t)strtoul(optarg, NULL, 0) << 20;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !threads || !size || !file != !algs)
+		usage(argv[0]);
+
+	if (pid) {
+		capture(pid, argv[optind]);
+		return 0;
+	}
+	if (file) {
+		compare(argv[optind], algs, threads, load_corpus(file));
+		return 0;
+	}
+
+	for (nr = 1; ; nr *= 2) {
+		if (nr > threads)
+			nr = threads;
+		mbs = run(argv[optind], nr, size, 0);
+		if (!base)
+			base = mbs;
+		printf("write, %u threads: %.1f MB/s (%.2fx)\n", nr, mbs,
+		       mbs / base);
+		if (nr == threads)
+			break;
+	}
+	printf("read, %u threads: %.1f MB/s\n", threads,
+	       run(argv[optind], threads, size, 1));
+	return 0;
+}